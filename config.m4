@@ -4,6 +4,9 @@ dnl config.m4 for extension ssh2
 PHP_ARG_WITH(ssh2, for ssh2 support,
 [  --with-ssh2=[DIR]       Include ssh2 support])
 
+PHP_ARG_ENABLE(ssh2-threads, whether to run ssh2 handshakes on native threads,
+[  --enable-ssh2-threads     SSH2: Allow ssh2_connect_multi() to run handshakes on native threads], no, no)
+
 if test "$PHP_SSH2" != "no"; then
   SEARCH_PATH="/usr/local /usr"
   SEARCH_FOR="/include/libssh2.h"
@@ -54,7 +57,91 @@ if test "$PHP_SSH2" != "no"; then
     -L$SSH2_DIR/lib -lm 
   ])
 
+  PHP_CHECK_LIBRARY(ssh2,libssh2_keepalive_config,
+  [
+    AC_DEFINE(PHP_SSH2_KEEPALIVE, 1, [Have libssh2 with keepalive support])
+  ],[
+    AC_MSG_WARN([libssh2 < 1.2.5, keepalive support not enabled])
+  ],[
+    -L$SSH2_DIR/lib -lm
+  ])
+
+  PHP_CHECK_LIBRARY(ssh2,libssh2_session_supported_algs,
+  [
+    AC_DEFINE(PHP_SSH2_SUPPORTED_ALGS, 1, [Have libssh2 which lists its supported algorithms])
+  ],[
+    AC_MSG_WARN([libssh2 < 1.4.0, benchmarked method preferences not applied])
+  ],[
+    -L$SSH2_DIR/lib -lm
+  ])
+
+  PHP_CHECK_LIBRARY(ssh2,libssh2_userauth_publickey_frommemory,
+  [
+    AC_DEFINE(PHP_SSH2_PUBKEY_MEMORY, 1, [Have libssh2 which authenticates with keys from memory])
+  ],[
+    AC_MSG_WARN([libssh2 < 1.6.0, ssh2_auth_pubkey_memory() and the key cache not available])
+  ],[
+    -L$SSH2_DIR/lib -lm
+  ])
+
+  PHP_CHECK_LIBRARY(ssh2,libssh2_sftp_get_channel,
+  [
+    AC_DEFINE(PHP_SSH2_SFTP_CHANNEL, 1, [Have libssh2 which exposes the SFTP channel])
+  ],[
+    AC_MSG_WARN([libssh2 < 1.4.0, SFTP stream window sizes not reported])
+  ],[
+    -L$SSH2_DIR/lib -lm
+  ])
+
+  AC_CHECK_HEADER(openssl/evp.h, [
+    PHP_CHECK_LIBRARY(crypto,EVP_CIPHER_CTX_new,
+    [
+      PHP_ADD_LIBRARY(crypto,, SSH2_SHARED_LIBADD)
+      AC_DEFINE(PHP_SSH2_BENCHMARK, 1, [Benchmark crypt and mac methods with libcrypto])
+      AC_DEFINE(PHP_SSH2_KEY_DECRYPT, 1, [Keep private keys decrypted with libcrypto])
+    ],[
+      AC_MSG_WARN([libcrypto not found, ssh2.method_benchmark and ssh2.key_cache_decrypted_ttl not available])
+    ])
+  ])
+
+  AC_CHECK_HEADER(zlib.h, [
+    PHP_CHECK_LIBRARY(z,deflateInit2_,
+    [
+      PHP_ADD_LIBRARY(z,, SSH2_SHARED_LIBADD)
+      AC_DEFINE(PHP_SSH2_ZLIB, 1, [Probe compressibility with zlib])
+    ],[
+      AC_MSG_WARN([zlib not found, 'auto' comp estimates compressibility from byte entropy])
+    ])
+  ])
+
+  AC_CHECK_FUNC(clock_gettime, [
+    AC_DEFINE(PHP_SSH2_MONOTONIC_CLOCK, 1, [Time with clock_gettime(CLOCK_MONOTONIC)])
+  ],[
+    PHP_CHECK_LIBRARY(rt,clock_gettime,
+    [
+      PHP_ADD_LIBRARY(rt,, SSH2_SHARED_LIBADD)
+      AC_DEFINE(PHP_SSH2_MONOTONIC_CLOCK, 1, [Time with clock_gettime(CLOCK_MONOTONIC)])
+    ],[
+      AC_MSG_WARN([clock_gettime() not found, latencies and throughput are timed on the wall clock])
+    ])
+  ])
+
+  if test "$PHP_SSH2_THREADS" != "no"; then
+    AC_CHECK_HEADER(pthread.h, [], [
+      AC_MSG_ERROR([--enable-ssh2-threads requires pthread.h])
+    ])
+    PHP_CHECK_LIBRARY(ssh2,libssh2_init,
+    [
+      PHP_ADD_LIBRARY(pthread,, SSH2_SHARED_LIBADD)
+      AC_DEFINE(PHP_SSH2_THREADS, 1, [Run handshakes on native threads])
+    ],[
+      AC_MSG_ERROR([--enable-ssh2-threads requires libssh2 >= 1.2.5])
+    ],[
+      -L$SSH2_DIR/lib -lm
+    ])
+  fi
+
   PHP_SUBST(SSH2_SHARED_LIBADD)
 
-  PHP_NEW_EXTENSION(ssh2, ssh2.c ssh2_fopen_wrappers.c ssh2_sftp.c, $ext_shared)
+  PHP_NEW_EXTENSION(ssh2, ssh2.c ssh2_fopen_wrappers.c ssh2_sftp.c ssh2_pool.c ssh2_async.c ssh2_threads.c ssh2_network.c ssh2_compress.c ssh2_bench.c ssh2_known_hosts.c ssh2_keys.c ssh2_auth.c ssh2_slab.c ssh2_stats.c ssh2_latency.c, $ext_shared)
 fi
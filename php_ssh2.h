@@ -24,6 +24,8 @@
 #include <libssh2.h>
 #include <libssh2_sftp.h>
 #include "ext/standard/url.h"
+#include "ext/standard/php_smart_str.h"
+#include "main/php_network.h"
 
 #define PHP_SSH2_VERSION        "0.12+dev"
 #define PHP_SSH2_DEFAULT_PORT   22
@@ -33,6 +35,15 @@
 #define PHP_SSH2_FINGERPRINT_SHA1		0x0001
 #define PHP_SSH2_FINGERPRINT_HEX		0x0000
 #define PHP_SSH2_FINGERPRINT_RAW		0x0002
+#ifdef LIBSSH2_HOSTKEY_HASH_SHA256
+#define PHP_SSH2_FINGERPRINT_SHA256		0x0004
+#endif
+
+/* php_ssh2_known_hosts_lookup() results */
+#define PHP_SSH2_KNOWNHOST_MATCH		0
+#define PHP_SSH2_KNOWNHOST_MISMATCH		1
+#define PHP_SSH2_KNOWNHOST_NOTFOUND		2
+#define PHP_SSH2_KNOWNHOST_REVOKED		3
 
 #define PHP_SSH2_TERM_UNIT_CHARS		0x0000
 #define PHP_SSH2_TERM_UNIT_PIXELS		0x0001
@@ -56,9 +67,289 @@
 
 #define PHP_SSH2_DEFAULT_POLL_TIMEOUT	30
 
+#define PHP_SSH2_POOL_RES_NAME			"SSH2 Persistent Session Pool"
+
+/* ssh2_connect_step() return values, same bits as libssh2_session_block_directions() */
+#define PHP_SSH2_ASYNC_WANT_READ		LIBSSH2_SESSION_BLOCK_INBOUND
+#define PHP_SSH2_ASYNC_WANT_WRITE		LIBSSH2_SESSION_BLOCK_OUTBOUND
+
+#define PHP_SSH2_ASYNC_CONNECTING		1
+#define PHP_SSH2_ASYNC_HANDSHAKE		2
+#define PHP_SSH2_ASYNC_AUTH				3
+#define PHP_SSH2_ASYNC_FAILED			4
+
+/* Phases with their own deadline, see php_ssh2_timeouts_parse() */
+#define PHP_SSH2_TIMEOUT_CONNECT		0
+#define PHP_SSH2_TIMEOUT_HANDSHAKE		1
+#define PHP_SSH2_TIMEOUT_AUTH			2
+#define PHP_SSH2_TIMEOUT_OPERATION		3
+#define PHP_SSH2_TIMEOUT_COUNT			4
+
+/* Hosts remembered for their address family when the resolver cache is disabled */
+#define PHP_SSH2_FAMILY_CACHE_SIZE		256
+
+/* Hosts the circuit breaker tracks at most */
+#define PHP_SSH2_BREAKER_CACHE_SIZE		1024
+
+/* Default number of connections ssh2_connect_multi() keeps in flight */
+#define PHP_SSH2_MULTI_CONCURRENCY		64
+
+/* Byte counters are kept by our own send/recv callbacks where libssh2 lets us install them */
+#if defined(LIBSSH2_CALLBACK_SEND) && defined(LIBSSH2_CALLBACK_RECV)
+#define PHP_SSH2_TRAFFIC_COUNTERS		1
+#endif
+
+#ifdef PHP_WIN32
+typedef unsigned __int64 php_ssh2_uint64;
+#else
+typedef unsigned long long php_ssh2_uint64;
+#endif
+
+/* Adaptive compression, payload directions and how much of it gets sampled */
+#define PHP_SSH2_COMP_CS				0
+#define PHP_SSH2_COMP_SC				1
+#define PHP_SSH2_COMP_SAMPLE			4096
+#define PHP_SSH2_COMP_SAMPLE_MAX		(1024 * 1024)
+#define PHP_SSH2_COMP_CACHE_SIZE		256
+
+/* php_ssh2_userauth_publickey() couldn't read the key files, libssh2's own errors are all negative */
+#define PHP_SSH2_KEY_UNREADABLE			1
+
+/* Authentication methods remembered per user and host */
+#define PHP_SSH2_AUTH_PASSWORD			1
+#define PHP_SSH2_AUTH_KBDINT			2
+#define PHP_SSH2_AUTH_PUBKEY			3
+#define PHP_SSH2_AUTH_AGENT				4
+#define PHP_SSH2_AUTH_HINT_CACHE_SIZE	1024
+
+/* Channel kinds and SFTP request types counted by ssh2_session_stats(), see ssh2_stats.c */
+#define PHP_SSH2_CHANNEL_SHELL			0
+#define PHP_SSH2_CHANNEL_EXEC			1
+#define PHP_SSH2_CHANNEL_SCP			2
+#define PHP_SSH2_CHANNEL_DIRECT_TCPIP	3
+#define PHP_SSH2_CHANNEL_FORWARDED		4
+#define PHP_SSH2_CHANNEL_KINDS			5
+
+#define PHP_SSH2_SFTP_OP_OPEN			0
+#define PHP_SSH2_SFTP_OP_READ			1
+#define PHP_SSH2_SFTP_OP_WRITE			2
+#define PHP_SSH2_SFTP_OP_CLOSE			3
+#define PHP_SSH2_SFTP_OP_STAT			4
+#define PHP_SSH2_SFTP_OP_SETSTAT		5
+#define PHP_SSH2_SFTP_OP_OPENDIR		6
+#define PHP_SSH2_SFTP_OP_READDIR		7
+#define PHP_SSH2_SFTP_OP_MKDIR			8
+#define PHP_SSH2_SFTP_OP_RMDIR			9
+#define PHP_SSH2_SFTP_OP_RENAME			10
+#define PHP_SSH2_SFTP_OP_UNLINK			11
+#define PHP_SSH2_SFTP_OP_SYMLINK		12
+#define PHP_SSH2_SFTP_OP_READLINK		13
+#define PHP_SSH2_SFTP_OP_REALPATH		14
+#define PHP_SSH2_SFTP_OPS				15
+
+/* Latency histograms recorded by php_ssh2_latency_record(), see ssh2_latency.c */
+#define PHP_SSH2_LATENCY_CONNECT		0
+#define PHP_SSH2_LATENCY_KEX			1
+#define PHP_SSH2_LATENCY_AUTH			(2 - PHP_SSH2_AUTH_PASSWORD)	/* + PHP_SSH2_AUTH_* */
+#define PHP_SSH2_LATENCY_CHANNEL		6								/* + PHP_SSH2_CHANNEL_* */
+#define PHP_SSH2_LATENCY_SFTP			(PHP_SSH2_LATENCY_CHANNEL + PHP_SSH2_CHANNEL_KINDS)	/* + PHP_SSH2_SFTP_OP_* */
+#define PHP_SSH2_LATENCY_COUNT			(PHP_SSH2_LATENCY_SFTP + PHP_SSH2_SFTP_OPS)
+
+typedef struct _php_ssh2_latency php_ssh2_latency;
+
+/* libssh2 allocations are recycled in power of two size classes from 64 bytes to 64KB, see ssh2_slab.c */
+#define PHP_SSH2_SLAB_MIN_SHIFT			6
+#define PHP_SSH2_SLAB_CLASSES			11
+
+/* Hex MD5 of username/method/credential, see php_ssh2_auth_ident() and php_ssh2_auth_ident_key() */
+#define PHP_SSH2_AUTH_IDENT_LEN			32
+
 extern zend_module_entry ssh2_module_entry;
 #define phpext_ssh2_ptr &ssh2_module_entry
 
+ZEND_BEGIN_MODULE_GLOBALS(ssh2)
+	/* Persistent session pool */
+	long pool_max_idle;
+	long pool_max_idle_per_host;
+	long pool_idle_ttl;
+	long pool_num_idle;
+	long pool_hits;
+	long pool_misses;
+
+	/* Pool pre-warming, see php_ssh2_pool_warm() */
+	char *pool_warm;
+	long pool_warm_budget;
+	long pool_warm_next;
+	long pool_warm_done;
+	long pool_warmed;
+	long pool_warm_failures;
+	long pool_warm_hits;
+
+	/* ZTS: idle sessions go to one pool shared by all threads, see php_ssh2_pool_shared_release() */
+	zend_bool pool_shared;
+
+	/* Resolver cache, see php_ssh2_resolve() */
+	HashTable dns_cache;
+	long dns_cache_size;
+	long dns_cache_ttl;
+	long dns_cache_negative_ttl;
+	long dns_cache_hits;
+	long dns_cache_misses;
+
+	/* Happy eyeballs, host => address family that connected last */
+	HashTable family_cache;
+	long connect_attempt_delay;
+
+	/* Default deadlines in milliseconds, 0 for none (default_socket_timeout for connect) */
+	long timeout_connect;
+	long timeout_handshake;
+	long timeout_auth;
+	long timeout_operation;
+
+	/* Circuit breaker, host:port => php_ssh2_breaker for failing hosts */
+	HashTable breakers;
+	long breaker_threshold;
+	long breaker_backoff;
+	long breaker_backoff_max;
+	long breaker_fast_failures;
+
+	/* Keepalive defaults, methods['keepalive'] overrides them per session */
+	long keepalive_interval;
+	zend_bool keepalive_want_reply;
+
+	/* Pooled sessions retired for reaching their age or volume limits */
+	long pool_retired;
+
+	/* Adaptive compression, host:port => php_ssh2_comp_host */
+	HashTable comp_hosts;
+	double compression_threshold;
+	long compression_max_rate;
+
+	/* Milliseconds per method for the startup crypt/mac benchmark, 0 for off */
+	long method_benchmark;
+
+	/* Host key checking, file name => php_ssh2_known_hosts parsed from it */
+	char *known_hosts_file;
+	zend_bool known_hosts_strict;
+	HashTable known_hosts;
+
+	/* Request scoped wrapper connections, see php_ssh2_fopen_wraper_parse_path() */
+	HashTable wrapper_cache;
+	long wrapper_cache_hits;
+
+	/* Key files by path and decrypted private keys by path|MD5(passphrase), see ssh2_keys.c */
+	HashTable key_files;
+	HashTable key_plain;
+	char *key_home;
+	long key_cache_size;
+	long key_cache_decrypted_ttl;
+
+	/* user@host:port => method that authenticated last, see ssh2_auth.c */
+	HashTable auth_hints;
+
+	/* Bytes of freed libssh2 allocations each session may keep for reuse, see ssh2_slab.c */
+	long slab_cache;
+	zend_bool slab_persistent;
+
+	/* Default for methods['memory']['limit'] */
+	long session_memory_limit;
+
+	/* Allocated on first use, see ssh2_latency.c */
+	php_ssh2_latency *latency[PHP_SSH2_LATENCY_COUNT];
+ZEND_END_MODULE_GLOBALS(ssh2)
+
+ZEND_EXTERN_MODULE_GLOBALS(ssh2)
+
+#ifdef ZTS
+#define SSH2_G(v) TSRMG(ssh2_globals_id, zend_ssh2_globals *, v)
+#else
+#define SSH2_G(v) (ssh2_globals.v)
+#endif
+
+/* A parsed known_hosts file, see ssh2_known_hosts.c */
+typedef struct _php_ssh2_known_hosts php_ssh2_known_hosts;
+
+/* State of a session created by ssh2_connect_async(), freed once established */
+typedef struct _php_ssh2_async_data {
+	int state;
+	int want;
+
+	/* Wall clock milliseconds the current state has to finish by, 0 for never */
+	double deadline;
+
+	/* php_ssh2_comp_clock() the current state started at, for the latency histograms */
+	double phase_started;
+
+	/* Optional credentials to authenticate with once the handshake is done */
+	char *username;
+	int username_len;
+	char *password;
+	int password_len;
+	char *pubkey_file;
+	char *privkey_file;
+	char *passphrase;
+
+	/* Reported to the circuit breaker once the handshake succeeds or fails */
+	char *host;
+	int port;
+
+	/* Why the connection failed, once state is PHP_SSH2_ASYNC_FAILED */
+	char *error;
+} php_ssh2_async_data;
+
+/* Socket tuning from methods['socket'], see php_ssh2_sockopts_parse() */
+typedef struct _php_ssh2_sockopts {
+	/* -1 leaves the system default alone */
+	int tcp_nodelay;
+	int sndbuf;
+	int rcvbuf;
+	int keepalive;
+	int keepidle;
+	int keepintvl;
+	int keepcnt;
+	int user_timeout;
+	int tos;
+} php_ssh2_sockopts;
+
+typedef struct _php_ssh2_slab {
+	/* Freed blocks per size class, linked through their first bytes */
+	void *free[PHP_SSH2_SLAB_CLASSES];
+	size_t cached;
+	size_t cache_max;
+	int persistent;
+
+	long hits;
+	long misses;
+
+	/* Bytes handed to libssh2 and not freed yet, their high water mark and the number of allocations
+	 * Allocations which would take bytes past limit fail, 0 for no limit */
+	size_t bytes;
+	size_t peak;
+	long allocations;
+	size_t limit;
+	long limit_failures;
+} php_ssh2_slab;
+
+typedef struct _php_ssh2_session_stats {
+	/* send()/recv() calls which moved data, libssh2 doesn't report packets */
+	long sends;
+	long recvs;
+
+	/* Payload through channels and SFTP */
+	php_ssh2_uint64 channel_bytes_written;
+	php_ssh2_uint64 channel_bytes_read;
+	php_ssh2_uint64 sftp_bytes_written;
+	php_ssh2_uint64 sftp_bytes_read;
+
+	long channels_opened[PHP_SSH2_CHANNEL_KINDS];
+	long channels_closed;
+	long sftp_requests[PHP_SSH2_SFTP_OPS];
+
+	/* Calls which would have blocked, milliseconds spent inside libssh2 */
+	long eagain;
+	double blocked;
+} php_ssh2_session_stats;
+
 typedef struct _php_ssh2_session_data {
 	/* Userspace callback functions */
 	zval *ignore_cb;
@@ -68,6 +359,66 @@ typedef struct _php_ssh2_session_data {
 
 	int socket;
 
+	/* Back reference, the session owns this structure via its abstract */
+	LIBSSH2_SESSION *session;
+
+	/* Persistent sessions are allocated with pemalloc() and returned to the pool
+	 * by the resource destructor instead of being disconnected */
+	char persistent;
+	char *pool_key;
+	int pool_key_len;
+	char *host;
+	int port;
+	time_t last_used;
+	struct _php_ssh2_session_data *pool_next;
+	char warmed;
+
+	/* Who we authenticated as, so a pooled session can be handed out again */
+	char auth_ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	/* Checked out of the pool authenticated, unusable until the caller
+	 * authenticates with that same identity, see php_ssh2_session_auth_remember() */
+	char auth_locked;
+
+	/* Non-NULL while a non-blocking connect is in progress */
+	php_ssh2_async_data *async;
+
+	/* Milliseconds per PHP_SSH2_TIMEOUT_* phase */
+	long timeouts[PHP_SSH2_TIMEOUT_COUNT];
+
+	/* Seconds between keepalives, 0 when they are off */
+	int keepalive_interval;
+
+	/* Traffic since the handshake and the pool retirement limits from methods['retire'], 0 for none */
+	time_t established;
+	php_ssh2_uint64 bytes_sent;
+	php_ssh2_uint64 bytes_received;
+	php_ssh2_uint64 retire_bytes;
+	long retire_time;
+
+	/* Channel and SFTP payload per PHP_SSH2_COMP_* direction, milliseconds spent moving it
+	 * and the estimated compressed size in bits of the sampled part, see php_ssh2_comp_sample() */
+	php_ssh2_uint64 payload[2];
+	double busy[2];
+	php_ssh2_uint64 sampled[2];
+	double sampled_bits[2];
+
+	/* known_hosts file the host key is checked against, NULL for none */
+	char *known_hosts;
+	char known_hosts_strict;
+
+	/* SFTP subsystem the stream wrapper shares, started on first use */
+	LIBSSH2_SFTP *sftp;
+
+	/* Answer for the keyboard-interactive callback, only set while authenticating */
+	char *kbd_password;
+	int kbd_password_len;
+
+	/* Recycled libssh2 allocations, must outlive libssh2_session_free() */
+	php_ssh2_slab slab;
+
+	/* ssh2_session_stats() */
+	php_ssh2_session_stats stats;
+
 #ifdef ZTS
 	/* Avoid unnecessary TSRMLS_FETCH() calls */
 	TSRMLS_D;
@@ -79,6 +430,9 @@ typedef struct _php_ssh2_sftp_data {
     LIBSSH2_SFTP *sftp;
 
     int session_rsrcid;
+
+    /* sftp is the session's own, see php_ssh2_session_sftp() */
+    int shared;
 } php_ssh2_sftp_data;
 
 typedef struct _php_ssh2_listener_data {
@@ -141,16 +495,43 @@ typedef struct _php_ssh2_pkey_subsys_data {
 #define Z_UNSET_ISREF_PP(ppz)         Z_UNSET_ISREF_P(*(ppz))
 #endif
 
+#define SSH2_SESSION_PENDING(session) \
+	((*(php_ssh2_session_data**)libssh2_session_abstract(session)) && (*(php_ssh2_session_data**)libssh2_session_abstract(session))->async)
+
+#define SSH2_SESSION_LOCKED(session) \
+	((*(php_ssh2_session_data**)libssh2_session_abstract(session)) && (*(php_ssh2_session_data**)libssh2_session_abstract(session))->auth_locked)
+
 #define SSH2_FETCH_NONAUTHENTICATED_SESSION(session, zsession) \
 ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session); \
+if (SSH2_SESSION_PENDING(session)) { \
+	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet"); \
+	RETURN_FALSE; \
+} \
+if (libssh2_userauth_authenticated(session)) { \
+	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection already authenticated"); \
+	RETURN_FALSE; \
+}
+
+/* Like SSH2_FETCH_NONAUTHENTICATED_SESSION, but a pooled session which was already
+ * authenticated with the very same identity is accepted as is (and unlocked) */
+#define SSH2_FETCH_NONAUTHENTICATED_SESSION_IDENT(session, zsession, ident) \
+ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session); \
+if (SSH2_SESSION_PENDING(session)) { \
+	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet"); \
+	RETURN_FALSE; \
+} \
 if (libssh2_userauth_authenticated(session)) { \
+	if (php_ssh2_session_auth_matches(session, ident)) { \
+		php_ssh2_session_auth_remember(session, ident); \
+		RETURN_TRUE; \
+	} \
 	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection already authenticated"); \
 	RETURN_FALSE; \
 }
 
 #define SSH2_FETCH_AUTHENTICATED_SESSION(session, zsession) \
 ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session); \
-if (!libssh2_userauth_authenticated(session)) { \
+if (!libssh2_userauth_authenticated(session) || SSH2_SESSION_LOCKED(session)) { \
 	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not authenticated"); \
 	RETURN_FALSE; \
 }
@@ -169,6 +550,10 @@ typedef struct _php_ssh2_channel_data {
 	/* Allow one stream to be closed while the other is kept open */
 	unsigned char *refcount;
 
+	/* Payload through this stream, for stream_get_meta_data() */
+	php_ssh2_uint64 bytes_read;
+	php_ssh2_uint64 bytes_written;
+
 } php_ssh2_channel_data;
 
 /* In ssh2_fopen_wrappers.c */
@@ -178,8 +563,133 @@ PHP_FUNCTION(ssh2_tunnel);
 PHP_FUNCTION(ssh2_scp_recv);
 PHP_FUNCTION(ssh2_scp_send);
 PHP_FUNCTION(ssh2_fetch_stream);
+void php_ssh2_wrapper_cache_dtor(void *pDest);
+
+/* In ssh2_pool.c */
+LIBSSH2_SESSION *php_ssh2_pool_checkout(char *key, int key_len TSRMLS_DC);
+int php_ssh2_pool_release(LIBSSH2_SESSION *session TSRMLS_DC);
+void php_ssh2_pool_key(smart_str *key, char *host, int port, char *username, int username_len, zval *methods TSRMLS_DC);
+void php_ssh2_pool_bucket_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC);
+void php_ssh2_pool_warm(TSRMLS_D);
+#ifdef ZTS
+void php_ssh2_pool_shared_startup(void);
+void php_ssh2_pool_shared_shutdown(TSRMLS_D);
+long php_ssh2_pool_shared_num_idle(void);
+#endif
+
+/* In ssh2_async.c */
+PHP_FUNCTION(ssh2_connect_async);
+PHP_FUNCTION(ssh2_connect_step);
+PHP_FUNCTION(ssh2_connect_wait);
+PHP_FUNCTION(ssh2_connect_multi);
+
+LIBSSH2_SESSION *php_ssh2_async_connect(char *host, int port, zval *methods, zval *callbacks, zval *auth, char **error TSRMLS_DC);
+int php_ssh2_async_step(LIBSSH2_SESSION *session TSRMLS_DC);
+void php_ssh2_async_free(php_ssh2_async_data *async);
+
+#ifdef PHP_SSH2_THREADS
+/* In ssh2_threads.c */
+typedef struct _php_ssh2_thread_job {
+	/* Set up by the PHP thread, the session must use the persistent allocators and have no userspace callbacks */
+	char *host;
+	int port;
+	long timeout;
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	int tag;
+	php_ssh2_sockopts sockopts;
+	/* Referenced so reloading the file on this thread can't free it under a worker */
+	php_ssh2_known_hosts *known_hosts;
+	int known_hosts_strict;
+
+	/* Filled in by the worker */
+	int failed;
+	int handshaken;
+	char error[256];
+} php_ssh2_thread_job;
+
+void php_ssh2_threads_run(php_ssh2_thread_job *jobs, int num_jobs, int num_threads);
+#endif
+
+/* In ssh2_network.c */
+void php_ssh2_sockopts_parse(zval *methods, php_ssh2_sockopts *opts TSRMLS_DC);
+const char *php_ssh2_sockopts_apply(int sock, php_ssh2_sockopts *opts);
+int php_ssh2_resolve(char *host, struct sockaddr ***sal, char **error TSRMLS_DC);
+int php_ssh2_connect_socket(char *host, int port, int asynchronous, struct timeval *timeout, char **error TSRMLS_DC);
+void php_ssh2_dns_entry_dtor(void *pDest);
+int php_ssh2_breaker_allow(char *host, int port, char **error TSRMLS_DC);
+void php_ssh2_breaker_record(char *host, int port, int success TSRMLS_DC);
+PHP_FUNCTION(ssh2_breaker_stats);
+
+/* In ssh2_compress.c */
+double php_ssh2_comp_clock(void);
+void php_ssh2_comp_sample(LIBSSH2_SESSION *session, int direction, const char *buf, ssize_t len, double started);
+void php_ssh2_comp_auto(LIBSSH2_SESSION *session, zval *methods TSRMLS_DC);
+void php_ssh2_comp_learn(php_ssh2_session_data *data TSRMLS_DC);
+PHP_FUNCTION(ssh2_compression_stats);
+
+/* In ssh2_known_hosts.c */
+php_ssh2_known_hosts *php_ssh2_known_hosts_get(char *filename TSRMLS_DC);
+int php_ssh2_known_hosts_lookup(php_ssh2_known_hosts *kh, char *host, int port, const char *blob, size_t blob_len, int type, int memoize);
+void php_ssh2_known_hosts_prime(php_ssh2_known_hosts *kh, char *host, int port);
+void php_ssh2_known_hosts_policy(zval *methods, char **pfile, int *pstrict TSRMLS_DC);
+void php_ssh2_known_hosts_config(php_ssh2_session_data *data, zval *methods TSRMLS_DC);
+int php_ssh2_known_hosts_verify(LIBSSH2_SESSION *session, char **error TSRMLS_DC);
+void php_ssh2_known_hosts_addref(php_ssh2_known_hosts *kh);
+void php_ssh2_known_hosts_release(php_ssh2_known_hosts *kh);
+void php_ssh2_known_hosts_dtor(void *pDest);
+PHP_FUNCTION(ssh2_known_hosts_check);
+
+/* In ssh2_auth.c */
+char *php_ssh2_auth_method_name(int method);
+int php_ssh2_userauth_password(LIBSSH2_SESSION *session, char *username, int username_len, char *password, int password_len TSRMLS_DC);
+#ifdef PHP_SSH2_AGENT_AUTH
+int php_ssh2_userauth_agent(LIBSSH2_SESSION *session, char *username, int username_len, char *ident, char **error TSRMLS_DC);
+int php_ssh2_agent_auth_matches(LIBSSH2_SESSION *session, char *username, int username_len, char *ident TSRMLS_DC);
+#endif
+PHP_FUNCTION(ssh2_auth_auto);
+
+/* In ssh2_keys.c */
+int php_ssh2_userauth_publickey(LIBSSH2_SESSION *session, char *username, int username_len, char *pubkey, char *privkey, char *passphrase TSRMLS_DC);
+void php_ssh2_auth_ident_key(char *ident, char *username, int username_len, char *method, char *key, size_t key_len, char *passphrase);
+int php_ssh2_auth_ident_keyfile(char *ident, char *username, int username_len, char *method, char *pubkey, char *privkey, char *passphrase TSRMLS_DC);
+void php_ssh2_key_dtor(void *pDest);
+PHP_FUNCTION(ssh2_auth_pubkey_memory);
+PHP_FUNCTION(ssh2_key_cache_clear);
+
+/* In ssh2_slab.c */
+void php_ssh2_slab_init(php_ssh2_slab *slab, long cache_max, long limit, int persistent);
+void *php_ssh2_slab_alloc(php_ssh2_slab *slab, size_t count);
+void php_ssh2_slab_free(php_ssh2_slab *slab, void *ptr);
+void *php_ssh2_slab_realloc(php_ssh2_slab *slab, void *ptr, size_t count);
+void php_ssh2_slab_release(php_ssh2_slab *slab);
+void php_ssh2_slab_meta(zval *arr, LIBSSH2_SESSION *session);
+PHP_FUNCTION(ssh2_session_memory);
+
+/* In ssh2_stats.c */
+void php_ssh2_stats_io(LIBSSH2_SESSION *session, int direction, ssize_t rc, double started);
+void php_ssh2_stats_sftp(LIBSSH2_SESSION *session, int op, ssize_t rc, double started);
+void php_ssh2_stats_channel_open(LIBSSH2_SESSION *session, int kind, LIBSSH2_CHANNEL *channel, double started);
+void php_ssh2_channel_free(LIBSSH2_SESSION *session, LIBSSH2_CHANNEL *channel);
+void php_ssh2_channel_meta(zval *arr, LIBSSH2_CHANNEL *channel);
+void php_ssh2_session_meta(zval *arr, long session_rsrcid TSRMLS_DC);
+PHP_FUNCTION(ssh2_session_stats);
+
+/* In ssh2_latency.c */
+void php_ssh2_latency_record(int histogram, double started TSRMLS_DC);
+void php_ssh2_latency_free(php_ssh2_latency **latency);
+PHP_FUNCTION(ssh2_latency_stats);
+PHP_FUNCTION(ssh2_latency_reset);
+
+/* In ssh2_bench.c */
+void php_ssh2_bench_run(long budget);
+void php_ssh2_bench_prefer(LIBSSH2_SESSION *session);
+void php_ssh2_bench_info(void);
+void php_ssh2_bench_free(void);
 
 /* In ssh2_sftp.c */
+LIBSSH2_SFTP *php_ssh2_session_sftp(LIBSSH2_SESSION *session);
+int php_ssh2_sftp_register_shared(LIBSSH2_SESSION *session, int session_rsrcid TSRMLS_DC);
 PHP_FUNCTION(ssh2_sftp);
 
 PHP_FUNCTION(ssh2_sftp_rename);
@@ -194,6 +704,23 @@ PHP_FUNCTION(ssh2_sftp_readlink);
 PHP_FUNCTION(ssh2_sftp_realpath);
 
 LIBSSH2_SESSION *php_ssh2_session_connect(char *host, int port, zval *methods, zval *callbacks TSRMLS_DC);
+LIBSSH2_SESSION *php_ssh2_session_connect_ex(char *host, int port, zval *methods, zval *callbacks, int persistent TSRMLS_DC);
+LIBSSH2_SESSION *php_ssh2_session_init(char *host, int port, int socket, zval *methods, zval *callbacks, int persistent TSRMLS_DC);
+void php_ssh2_session_set_callbacks(LIBSSH2_SESSION *session, zval *callbacks, php_ssh2_session_data *data TSRMLS_DC);
+void php_ssh2_timeouts_parse(zval *methods, long *timeouts TSRMLS_DC);
+void php_ssh2_session_timeout(LIBSSH2_SESSION *session, int phase);
+void php_ssh2_session_timeout_ms(LIBSSH2_SESSION *session, long ms);
+void php_ssh2_keepalive_config(LIBSSH2_SESSION *session, zval *methods TSRMLS_DC);
+void php_ssh2_session_reconfigure(LIBSSH2_SESSION *session, zval *methods TSRMLS_DC);
+int php_ssh2_keepalive(LIBSSH2_SESSION *session);
+int php_ssh2_retire_due(php_ssh2_session_data *data);
+void php_ssh2_add_assoc_counter(zval *arr, char *key, php_ssh2_uint64 value);
+void php_ssh2_session_destroy(LIBSSH2_SESSION *session TSRMLS_DC);
+void php_ssh2_session_free(LIBSSH2_SESSION *session TSRMLS_DC);
+void php_ssh2_session_clear_callbacks(php_ssh2_session_data *data TSRMLS_DC);
+void php_ssh2_auth_ident(char *ident, char *username, int username_len, char *method, char *credential, int credential_len);
+int php_ssh2_session_auth_matches(LIBSSH2_SESSION *session, char *ident);
+void php_ssh2_session_auth_remember(LIBSSH2_SESSION *session, char *ident);
 void php_ssh2_sftp_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC);
 php_url *php_ssh2_fopen_wraper_parse_path(	char *path, char *type, php_stream_context *context,
 											LIBSSH2_SESSION **psession, int *presource_id,
@@ -211,6 +738,7 @@ extern php_stream_wrapper php_ssh2_sftp_wrapper;
 /* Resource list entries */
 extern int le_ssh2_session;
 extern int le_ssh2_sftp;
+extern int le_ssh2_pool;
 
 /* {{{ ZIP_OPENBASEDIR_CHECKPATH(filename) */
 #if PHP_API_VERSION < 20100412
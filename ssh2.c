@@ -25,6 +25,7 @@
 #include "php.h"
 #include "ext/standard/info.h"
 #include "ext/standard/file.h"
+#include "ext/standard/md5.h"
 #include "php_ssh2.h"
 #include "main/php_network.h"
 
@@ -46,6 +47,44 @@ int le_ssh2_session;
 int le_ssh2_listener;
 int le_ssh2_sftp;
 int le_ssh2_pkey_subsys;
+int le_ssh2_pool;
+
+ZEND_DECLARE_MODULE_GLOBALS(ssh2)
+
+/* {{{ PHP_INI
+ */
+PHP_INI_BEGIN()
+	STD_PHP_INI_ENTRY("ssh2.pool_max_idle",				"32",	PHP_INI_ALL,	OnUpdateLong,	pool_max_idle,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.pool_max_idle_per_host",	"4",	PHP_INI_ALL,	OnUpdateLong,	pool_max_idle_per_host,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.pool_idle_ttl",				"300",	PHP_INI_ALL,	OnUpdateLong,	pool_idle_ttl,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.pool_warm",					"",		PHP_INI_SYSTEM,	OnUpdateString,	pool_warm,				zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.pool_warm_budget",			"1000",	PHP_INI_SYSTEM,	OnUpdateLong,	pool_warm_budget,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.pool_shared",				"0",	PHP_INI_SYSTEM,	OnUpdateBool,	pool_shared,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.dns_cache_size",			"256",	PHP_INI_ALL,	OnUpdateLong,	dns_cache_size,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.dns_cache_ttl",				"60",	PHP_INI_ALL,	OnUpdateLong,	dns_cache_ttl,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.dns_cache_negative_ttl",	"5",	PHP_INI_ALL,	OnUpdateLong,	dns_cache_negative_ttl,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.connect_attempt_delay",		"250",	PHP_INI_ALL,	OnUpdateLong,	connect_attempt_delay,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.connect_timeout",			"0",	PHP_INI_ALL,	OnUpdateLong,	timeout_connect,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.handshake_timeout",			"0",	PHP_INI_ALL,	OnUpdateLong,	timeout_handshake,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.auth_timeout",				"0",	PHP_INI_ALL,	OnUpdateLong,	timeout_auth,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.operation_timeout",			"0",	PHP_INI_ALL,	OnUpdateLong,	timeout_operation,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.breaker_threshold",			"5",	PHP_INI_ALL,	OnUpdateLong,	breaker_threshold,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.breaker_backoff",			"1000",	PHP_INI_ALL,	OnUpdateLong,	breaker_backoff,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.breaker_backoff_max",		"60000",	PHP_INI_ALL,	OnUpdateLong,	breaker_backoff_max,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.keepalive_interval",		"0",	PHP_INI_ALL,	OnUpdateLong,	keepalive_interval,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.keepalive_want_reply",		"0",	PHP_INI_ALL,	OnUpdateBool,	keepalive_want_reply,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.compression_threshold",		"0.7",	PHP_INI_ALL,	OnUpdateReal,	compression_threshold,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.compression_max_rate",		"4194304",	PHP_INI_ALL,	OnUpdateLong,	compression_max_rate,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.method_benchmark",			"0",	PHP_INI_SYSTEM,	OnUpdateLong,	method_benchmark,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.known_hosts",				"",		PHP_INI_ALL,	OnUpdateString,	known_hosts_file,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.known_hosts_strict",		"1",	PHP_INI_ALL,	OnUpdateBool,	known_hosts_strict,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.key_cache_size",			"64",	PHP_INI_ALL,	OnUpdateLong,	key_cache_size,			zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.key_cache_decrypted_ttl",	"0",	PHP_INI_SYSTEM,	OnUpdateLong,	key_cache_decrypted_ttl,	zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.slab_cache",				"262144",	PHP_INI_ALL,	OnUpdateLong,	slab_cache,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.slab_persistent",			"0",	PHP_INI_ALL,	OnUpdateBool,	slab_persistent,		zend_ssh2_globals,	ssh2_globals)
+	STD_PHP_INI_ENTRY("ssh2.session_memory_limit",		"0",	PHP_INI_ALL,	OnUpdateLong,	session_memory_limit,	zend_ssh2_globals,	ssh2_globals)
+PHP_INI_END()
+/* }}} */
 
 ZEND_BEGIN_ARG_INFO(php_ssh2_first_arg_force_ref, 0)
     ZEND_ARG_PASS_INFO(1)
@@ -62,29 +101,27 @@ ZEND_END_ARG_INFO()
 #endif
 
 /* {{{ php_ssh2_alloc_cb
- * Wrap emalloc()
+ * Allocate from the session's slabs, see ssh2_slab.c
  */
 static LIBSSH2_ALLOC_FUNC(php_ssh2_alloc_cb)
 {
-	return emalloc(count);
+	return php_ssh2_slab_alloc(&(*(php_ssh2_session_data**)abstract)->slab, count);
 }
 /* }}} */
 
 /* {{{ php_ssh2_free_cb
- * Wrap efree()
  */
 static LIBSSH2_FREE_FUNC(php_ssh2_free_cb)
 {
-	efree(ptr);
+	php_ssh2_slab_free(&(*(php_ssh2_session_data**)abstract)->slab, ptr);
 }
 /* }}} */
 
 /* {{{ php_ssh2_realloc_cb
- * Wrap erealloc()
  */
 static LIBSSH2_REALLOC_FUNC(php_ssh2_realloc_cb)
 {
-	return erealloc(ptr, count);
+	return php_ssh2_slab_realloc(&(*(php_ssh2_session_data**)abstract)->slab, ptr, count);
 }
 /* }}} */
 
@@ -236,7 +273,59 @@ LIBSSH2_DISCONNECT_FUNC(php_ssh2_disconnect_cb)
 }
 /* }}} */
 
+#ifdef PHP_SSH2_TRAFFIC_COUNTERS
+/* {{{ php_ssh2_socket_error
+ * libssh2 wants the negated errno back, EAGAIN for a socket which would block
+ */
+static ssize_t php_ssh2_socket_error(void)
+{
+	int err = php_socket_errno();
+
+#ifdef PHP_WIN32
+	if (err == WSAEWOULDBLOCK) {
+		return -EAGAIN;
+	}
+#endif
+	return -err;
+}
+/* }}} */
 
+/* {{{ php_ssh2_send_cb
+ * Plain send() counting the bytes, may run on a handshake thread so it stays clear of the engine
+ */
+static LIBSSH2_SEND_FUNC(php_ssh2_send_cb)
+{
+	php_ssh2_session_data *data = (php_ssh2_session_data*)*abstract;
+	ssize_t rc = send(socket, (const char*)buffer, length, flags);
+
+	if (rc < 0) {
+		return php_ssh2_socket_error();
+	}
+	data->bytes_sent += rc;
+	data->stats.sends++;
+
+	return rc;
+}
+/* }}} */
+
+/* {{{ php_ssh2_recv_cb
+ * Plain recv() counting the bytes
+ */
+static LIBSSH2_RECV_FUNC(php_ssh2_recv_cb)
+{
+	php_ssh2_session_data *data = (php_ssh2_session_data*)*abstract;
+	ssize_t rc = recv(socket, (char*)buffer, length, flags);
+
+	if (rc < 0) {
+		return php_ssh2_socket_error();
+	}
+	data->bytes_received += rc;
+	data->stats.recvs++;
+
+	return rc;
+}
+/* }}} */
+#endif /* PHP_SSH2_TRAFFIC_COUNTERS */
 
 /* *****************
    * Userspace API *
@@ -317,48 +406,378 @@ static int php_ssh2_set_method(LIBSSH2_SESSION *session, HashTable *ht, char *me
 		return -1;
 	}
 
+	/* Left to php_ssh2_comp_auto() */
+	if ((method_type == LIBSSH2_METHOD_COMP_CS || method_type == LIBSSH2_METHOD_COMP_SC) && strcmp(Z_STRVAL_PP(value), "auto") == 0) {
+		return 0;
+	}
+
 	return libssh2_session_method_pref(session, method_type, Z_STRVAL_PP(value));
 }
 /* }}} */
 
-/* {{{ php_ssh2_session_connect
- * Connect to an SSH server with requested methods
+/* {{{ php_ssh2_timeouts_parse
+ * Deadlines for each phase in milliseconds, the ssh2.*_timeout defaults overridden by methods['timeouts']
+ * ('connect', 'handshake', 'auth', 'operation'), a connect timeout of 0 falls back on default_socket_timeout
  */
-LIBSSH2_SESSION *php_ssh2_session_connect(char *host, int port, zval *methods, zval *callbacks TSRMLS_DC)
+void php_ssh2_timeouts_parse(zval *methods, long *timeouts TSRMLS_DC)
 {
-	LIBSSH2_SESSION *session;
-	int socket;
-	php_ssh2_session_data *data;
-	struct timeval tv;
+	static char *names[PHP_SSH2_TIMEOUT_COUNT] = { "connect", "handshake", "auth", "operation" };
+	zval **container, **value;
+	int i;
+
+	timeouts[PHP_SSH2_TIMEOUT_CONNECT] = SSH2_G(timeout_connect);
+	timeouts[PHP_SSH2_TIMEOUT_HANDSHAKE] = SSH2_G(timeout_handshake);
+	timeouts[PHP_SSH2_TIMEOUT_AUTH] = SSH2_G(timeout_auth);
+	timeouts[PHP_SSH2_TIMEOUT_OPERATION] = SSH2_G(timeout_operation);
+
+	if (methods && Z_TYPE_P(methods) == IS_ARRAY &&
+		zend_hash_find(Z_ARRVAL_P(methods), "timeouts", sizeof("timeouts"), (void**)&container) == SUCCESS &&
+		container && *container && Z_TYPE_PP(container) == IS_ARRAY) {
+		for(i = 0; i < PHP_SSH2_TIMEOUT_COUNT; i++) {
+			if (zend_hash_find(Z_ARRVAL_PP(container), names[i], strlen(names[i]) + 1, (void**)&value) == SUCCESS &&
+				value && *value && Z_TYPE_PP(value) != IS_NULL) {
+				zval tmp = **value;
+
+				zval_copy_ctor(&tmp);
+				convert_to_long(&tmp);
+				timeouts[i] = Z_LVAL(tmp) > 0 ? Z_LVAL(tmp) : 0;
+			}
+		}
+	}
+
+	if (timeouts[PHP_SSH2_TIMEOUT_CONNECT] <= 0) {
+		timeouts[PHP_SSH2_TIMEOUT_CONNECT] = FG(default_socket_timeout) * 1000;
+	}
+}
+/* }}} */
 
-	tv.tv_sec = FG(default_socket_timeout);
-	tv.tv_usec = 0;
+/* {{{ php_ssh2_session_timeout
+ * Make blocking libssh2 calls give up after the deadline for the given phase
+ */
+void php_ssh2_session_timeout(LIBSSH2_SESSION *session, int phase)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
 
-#if PHP_MAJOR_VERSION > 5 || (PHP_MAJOR_VERSION == 5 && PHP_MINOR_VERSION > 0)
-	socket = php_network_connect_socket_to_host(host, port, SOCK_STREAM, 0, &tv, NULL, NULL, NULL, 0 TSRMLS_CC);
-#elif PHP_MAJOR_VERSION == 5
-	socket = php_network_connect_socket_to_host(host, port, SOCK_STREAM, 0, &tv, NULL, NULL TSRMLS_CC);
+	if (data) {
+		php_ssh2_session_timeout_ms(session, data->timeouts[phase]);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_timeout_ms
+ * Explicit timeout for the next call, 0 restores the session's operation timeout
+ */
+void php_ssh2_session_timeout_ms(LIBSSH2_SESSION *session, long ms)
+{
+#ifdef PHP_SSH2_SESSION_TIMEOUT
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	if (!ms && data) {
+		ms = data->timeouts[PHP_SSH2_TIMEOUT_OPERATION];
+	}
+	libssh2_session_set_timeout(session, ms);
+#endif
+}
+/* }}} */
+
+/* {{{ php_ssh2_keepalive_config
+ * Keepalive interval in seconds and whether the server should answer, from methods['keepalive']
+ * ('interval', 'want_reply') or a plain number of seconds, ssh2.keepalive_* otherwise
+ */
+void php_ssh2_keepalive_config(LIBSSH2_SESSION *session, zval *methods TSRMLS_DC)
+{
+	long interval = SSH2_G(keepalive_interval);
+	int want_reply = SSH2_G(keepalive_want_reply);
+	zval **container, **value;
+
+	if (methods && Z_TYPE_P(methods) == IS_ARRAY &&
+		zend_hash_find(Z_ARRVAL_P(methods), "keepalive", sizeof("keepalive"), (void**)&container) == SUCCESS &&
+		container && *container) {
+		zval tmp;
+
+		if (Z_TYPE_PP(container) == IS_ARRAY) {
+			if (zend_hash_find(Z_ARRVAL_PP(container), "interval", sizeof("interval"), (void**)&value) == SUCCESS &&
+				value && *value) {
+				tmp = **value;
+				zval_copy_ctor(&tmp);
+				convert_to_long(&tmp);
+				interval = Z_LVAL(tmp);
+			}
+			if (zend_hash_find(Z_ARRVAL_PP(container), "want_reply", sizeof("want_reply"), (void**)&value) == SUCCESS &&
+				value && *value) {
+				tmp = **value;
+				zval_copy_ctor(&tmp);
+				convert_to_boolean(&tmp);
+				want_reply = Z_BVAL(tmp);
+			}
+		} else {
+			tmp = **container;
+			zval_copy_ctor(&tmp);
+			convert_to_long(&tmp);
+			interval = Z_LVAL(tmp);
+		}
+	}
+
+	if (interval < 0) {
+		interval = 0;
+	}
+
+#ifdef PHP_SSH2_KEEPALIVE
+	(*(php_ssh2_session_data**)libssh2_session_abstract(session))->keepalive_interval = interval;
+	libssh2_keepalive_config(session, want_reply, (unsigned int)interval);
 #else
-	socket = php_hostconnect(host, port, SOCK_STREAM, &tv TSRMLS_CC);
+	if (interval > 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Upgrade the libssh2 library (needs 1.2.5 or higher) and reinstall the ssh2 extension for keepalive support");
+	}
 #endif
+}
+/* }}} */
 
-	if (socket <= 0) {
-		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to connect to %s on port %d", host, port);
-		return NULL;
+/* {{{ php_ssh2_keepalive
+ * Send a keepalive if one is due, cheap enough to call from any read or poll
+ * Returns the seconds until the next one is due (0 when they are off), -1 when sending failed
+ */
+int php_ssh2_keepalive(LIBSSH2_SESSION *session)
+{
+#ifdef PHP_SSH2_KEEPALIVE
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	int next = 0;
+
+	if (!data || data->async || data->keepalive_interval <= 0) {
+		return 0;
+	}
+
+	/* A non-blocking session which can't write right now leaves the packet queued, libssh2 doesn't report that */
+	if (libssh2_keepalive_send(session, &next)) {
+		return -1;
+	}
+
+	return next;
+#else
+	return 0;
+#endif
+}
+/* }}} */
+
+/* {{{ php_ssh2_retire_config
+ * Data volume ('bytes') and age ('time', seconds) limits from methods['retire']
+ * These only decide whether the pool hands a session out again, a session which
+ * never goes back to the pool has nothing to enforce them and gets a warning instead
+ */
+static void php_ssh2_retire_config(php_ssh2_session_data *data, zval *methods TSRMLS_DC)
+{
+	zval **container, **value;
+
+	if (!methods || Z_TYPE_P(methods) != IS_ARRAY ||
+		zend_hash_find(Z_ARRVAL_P(methods), "retire", sizeof("retire"), (void**)&container) == FAILURE ||
+		!container || !*container || Z_TYPE_PP(container) != IS_ARRAY) {
+		return;
+	}
+	if (!data->persistent) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "methods['retire'] only applies to pooled sessions, ignoring it");
+		return;
+	}
+
+	if (zend_hash_find(Z_ARRVAL_PP(container), "bytes", sizeof("bytes"), (void**)&value) == SUCCESS &&
+		value && *value) {
+		zval tmp = **value;
+
+		/* Doubles so 32-bit builds can ask for more than 2GB */
+		zval_copy_ctor(&tmp);
+		convert_to_double(&tmp);
+		data->retire_bytes = Z_DVAL(tmp) > 0 ? (php_ssh2_uint64)Z_DVAL(tmp) : 0;
+	}
+	if (zend_hash_find(Z_ARRVAL_PP(container), "time", sizeof("time"), (void**)&value) == SUCCESS &&
+		value && *value) {
+		zval tmp = **value;
+
+		zval_copy_ctor(&tmp);
+		convert_to_long(&tmp);
+		data->retire_time = Z_LVAL(tmp) > 0 ? Z_LVAL(tmp) : 0;
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_memory_limit
+ * Bytes libssh2 may hold for the session, methods['memory']['limit'] or ssh2.session_memory_limit
+ */
+static long php_ssh2_memory_limit(zval *methods TSRMLS_DC)
+{
+	zval **container, **value;
+
+	if (methods && Z_TYPE_P(methods) == IS_ARRAY &&
+		zend_hash_find(Z_ARRVAL_P(methods), "memory", sizeof("memory"), (void**)&container) == SUCCESS &&
+		container && *container && Z_TYPE_PP(container) == IS_ARRAY &&
+		zend_hash_find(Z_ARRVAL_PP(container), "limit", sizeof("limit"), (void**)&value) == SUCCESS &&
+		value && *value) {
+		zval tmp = **value;
+
+		zval_copy_ctor(&tmp);
+		convert_to_long(&tmp);
+		return Z_LVAL(tmp) > 0 ? Z_LVAL(tmp) : 0;
 	}
 
-	data = ecalloc(1, sizeof(php_ssh2_session_data));
+	return SSH2_G(session_memory_limit);
+}
+/* }}} */
+
+/* {{{ php_ssh2_retire_due
+ * Whether the session has moved more data or lived longer than its retirement limits allow
+ * libssh2 has no way to start a key re-exchange itself, the pool drops such a session
+ * instead so the next user gets a fresh handshake and fresh keys
+ */
+int php_ssh2_retire_due(php_ssh2_session_data *data)
+{
+	if (data->retire_bytes && data->bytes_sent + data->bytes_received >= data->retire_bytes) {
+		return 1;
+	}
+	if (data->retire_time && data->established && time(NULL) - data->established >= data->retire_time) {
+		return 1;
+	}
+
+	return 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_reconfigure
+ * Apply what methods asks for while a session is in use to one checked out of the pool,
+ * everything settled by the handshake is part of the pool key instead
+ */
+void php_ssh2_session_reconfigure(LIBSSH2_SESSION *session, zval *methods TSRMLS_DC)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	php_ssh2_sockopts sockopts;
+	const char *failed;
+
+	php_ssh2_timeouts_parse(methods, data->timeouts TSRMLS_CC);
+	php_ssh2_session_timeout(session, libssh2_userauth_authenticated(session) ? PHP_SSH2_TIMEOUT_OPERATION : PHP_SSH2_TIMEOUT_AUTH);
+	data->slab.limit = php_ssh2_memory_limit(methods TSRMLS_CC);
+	php_ssh2_keepalive_config(session, methods TSRMLS_CC);
+	php_ssh2_retire_config(data, methods TSRMLS_CC);
+
+	php_ssh2_sockopts_parse(methods, &sockopts TSRMLS_CC);
+	if ((failed = php_ssh2_sockopts_apply(data->socket, &sockopts))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting socket option %s", failed);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_add_assoc_counter
+ * Byte counters outgrow a long on 32-bit builds, hand those out as floats
+ */
+void php_ssh2_add_assoc_counter(zval *arr, char *key, php_ssh2_uint64 value)
+{
+	if (value <= (php_ssh2_uint64)LONG_MAX) {
+		add_assoc_long(arr, key, (long)value);
+	} else {
+		add_assoc_double(arr, key, (double)value);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_set_callbacks
+ * Register all userspace callbacks found in the callbacks array
+ */
+void php_ssh2_session_set_callbacks(LIBSSH2_SESSION *session, zval *callbacks, php_ssh2_session_data *data TSRMLS_DC)
+{
+	/* ignore debug disconnect macerror */
+
+	if (php_ssh2_set_callback(session, HASH_OF(callbacks), "ignore", sizeof("ignore") - 1, LIBSSH2_CALLBACK_IGNORE, data TSRMLS_CC)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting IGNORE callback");
+	}
+
+	if (php_ssh2_set_callback(session, HASH_OF(callbacks), "debug", sizeof("debug") - 1, LIBSSH2_CALLBACK_DEBUG, data TSRMLS_CC)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting DEBUG callback");
+	}
+
+	if (php_ssh2_set_callback(session, HASH_OF(callbacks), "macerror", sizeof("macerror") - 1, LIBSSH2_CALLBACK_MACERROR, data TSRMLS_CC)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting MACERROR callback");
+	}
+
+	if (php_ssh2_set_callback(session, HASH_OF(callbacks), "disconnect", sizeof("disconnect") - 1, LIBSSH2_CALLBACK_DISCONNECT, data TSRMLS_CC)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting DISCONNECT callback");
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_clear_callbacks
+ * Drop userspace callbacks, the internal handlers become no-ops without them
+ */
+void php_ssh2_session_clear_callbacks(php_ssh2_session_data *data TSRMLS_DC)
+{
+	if (data->ignore_cb) {
+		zval_ptr_dtor(&data->ignore_cb);
+		data->ignore_cb = NULL;
+	}
+	if (data->debug_cb) {
+		zval_ptr_dtor(&data->debug_cb);
+		data->debug_cb = NULL;
+	}
+	if (data->macerror_cb) {
+		zval_ptr_dtor(&data->macerror_cb);
+		data->macerror_cb = NULL;
+	}
+	if (data->disconnect_cb) {
+		zval_ptr_dtor(&data->disconnect_cb);
+		data->disconnect_cb = NULL;
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_connect
+ * Connect to an SSH server with requested methods
+ */
+LIBSSH2_SESSION *php_ssh2_session_connect(char *host, int port, zval *methods, zval *callbacks TSRMLS_DC)
+{
+	return php_ssh2_session_connect_ex(host, port, methods, callbacks, 0 TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_init
+ * Wrap a connected socket into a session with requested methods and callbacks
+ * The handshake is left to the caller, the socket is not closed on failure
+ * host:port is remembered for the pool and for what is learned per host
+ */
+LIBSSH2_SESSION *php_ssh2_session_init(char *host, int port, int socket, zval *methods, zval *callbacks, int persistent TSRMLS_DC)
+{
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+
+	data = pecalloc(1, sizeof(php_ssh2_session_data), persistent);
 	SSH2_TSRMLS_SET(data);
 	data->socket = socket;
+	data->persistent = persistent;
+	php_ssh2_timeouts_parse(methods, data->timeouts TSRMLS_CC);
+
+	/* Sessions which outlive the request must allocate from persistent memory so they can be pooled,
+	 * ssh2.slab_persistent moves the others off the request heap as well */
+	php_ssh2_slab_init(&data->slab, SSH2_G(slab_cache), php_ssh2_memory_limit(methods TSRMLS_CC), persistent || SSH2_G(slab_persistent));
 
 	session = libssh2_session_init_ex(php_ssh2_alloc_cb, php_ssh2_free_cb, php_ssh2_realloc_cb, data);
 	if (!session) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to initialize SSH2 session");
-		efree(data);
-		closesocket(socket);
+		php_ssh2_slab_release(&data->slab);
+		pefree(data, persistent);
 		return NULL;
 	}
+	data->session = session;
+	if (host) {
+		data->host = pestrdup(host, 1);
+		data->port = port;
+	}
 	libssh2_banner_set(session, LIBSSH2_SSH_DEFAULT_BANNER " PHP");
+	php_ssh2_keepalive_config(session, methods TSRMLS_CC);
+	php_ssh2_retire_config(data, methods TSRMLS_CC);
+	php_ssh2_known_hosts_config(data, methods TSRMLS_CC);
+	data->established = time(NULL);
+
+#ifdef PHP_SSH2_TRAFFIC_COUNTERS
+	libssh2_session_callback_set(session, LIBSSH2_CALLBACK_SEND, (void*)php_ssh2_send_cb);
+	libssh2_session_callback_set(session, LIBSSH2_CALLBACK_RECV, (void*)php_ssh2_recv_cb);
+#endif
+
+	/* Benchmarked crypt/mac order, if ssh2.method_benchmark ran */
+	php_ssh2_bench_prefer(session);
 
 	/* Override method preferences */
 	if (methods) {
@@ -402,40 +821,94 @@ LIBSSH2_SESSION *php_ssh2_session_connect(char *host, int port, zval *methods, z
 				php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed overriding server to client LANG method");
 			}
 		}
+
+		php_ssh2_comp_auto(session, methods TSRMLS_CC);
 	}
 
 	/* Register Callbacks */
 	if (callbacks) {
-		/* ignore debug disconnect macerror */
+		php_ssh2_session_set_callbacks(session, callbacks, data TSRMLS_CC);
+	}
 
-		if (php_ssh2_set_callback(session, HASH_OF(callbacks), "ignore", sizeof("ignore") - 1, LIBSSH2_CALLBACK_IGNORE, data TSRMLS_CC)) {
-			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting IGNORE callback");
-		}
+	/* Socket tuning, sessions set up for the handshake threads get their socket (and options) there */
+	if (methods && socket >= 0) {
+		php_ssh2_sockopts sockopts;
+		const char *failed;
 
-		if (php_ssh2_set_callback(session, HASH_OF(callbacks), "debug", sizeof("debug") - 1, LIBSSH2_CALLBACK_DEBUG, data TSRMLS_CC)) {
-			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting DEBUG callback");
+		php_ssh2_sockopts_parse(methods, &sockopts TSRMLS_CC);
+		if ((failed = php_ssh2_sockopts_apply(socket, &sockopts))) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting socket option %s", failed);
 		}
+	}
 
-		if (php_ssh2_set_callback(session, HASH_OF(callbacks), "macerror", sizeof("macerror") - 1, LIBSSH2_CALLBACK_MACERROR, data TSRMLS_CC)) {
-			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting MACERROR callback");
-		}
+	return session;
+}
+/* }}} */
 
-		if (php_ssh2_set_callback(session, HASH_OF(callbacks), "disconnect", sizeof("disconnect") - 1, LIBSSH2_CALLBACK_DISCONNECT, data TSRMLS_CC)) {
-			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed setting DISCONNECT callback");
-		}
+/* {{{ php_ssh2_session_connect_ex
+ * Connect to an SSH server with requested methods
+ * Persistent sessions allocate from persistent memory so they can be pooled across requests
+ */
+LIBSSH2_SESSION *php_ssh2_session_connect_ex(char *host, int port, zval *methods, zval *callbacks, int persistent TSRMLS_DC)
+{
+	LIBSSH2_SESSION *session;
+	int socket;
+	char *error = NULL;
+	long timeouts[PHP_SSH2_TIMEOUT_COUNT];
+	struct timeval tv;
+	double started;
+
+	if (php_ssh2_breaker_allow(host, port, &error TSRMLS_CC) == FAILURE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to connect to %s on port %d: %s", host, port, error);
+		efree(error);
+		return NULL;
+	}
+
+	php_ssh2_timeouts_parse(methods, timeouts TSRMLS_CC);
+	tv.tv_sec = timeouts[PHP_SSH2_TIMEOUT_CONNECT] / 1000;
+	tv.tv_usec = (timeouts[PHP_SSH2_TIMEOUT_CONNECT] % 1000) * 1000;
+
+	started = php_ssh2_comp_clock();
+	socket = php_ssh2_connect_socket(host, port, 0, &tv, &error TSRMLS_CC);
+	if (socket < 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to connect to %s on port %d: %s", host, port, error);
+		efree(error);
+		php_ssh2_breaker_record(host, port, 0 TSRMLS_CC);
+		return NULL;
+	}
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_CONNECT, started TSRMLS_CC);
+
+	session = php_ssh2_session_init(host, port, socket, methods, callbacks, persistent TSRMLS_CC);
+	if (!session) {
+		closesocket(socket);
+		return NULL;
 	}
 
+	php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_HANDSHAKE);
+	started = php_ssh2_comp_clock();
 	if (libssh2_session_startup(session, socket)) {
 		int last_error = 0;
 		char *error_msg = NULL;
 
 		last_error = libssh2_session_last_error(session, &error_msg, NULL, 0);
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Error starting up SSH connection(%d): %s", last_error, error_msg);
-		closesocket(socket);
-		libssh2_session_free(session);
-		efree(data);
+		php_ssh2_session_free(session TSRMLS_CC);
+		php_ssh2_breaker_record(host, port, 0 TSRMLS_CC);
 		return NULL;
 	}
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_KEX, started TSRMLS_CC);
+	php_ssh2_breaker_record(host, port, 1 TSRMLS_CC);
+
+	/* The server answered, whether it is the one we know is a different matter */
+	if (php_ssh2_known_hosts_verify(session, &error TSRMLS_CC) == FAILURE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to verify %s on port %d: %s", host, port, error);
+		efree(error);
+		php_ssh2_session_destroy(session TSRMLS_CC);
+		return NULL;
+	}
+
+	/* Until authenticated everything on the session is part of authenticating */
+	php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_AUTH);
 
 	return session;
 }
@@ -466,6 +939,52 @@ PHP_FUNCTION(ssh2_connect)
 }
 /* }}} */
 
+/* {{{ proto resource ssh2_pconnect(string host[, int port[, array methods[, array callbacks[, string username]]]])
+ * Fetch an idle session to the remote SSH server from the persistent pool, or establish a new one
+ * Only sessions for the same username are handed out again, authenticating a pooled session
+ * with the credentials it was authenticated with before succeeds without a round trip
+ * Until then a pooled session counts as not authenticated, and other credentials are refused
+ */
+PHP_FUNCTION(ssh2_pconnect)
+{
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	zval *methods = NULL, *callbacks = NULL;
+	char *host, *username = NULL;
+	long port = PHP_SSH2_DEFAULT_PORT;
+	int host_len, username_len = 0;
+	smart_str key = {0};
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|la!a!s", &host, &host_len, &port, &methods, &callbacks, &username, &username_len) == FAILURE) {
+		return;
+	}
+
+	php_ssh2_pool_key(&key, host, port, username, username_len, methods TSRMLS_CC);
+
+	session = php_ssh2_pool_checkout(key.c, key.len TSRMLS_CC);
+	if (session) {
+		data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+		php_ssh2_session_reconfigure(session, methods TSRMLS_CC);
+		if (callbacks) {
+			php_ssh2_session_set_callbacks(session, callbacks, data TSRMLS_CC);
+		}
+	} else {
+		session = php_ssh2_session_connect_ex(host, port, methods, callbacks, 1 TSRMLS_CC);
+		if (!session) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to connect to %s", host);
+			smart_str_free(&key);
+			RETURN_FALSE;
+		}
+		data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+		data->pool_key = pestrndup(key.c, key.len, 1);
+		data->pool_key_len = key.len;
+	}
+	smart_str_free(&key);
+
+	ZEND_REGISTER_RESOURCE(return_value, session, le_ssh2_session);
+}
+/* }}} */
+
 /* {{{ proto array ssh2_methods_negotiated(resource session)
  * Return list of negotiaed methods
  */
@@ -480,6 +999,10 @@ PHP_FUNCTION(ssh2_methods_negotiated)
 	}
 
 	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	if (SSH2_SESSION_PENDING(session)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet");
+		RETURN_FALSE;
+	}
 
 	kex = (char*)libssh2_session_methods(session, LIBSSH2_METHOD_KEX);
 	hostkey = (char*)libssh2_session_methods(session, LIBSSH2_METHOD_HOSTKEY);
@@ -492,6 +1015,19 @@ PHP_FUNCTION(ssh2_methods_negotiated)
 	lang_cs = (char*)libssh2_session_methods(session, LIBSSH2_METHOD_LANG_CS);
 	lang_sc = (char*)libssh2_session_methods(session, LIBSSH2_METHOD_LANG_SC);
 
+	/* Nothing is negotiated on a session whose handshake failed */
+	if (!kex || !hostkey || !crypt_cs || !crypt_sc || !mac_cs || !mac_sc || !comp_cs || !comp_sc) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to retrieve negotiated methods from specified session");
+		RETURN_FALSE;
+	}
+	/* No language is a valid outcome */
+	if (!lang_cs) {
+		lang_cs = "";
+	}
+	if (!lang_sc) {
+		lang_sc = "";
+	}
+
 	array_init(return_value);
 	add_assoc_string(return_value, "kex", kex, 1);
 	add_assoc_string(return_value, "hostkey", hostkey, 1);
@@ -524,16 +1060,28 @@ PHP_FUNCTION(ssh2_fingerprint)
 	zval *zsession;
 	const char *fingerprint;
 	long flags = 0;
-	int i, fingerprint_len;
+	int i, fingerprint_len, hash_type;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r|l", &zsession, &flags) == FAILURE) {
 		return;
 	}
-	fingerprint_len = (flags & PHP_SSH2_FINGERPRINT_SHA1) ? SHA_DIGEST_LENGTH : MD5_DIGEST_LENGTH;
+#ifdef PHP_SSH2_FINGERPRINT_SHA256
+	if (flags & PHP_SSH2_FINGERPRINT_SHA256) {
+		fingerprint_len = 32;
+		hash_type = LIBSSH2_HOSTKEY_HASH_SHA256;
+	} else
+#endif
+	if (flags & PHP_SSH2_FINGERPRINT_SHA1) {
+		fingerprint_len = SHA_DIGEST_LENGTH;
+		hash_type = LIBSSH2_HOSTKEY_HASH_SHA1;
+	} else {
+		fingerprint_len = MD5_DIGEST_LENGTH;
+		hash_type = LIBSSH2_HOSTKEY_HASH_MD5;
+	}
 
 	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
 
-	fingerprint = (char*)libssh2_hostkey_hash(session, (flags & PHP_SSH2_FINGERPRINT_SHA1) ? LIBSSH2_HOSTKEY_HASH_SHA1 : LIBSSH2_HOSTKEY_HASH_MD5);
+	fingerprint = (char*)libssh2_hostkey_hash(session, hash_type);
 	if (!fingerprint) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to retrieve fingerprint from specified session");
 		RETURN_FALSE;
@@ -550,17 +1098,66 @@ PHP_FUNCTION(ssh2_fingerprint)
 	if (flags & PHP_SSH2_FINGERPRINT_RAW) {
 		RETURN_STRINGL(fingerprint, fingerprint_len, 1);
 	} else {
+		static const char hexdigits[] = "0123456789ABCDEF";
 		char *hexchars;
 
 		hexchars = emalloc((fingerprint_len * 2) + 1);
 		for(i = 0; i < fingerprint_len; i++) {
-			snprintf(hexchars + (2 * i), 3, "%02X", (unsigned char)fingerprint[i]);
+			hexchars[2 * i] = hexdigits[(unsigned char)fingerprint[i] >> 4];
+			hexchars[(2 * i) + 1] = hexdigits[(unsigned char)fingerprint[i] & 0x0F];
 		}
+		hexchars[2 * fingerprint_len] = '\0';
 		RETURN_STRINGL(hexchars, 2 * fingerprint_len, 0);
 	}
 }
 /* }}} */
 
+/* {{{ php_ssh2_auth_ident
+ * Digest what a session gets authenticated with, ident must hold PHP_SSH2_AUTH_IDENT_LEN + 1 bytes
+ * Credentials are hashed so that pooled sessions never keep them around
+ */
+void php_ssh2_auth_ident(char *ident, char *username, int username_len, char *method, char *credential, int credential_len)
+{
+	PHP_MD5_CTX context;
+	unsigned char digest[16];
+
+	PHP_MD5Init(&context);
+	PHP_MD5Update(&context, (unsigned char*)username, username_len + 1);
+	PHP_MD5Update(&context, (unsigned char*)method, strlen(method) + 1);
+	if (credential) {
+		PHP_MD5Update(&context, (unsigned char*)credential, credential_len);
+	}
+	PHP_MD5Final(digest, &context);
+	make_digest(ident, digest);
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_auth_matches
+ * Was this (pooled) session already authenticated using the given identity?
+ */
+int php_ssh2_session_auth_matches(LIBSSH2_SESSION *session, char *ident)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	return data && data->persistent && data->auth_ident[0] && strcmp(data->auth_ident, ident) == 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_auth_remember
+ * The caller proved ident, which also unlocks a session fresh out of the pool
+ */
+void php_ssh2_session_auth_remember(LIBSSH2_SESSION *session, char *ident)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	if (data) {
+		memcpy(data->auth_ident, ident, PHP_SSH2_AUTH_IDENT_LEN + 1);
+		data->auth_locked = 0;
+	}
+	php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_OPERATION);
+}
+/* }}} */
+
 /* {{{ proto array ssh2_auth_none(resource session, string username)
  * Attempt "none" authentication, returns a list of allowed methods on failed authentication, 
  * false on utter failure, or true on success
@@ -577,11 +1174,24 @@ PHP_FUNCTION(ssh2_auth_none)
 	}
 
 	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	if (SSH2_SESSION_PENDING(session)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet");
+		RETURN_FALSE;
+	}
+	if (SSH2_SESSION_LOCKED(session)) {
+		/* A pooled session only opens up for the identity it was authenticated with */
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection already authenticated");
+		RETURN_FALSE;
+	}
 
 	s = methods = libssh2_userauth_list(session, username, username_len);
 	if (!methods) {
 		/* Either bad failure, or unexpected success */
-		RETURN_BOOL(libssh2_userauth_authenticated(session));
+		if (libssh2_userauth_authenticated(session)) {
+			php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_OPERATION);
+			RETURN_TRUE;
+		}
+		RETURN_FALSE;
 	}
 
 	array_init(return_value);
@@ -597,27 +1207,6 @@ PHP_FUNCTION(ssh2_auth_none)
 }
 /* }}} */
 
-char *password_for_kbd_callback;
-
-static void kbd_callback(const char *name, int name_len,
-							const char *instruction, int instruction_len,
-							int num_prompts,
-							const LIBSSH2_USERAUTH_KBDINT_PROMPT *prompts,
-							LIBSSH2_USERAUTH_KBDINT_RESPONSE *responses,
-							void **abstract)
-{
-	(void)name;
-	(void)name_len;
-	(void)instruction;
-	(void)instruction_len;
-	if (num_prompts == 1) {
-		responses[0].text = estrdup(password_for_kbd_callback);
-		responses[0].length = strlen(password_for_kbd_callback);
-	}
-	(void)prompts;
-	(void)abstract;
-}
-
 /* {{{ proto bool ssh2_auth_password(resource session, string username, string password)
  * Authenticate over SSH using a plain password
  */
@@ -627,28 +1216,21 @@ PHP_FUNCTION(ssh2_auth_password)
 	zval *zsession;
 	char *username, *password;
 	int username_len, password_len;
-	char *userauthlist;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rss", &zsession, &username, &username_len, &password, &password_len) == FAILURE) {
 		return;
 	}
 
-	SSH2_FETCH_NONAUTHENTICATED_SESSION(session, zsession);
-
-	userauthlist = libssh2_userauth_list(session, username, username_len);
-	password_for_kbd_callback = password;
-	if (strstr(userauthlist, "keyboard-interactive") != NULL) {
-		if (libssh2_userauth_keyboard_interactive(session, username, &kbd_callback) == 0) {
-			RETURN_TRUE;
-		}
-	}
+	php_ssh2_auth_ident(ident, username, username_len, "password", password, password_len);
+	SSH2_FETCH_NONAUTHENTICATED_SESSION_IDENT(session, zsession, ident);
 
-	/* TODO: Support password change callback */
-	if (libssh2_userauth_password_ex(session, username, username_len, password, password_len, NULL)) {
+	if (!php_ssh2_userauth_password(session, username, username_len, password, password_len TSRMLS_CC)) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Authentication failed for %s using password", username);
 		RETURN_FALSE;
 	}
 
+	php_ssh2_session_auth_remember(session, ident);
 	RETURN_TRUE;
 }
 /* }}} */
@@ -662,10 +1244,8 @@ PHP_FUNCTION(ssh2_auth_pubkey_file)
 	zval *zsession;
 	char *username, *pubkey, *privkey, *passphrase = NULL;
 	int username_len, pubkey_len, privkey_len, passphrase_len;
-#ifndef PHP_WIN32
-	char *newpath;
-	struct passwd *pws;
-#endif
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	int rc;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rsss|s", &zsession,	&username, &username_len,
 																				&pubkey, &pubkey_len,
@@ -674,33 +1254,20 @@ PHP_FUNCTION(ssh2_auth_pubkey_file)
 		return;
 	}
 
-	if (SSH2_OPENBASEDIR_CHECKPATH(pubkey) || SSH2_OPENBASEDIR_CHECKPATH(privkey)) {
+	/* Pooled sessions open up for the key, not for whoever names its path */
+	if (php_ssh2_auth_ident_keyfile(ident, username, username_len, "publickey", pubkey, privkey, passphrase TSRMLS_CC) == FAILURE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Authentication failed for %s using public key: Unable to read key files", username);
 		RETURN_FALSE;
 	}
+	SSH2_FETCH_NONAUTHENTICATED_SESSION_IDENT(session, zsession, ident);
 
-	SSH2_FETCH_NONAUTHENTICATED_SESSION(session, zsession);
-#ifndef PHP_WIN32
-	/* Explode '~/paths' stopgap fix because libssh2 does not accept tilde for homedir
-	  This should be ifdef'ed when a fix is available to support older libssh2 versions*/
-	pws = getpwuid(geteuid());
-	if (pubkey_len >= 2 && *pubkey == '~' && *(pubkey+1) == '/') {
-		newpath = emalloc(strlen(pws->pw_dir) + strlen(pubkey));
-		strcpy(newpath, pws->pw_dir);
-		strcat(newpath, pubkey+1);
-		efree(pubkey);
-		pubkey = newpath;
-	}
-	if (privkey_len >= 2 && *privkey == '~' && *(privkey+1) == '/') {
-		newpath = emalloc(strlen(pws->pw_dir) + strlen(privkey));
-		strcpy(newpath, pws->pw_dir);
-		strcat(newpath, privkey+1);
-		efree(privkey);
-		privkey = newpath;
+	/* Keys come from the per-process cache, '~/' is expanded there */
+	rc = php_ssh2_userauth_publickey(session, username, username_len, pubkey, privkey, passphrase TSRMLS_CC);
+	if (rc == PHP_SSH2_KEY_UNREADABLE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Authentication failed for %s using public key: Unable to read key files", username);
+		RETURN_FALSE;
 	}
-#endif
-
-	/* TODO: Support passphrase callback */
-	if (libssh2_userauth_publickey_fromfile_ex(session, username, username_len, pubkey, privkey, passphrase)) {
+	if (rc) {
 		char *buf;
 		int len;
 		libssh2_session_last_error(session, &buf, &len, 0);
@@ -708,6 +1275,7 @@ PHP_FUNCTION(ssh2_auth_pubkey_file)
 		RETURN_FALSE;
 	}
 
+	php_ssh2_session_auth_remember(session, ident);
 	RETURN_TRUE;
 }
 /* }}} */
@@ -721,6 +1289,7 @@ PHP_FUNCTION(ssh2_auth_hostbased_file)
 	zval *zsession;
 	char *username, *hostname, *pubkey, *privkey, *passphrase = NULL, *local_username = NULL;
 	int username_len, hostname_len, pubkey_len, privkey_len, passphrase_len, local_username_len;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rssss|s!s!", &zsession,	&username, &username_len,
 																					&hostname, &hostname_len,
@@ -735,7 +1304,11 @@ PHP_FUNCTION(ssh2_auth_hostbased_file)
 		RETURN_FALSE;
 	}
 
-	SSH2_FETCH_NONAUTHENTICATED_SESSION(session, zsession);
+	if (php_ssh2_auth_ident_keyfile(ident, username, username_len, "hostbased", pubkey, privkey, passphrase TSRMLS_CC) == FAILURE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Authentication failed for %s using hostbased public key: Unable to read key files", username);
+		RETURN_FALSE;
+	}
+	SSH2_FETCH_NONAUTHENTICATED_SESSION_IDENT(session, zsession, ident);
 
 	if (!local_username) {
 		local_username = username;
@@ -748,6 +1321,7 @@ PHP_FUNCTION(ssh2_auth_hostbased_file)
 		RETURN_FALSE;
 	}
 
+	php_ssh2_session_auth_remember(session, ident);
 	RETURN_TRUE;
 }
 /* }}} */
@@ -799,6 +1373,7 @@ PHP_FUNCTION(ssh2_forward_accept)
 	LIBSSH2_CHANNEL *channel;
 	php_ssh2_channel_data *channel_data;
 	php_stream *stream;
+	double started;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zlistener) == FAILURE) {
 		return;
@@ -806,13 +1381,15 @@ PHP_FUNCTION(ssh2_forward_accept)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_listener_data*, &zlistener, -1, PHP_SSH2_LISTENER_RES_NAME, le_ssh2_listener);
 
+	started = php_ssh2_comp_clock();
 	channel = libssh2_channel_forward_accept(data->listener);
+	php_ssh2_stats_channel_open(data->session, PHP_SSH2_CHANNEL_FORWARDED, channel, started);
 
 	if (!channel) {
 		RETURN_FALSE;
 	}
 
-	channel_data = emalloc(sizeof(php_ssh2_channel_data));
+	channel_data = ecalloc(1, sizeof(php_ssh2_channel_data));
 	channel_data->channel = channel;
 	channel_data->streamid = 0;
 	channel_data->is_blocking = 0;
@@ -823,7 +1400,7 @@ PHP_FUNCTION(ssh2_forward_accept)
 	if (!stream) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failure allocating stream");
 		efree(channel_data);
-		libssh2_channel_free(channel);
+		php_ssh2_channel_free(data->session, channel);
 		RETURN_FALSE;
 	}
 	zend_list_addref(channel_data->session_rsrc);
@@ -893,10 +1470,19 @@ PHP_FUNCTION(ssh2_poll)
 		if (res_type == le_ssh2_listener) {
 			pollfds[i].type = LIBSSH2_POLLFD_LISTENER;
 			pollfds[i].fd.listener = ((php_ssh2_listener_data*)res)->listener;
+			php_ssh2_keepalive(((php_ssh2_listener_data*)res)->session);
 		} else if ((res_type == le_stream || res_type == le_pstream) && 
 				   ((php_stream*)res)->ops == &php_ssh2_channel_stream_ops) {
+			php_ssh2_channel_data *channel_data = (php_ssh2_channel_data*)(((php_stream*)res)->abstract);
+			LIBSSH2_SESSION *session;
+			int session_type;
+
 			pollfds[i].type = LIBSSH2_POLLFD_CHANNEL;
-			pollfds[i].fd.channel = ((php_ssh2_channel_data*)(((php_stream*)res)->abstract))->channel;
+			pollfds[i].fd.channel = channel_data->channel;
+			session = (LIBSSH2_SESSION*)zend_list_find(channel_data->session_rsrc, &session_type);
+			if (session && session_type == le_ssh2_session) {
+				php_ssh2_keepalive(session);
+			}
 			/* TODO: Add the ability to select against other stream types */
 		} else {
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid resource type in subarray: %s", zend_rsrc_list_get_rsrc_type(Z_LVAL_PP(tmpzval) TSRMLS_CC));
@@ -936,6 +1522,67 @@ PHP_FUNCTION(ssh2_poll)
 }
 /* }}} */
 
+/* {{{ proto int ssh2_keepalive_tick(resource session)
+Send a keepalive if one is due, returns the seconds until the next one should be sent */
+PHP_FUNCTION(ssh2_keepalive_tick)
+{
+	zval *zsession;
+	LIBSSH2_SESSION *session;
+	int next;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zsession) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	if (SSH2_SESSION_PENDING(session)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet");
+		RETURN_FALSE;
+	}
+
+	if ((next = php_ssh2_keepalive(session)) < 0) {
+		int last_error = 0;
+		char *error_msg = NULL;
+
+		last_error = libssh2_session_last_error(session, &error_msg, NULL, 0);
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failure sending keepalive(%d) %s", last_error, error_msg);
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(next);
+}
+/* }}} */
+
+/* {{{ proto array ssh2_retire_stats(resource session)
+Traffic and age of a session measured against the limits after which the pool retires it */
+PHP_FUNCTION(ssh2_retire_stats)
+{
+	zval *zsession;
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zsession) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	array_init(return_value);
+#ifdef PHP_SSH2_TRAFFIC_COUNTERS
+	php_ssh2_add_assoc_counter(return_value, "bytes_sent", data->bytes_sent);
+	php_ssh2_add_assoc_counter(return_value, "bytes_received", data->bytes_received);
+#else
+	add_assoc_null(return_value, "bytes_sent");
+	add_assoc_null(return_value, "bytes_received");
+#endif
+	add_assoc_long(return_value, "age", (long)(time(NULL) - data->established));
+	php_ssh2_add_assoc_counter(return_value, "retire_bytes", data->retire_bytes);
+	add_assoc_long(return_value, "retire_time", data->retire_time);
+	add_assoc_bool(return_value, "due", php_ssh2_retire_due(data));
+}
+/* }}} */
+
 /* ***********************
    * Publickey Subsystem *
    *********************** */
@@ -1153,70 +1800,36 @@ PHP_FUNCTION(ssh2_auth_agent)
 	int username_len;
 
 	LIBSSH2_SESSION *session;
-	char *userauthlist;
-	LIBSSH2_AGENT *agent = NULL;
-	int rc;
-	struct libssh2_agent_publickey *identity, *prev_identity = NULL;
+	char *error;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &zsession, &username, &username_len) == FAILURE) {
 		return;
 	}
 
-	SSH2_FETCH_NONAUTHENTICATED_SESSION(session, zsession);
-
-	/* check what authentication methods are available */
-	userauthlist = libssh2_userauth_list(session, username, username_len);
-
-	if (strstr(userauthlist, "publickey") == NULL) {
-		php_error_docref(NULL TSRMLS_CC, E_WARNING, "\"publickey\" authentication is not supported");
-		RETURN_FALSE;
-	}
-
-	/* Connect to the ssh-agent */
-	agent = libssh2_agent_init(session);
-
-	if (!agent) {
-		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failure initializing ssh-agent support");
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	if (SSH2_SESSION_PENDING(session)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet");
 		RETURN_FALSE;
 	}
-
-	if (libssh2_agent_connect(agent)) {
-		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failure connecting to ssh-agent");
-		libssh2_agent_free(agent);
+	if (libssh2_userauth_authenticated(session)) {
+		/* A pooled session only opens up if our agent holds the identity it was authenticated with */
+		if (php_ssh2_agent_auth_matches(session, username, username_len, ident TSRMLS_CC)) {
+			php_ssh2_session_auth_remember(session, ident);
+			RETURN_TRUE;
+		}
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection already authenticated");
 		RETURN_FALSE;
 	}
 
-	if (libssh2_agent_list_identities(agent)) {
-		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failure requesting identities to ssh-agent");
-		libssh2_agent_disconnect(agent);
-		libssh2_agent_free(agent);
+	/* Identities are tried from the one which worked last time on */
+	if (php_ssh2_userauth_agent(session, username, username_len, ident, &error TSRMLS_CC) == FAILURE) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", error ? error : "Authentication failed using ssh-agent");
 		RETURN_FALSE;
 	}
 
-	while (1) {
-		rc = libssh2_agent_get_identity(agent, &identity, prev_identity);
-
-		if (rc == 1) {
-			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Couldn't continue authentication");
-			libssh2_agent_disconnect(agent);
-			libssh2_agent_free(agent);
-			RETURN_FALSE;
-		}
-
-		if (rc < 0) {
-			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failure obtaining identity from ssh-agent support");
-			libssh2_agent_disconnect(agent);
-			libssh2_agent_free(agent);
-			RETURN_FALSE;
-		}
-
-		if (!libssh2_agent_userauth(agent, username, identity)) {
-			libssh2_agent_disconnect(agent);
-			libssh2_agent_free(agent);
-			RETURN_TRUE;
-		}
-		prev_identity = identity;
-	}
+	php_ssh2_session_auth_remember(session, ident);
+	RETURN_TRUE;
 #else
 	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Upgrade the libssh2 library (needs 1.2.3 or higher) and reinstall the ssh2 extension for ssh2 agent support");
 	RETURN_FALSE;
@@ -1228,34 +1841,79 @@ PHP_FUNCTION(ssh2_auth_agent)
    * Module Housekeeping *
    *********************** */
 
-static void php_ssh2_session_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+/* {{{ php_ssh2_session_destroy
+ * Disconnect and free a session along with its private data
+ */
+void php_ssh2_session_destroy(LIBSSH2_SESSION *session TSRMLS_DC)
 {
-	LIBSSH2_SESSION *session = (LIBSSH2_SESSION*)rsrc->ptr;
-	php_ssh2_session_data **data = (php_ssh2_session_data**)libssh2_session_abstract(session);
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
 
+	/* Close the shared SFTP channel while the server still listens */
+	if (data && data->sftp) {
+		libssh2_sftp_shutdown(data->sftp);
+		data->sftp = NULL;
+	}
 	libssh2_session_disconnect(session, "PECL/ssh2 (http://pecl.php.net/packages/ssh2)");
 
-	if (*data) {
-		if ((*data)->ignore_cb) {
-			zval_ptr_dtor(&(*data)->ignore_cb);
+	php_ssh2_session_free(session TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_free
+ * Close the socket and free a session along with its private data, without saying goodbye
+ */
+void php_ssh2_session_free(LIBSSH2_SESSION *session TSRMLS_DC)
+{
+	php_ssh2_session_data **data = (php_ssh2_session_data**)libssh2_session_abstract(session);
+	php_ssh2_session_data *session_data = *data;
+
+	if (session_data) {
+		php_ssh2_session_clear_callbacks(session_data TSRMLS_CC);
+		php_ssh2_comp_learn(session_data TSRMLS_CC);
+		if (session_data->sftp) {
+			libssh2_sftp_shutdown(session_data->sftp);
+			session_data->sftp = NULL;
+		}
+		closesocket(session_data->socket);
+	}
+
+	libssh2_session_free(session);
+
+	if (session_data) {
+		if (session_data->pool_key) {
+			pefree(session_data->pool_key, 1);
 		}
-		if ((*data)->debug_cb) {
-			zval_ptr_dtor(&(*data)->debug_cb);
+		if (session_data->host) {
+			pefree(session_data->host, 1);
 		}
-		if ((*data)->macerror_cb) {
-			zval_ptr_dtor(&(*data)->macerror_cb);
+		if (session_data->known_hosts) {
+			pefree(session_data->known_hosts, 1);
 		}
-		if ((*data)->disconnect_cb) {
-			zval_ptr_dtor(&(*data)->disconnect_cb);
+		if (session_data->async) {
+			php_ssh2_async_free(session_data->async);
 		}
+		php_ssh2_slab_release(&session_data->slab);
+		pefree(session_data, session_data->persistent);
+	}
+}
+/* }}} */
 
-		closesocket((*data)->socket);
+static void php_ssh2_session_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	LIBSSH2_SESSION *session = (LIBSSH2_SESSION*)rsrc->ptr;
 
-		efree(*data);
-		*data = NULL;
+	/* Persistent sessions go back to the pool if they are still usable */
+	if (php_ssh2_pool_release(session TSRMLS_CC) == SUCCESS) {
+		return;
 	}
 
-	libssh2_session_free(session);
+	/* A connect that never finished has nobody to say goodbye to */
+	if (SSH2_SESSION_PENDING(session)) {
+		php_ssh2_session_free(session TSRMLS_CC);
+		return;
+	}
+
+	php_ssh2_session_destroy(session TSRMLS_CC);
 }
 
 static void php_ssh2_listener_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
@@ -1278,19 +1936,75 @@ static void php_ssh2_pkey_subsys_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
 	efree(data);
 }
 
+/* {{{ php_ssh2_init_globals
+ */
+static void php_ssh2_init_globals(zend_ssh2_globals *ssh2_globals TSRMLS_DC)
+{
+	memset(ssh2_globals, 0, sizeof(zend_ssh2_globals));
+	zend_hash_init(&ssh2_globals->dns_cache, 32, NULL, php_ssh2_dns_entry_dtor, 1);
+	zend_hash_init(&ssh2_globals->family_cache, 32, NULL, NULL, 1);
+	zend_hash_init(&ssh2_globals->breakers, 8, NULL, NULL, 1);
+	zend_hash_init(&ssh2_globals->comp_hosts, 8, NULL, NULL, 1);
+	zend_hash_init(&ssh2_globals->known_hosts, 4, NULL, php_ssh2_known_hosts_dtor, 1);
+	zend_hash_init(&ssh2_globals->key_files, 8, NULL, php_ssh2_key_dtor, 1);
+	zend_hash_init(&ssh2_globals->key_plain, 8, NULL, php_ssh2_key_dtor, 1);
+	zend_hash_init(&ssh2_globals->auth_hints, 32, NULL, NULL, 1);
+}
+/* }}} */
+
+/* {{{ php_ssh2_destroy_globals
+ */
+static void php_ssh2_destroy_globals(zend_ssh2_globals *ssh2_globals TSRMLS_DC)
+{
+	zend_hash_destroy(&ssh2_globals->dns_cache);
+	zend_hash_destroy(&ssh2_globals->family_cache);
+	zend_hash_destroy(&ssh2_globals->breakers);
+	zend_hash_destroy(&ssh2_globals->comp_hosts);
+	zend_hash_destroy(&ssh2_globals->known_hosts);
+	zend_hash_destroy(&ssh2_globals->key_files);
+	zend_hash_destroy(&ssh2_globals->key_plain);
+	zend_hash_destroy(&ssh2_globals->auth_hints);
+	if (ssh2_globals->key_home) {
+		pefree(ssh2_globals->key_home, 1);
+	}
+	php_ssh2_latency_free(ssh2_globals->latency);
+}
+/* }}} */
+
 /* {{{ PHP_MINIT_FUNCTION
  */
 PHP_MINIT_FUNCTION(ssh2)
 {
+	ZEND_INIT_MODULE_GLOBALS(ssh2, php_ssh2_init_globals, php_ssh2_destroy_globals);
+	REGISTER_INI_ENTRIES();
+
+#ifdef PHP_SSH2_THREADS
+	/* Crypto backend setup is not thread safe, get it out of the way before any handshake thread runs */
+	libssh2_init(0);
+#endif
+	php_ssh2_bench_run(SSH2_G(method_benchmark));
+#ifdef ZTS
+	php_ssh2_pool_shared_startup();
+#endif
+
 	le_ssh2_session		= zend_register_list_destructors_ex(php_ssh2_session_dtor, NULL, PHP_SSH2_SESSION_RES_NAME, module_number);
 	le_ssh2_listener	= zend_register_list_destructors_ex(php_ssh2_listener_dtor, NULL, PHP_SSH2_LISTENER_RES_NAME, module_number);
 	le_ssh2_sftp		= zend_register_list_destructors_ex(php_ssh2_sftp_dtor, NULL, PHP_SSH2_SFTP_RES_NAME, module_number);
 	le_ssh2_pkey_subsys	= zend_register_list_destructors_ex(php_ssh2_pkey_subsys_dtor, NULL, PHP_SSH2_PKEY_SUBSYS_RES_NAME, module_number);
+	le_ssh2_pool		= zend_register_list_destructors_ex(NULL, php_ssh2_pool_bucket_dtor, PHP_SSH2_POOL_RES_NAME, module_number);
 
 	REGISTER_LONG_CONSTANT("SSH2_FINGERPRINT_MD5",		PHP_SSH2_FINGERPRINT_MD5,		CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SSH2_FINGERPRINT_SHA1",		PHP_SSH2_FINGERPRINT_SHA1,		CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SSH2_FINGERPRINT_HEX",		PHP_SSH2_FINGERPRINT_HEX,		CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SSH2_FINGERPRINT_RAW",		PHP_SSH2_FINGERPRINT_RAW,		CONST_CS | CONST_PERSISTENT);
+#ifdef PHP_SSH2_FINGERPRINT_SHA256
+	REGISTER_LONG_CONSTANT("SSH2_FINGERPRINT_SHA256",	PHP_SSH2_FINGERPRINT_SHA256,	CONST_CS | CONST_PERSISTENT);
+#endif
+
+	REGISTER_LONG_CONSTANT("SSH2_KNOWNHOST_MATCH",		PHP_SSH2_KNOWNHOST_MATCH,		CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SSH2_KNOWNHOST_MISMATCH",	PHP_SSH2_KNOWNHOST_MISMATCH,	CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SSH2_KNOWNHOST_NOTFOUND",	PHP_SSH2_KNOWNHOST_NOTFOUND,	CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SSH2_KNOWNHOST_REVOKED",	PHP_SSH2_KNOWNHOST_REVOKED,		CONST_CS | CONST_PERSISTENT);
 
 	REGISTER_LONG_CONSTANT("SSH2_TERM_UNIT_CHARS",		PHP_SSH2_TERM_UNIT_CHARS,		CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SSH2_TERM_UNIT_PIXELS",		PHP_SSH2_TERM_UNIT_PIXELS,		CONST_CS | CONST_PERSISTENT);
@@ -1316,6 +2030,10 @@ PHP_MINIT_FUNCTION(ssh2)
 	REGISTER_LONG_CONSTANT("SSH2_POLL_CHANNEL_CLOSED",	LIBSSH2_POLLFD_CHANNEL_CLOSED,	CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("SSH2_POLL_LISTENER_CLOSED",	LIBSSH2_POLLFD_LISTENER_CLOSED,	CONST_CS | CONST_PERSISTENT);
 
+	/* ssh2_connect_step() */
+	REGISTER_LONG_CONSTANT("SSH2_ASYNC_WANT_READ",		PHP_SSH2_ASYNC_WANT_READ,		CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("SSH2_ASYNC_WANT_WRITE",		PHP_SSH2_ASYNC_WANT_WRITE,		CONST_CS | CONST_PERSISTENT);
+
 	return (php_register_url_stream_wrapper("ssh2.shell", &php_ssh2_stream_wrapper_shell TSRMLS_CC) == SUCCESS &&
 			php_register_url_stream_wrapper("ssh2.exec", &php_ssh2_stream_wrapper_exec TSRMLS_CC) == SUCCESS &&
 			php_register_url_stream_wrapper("ssh2.tunnel", &php_ssh2_stream_wrapper_tunnel TSRMLS_CC) == SUCCESS &&
@@ -1328,6 +2046,21 @@ PHP_MINIT_FUNCTION(ssh2)
  */
 PHP_MSHUTDOWN_FUNCTION(ssh2)
 {
+	UNREGISTER_INI_ENTRIES();
+
+#ifndef ZTS
+	php_ssh2_destroy_globals(&ssh2_globals TSRMLS_CC);
+#endif
+
+	php_ssh2_bench_free();
+#ifdef ZTS
+	php_ssh2_pool_shared_shutdown(TSRMLS_C);
+#endif
+
+#ifdef PHP_SSH2_THREADS
+	libssh2_exit();
+#endif
+
 	return (php_unregister_url_stream_wrapper("ssh2.shell" TSRMLS_CC) == SUCCESS &&
 			php_unregister_url_stream_wrapper("ssh2.exec" TSRMLS_CC) == SUCCESS &&
 			php_unregister_url_stream_wrapper("ssh2.tunnel" TSRMLS_CC) == SUCCESS &&
@@ -1336,16 +2069,99 @@ PHP_MSHUTDOWN_FUNCTION(ssh2)
 }
 /* }}} */
 
+/* {{{ PHP_RINIT_FUNCTION
+ */
+PHP_RINIT_FUNCTION(ssh2)
+{
+	if (!SSH2_G(pool_warm_done)) {
+		php_ssh2_pool_warm(TSRMLS_C);
+	}
+	zend_hash_init(&SSH2_G(wrapper_cache), 8, NULL, php_ssh2_wrapper_cache_dtor, 0);
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ PHP_RSHUTDOWN_FUNCTION
+ */
+PHP_RSHUTDOWN_FUNCTION(ssh2)
+{
+	/* Drops the wrapper's references, pooled sessions go back to the pool from there */
+	zend_hash_destroy(&SSH2_G(wrapper_cache));
+
+	return SUCCESS;
+}
+/* }}} */
+
 /* {{{ PHP_MINFO_FUNCTION
  */
 PHP_MINFO_FUNCTION(ssh2)
 {
+	char buf[32];
+
 	php_info_print_table_start();
 	php_info_print_table_header(2, "SSH2 support", "enabled");
 	php_info_print_table_row(2, "extension version", PHP_SSH2_VERSION);
 	php_info_print_table_row(2, "libssh2 version", LIBSSH2_VERSION);
 	php_info_print_table_row(2, "banner", LIBSSH2_SSH_BANNER);
+#ifdef PHP_SSH2_THREADS
+	php_info_print_table_row(2, "handshake threads", "enabled");
+#else
+	php_info_print_table_row(2, "handshake threads", "disabled");
+#endif
+#ifdef PHP_SSH2_TRAFFIC_COUNTERS
+	php_info_print_table_row(2, "traffic counters", "enabled");
+#else
+	php_info_print_table_row(2, "traffic counters", "disabled");
+#endif
+
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_num_idle));
+	php_info_print_table_row(2, "idle persistent sessions", buf);
+#ifdef ZTS
+	if (SSH2_G(pool_shared)) {
+		snprintf(buf, sizeof(buf), "%ld", php_ssh2_pool_shared_num_idle());
+		php_info_print_table_row(2, "idle persistent sessions (shared)", buf);
+	}
+#endif
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_hits));
+	php_info_print_table_row(2, "persistent session hits (warm)", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_misses));
+	php_info_print_table_row(2, "persistent session misses (cold)", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_warmed));
+	php_info_print_table_row(2, "pre-warmed sessions", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_warm_hits));
+	php_info_print_table_row(2, "pre-warmed sessions handed out", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_warm_failures));
+	php_info_print_table_row(2, "pre-warm failures", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(dns_cache)));
+	php_info_print_table_row(2, "resolver cache entries", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(dns_cache_hits));
+	php_info_print_table_row(2, "resolver cache hits", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(dns_cache_misses));
+	php_info_print_table_row(2, "resolver cache misses", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(breakers)));
+	php_info_print_table_row(2, "failing hosts tracked", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(breaker_fast_failures));
+	php_info_print_table_row(2, "connects refused by open circuit", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(pool_retired));
+	php_info_print_table_row(2, "pooled sessions retired at age or volume limits", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(comp_hosts)));
+	php_info_print_table_row(2, "hosts with compression history", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(known_hosts)));
+	php_info_print_table_row(2, "known_hosts files indexed", buf);
+	snprintf(buf, sizeof(buf), "%ld", SSH2_G(wrapper_cache_hits));
+	php_info_print_table_row(2, "wrapper connections reused", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(key_files)));
+	php_info_print_table_row(2, "cached key files", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(key_plain)));
+	php_info_print_table_row(2, "cached decrypted keys", buf);
+	snprintf(buf, sizeof(buf), "%d", zend_hash_num_elements(&SSH2_G(auth_hints)));
+	php_info_print_table_row(2, "remembered auth methods", buf);
 	php_info_print_table_end();
+
+	php_ssh2_bench_info();
+
+	DISPLAY_INI_ENTRIES();
 }
 /* }}} */
 
@@ -1353,12 +2169,27 @@ PHP_MINFO_FUNCTION(ssh2)
  */
 zend_function_entry ssh2_functions[] = {
 	PHP_FE(ssh2_connect,						NULL)
+	PHP_FE(ssh2_pconnect,						NULL)
+	PHP_FE(ssh2_connect_async,					NULL)
+	PHP_FE(ssh2_connect_step,					NULL)
+	PHP_FE(ssh2_connect_wait,					NULL)
+	PHP_FE(ssh2_connect_multi,					NULL)
+	PHP_FE(ssh2_breaker_stats,					NULL)
+	PHP_FE(ssh2_retire_stats,					NULL)
+	PHP_FE(ssh2_compression_stats,				NULL)
+	PHP_FE(ssh2_session_memory,					NULL)
+	PHP_FE(ssh2_session_stats,					NULL)
+	PHP_FE(ssh2_latency_stats,					NULL)
+	PHP_FE(ssh2_latency_reset,					NULL)
 	PHP_FE(ssh2_methods_negotiated,				NULL)
 	PHP_FE(ssh2_fingerprint,					NULL)
+	PHP_FE(ssh2_known_hosts_check,				NULL)
 
 	PHP_FE(ssh2_auth_none,						NULL)
 	PHP_FE(ssh2_auth_password,					NULL)
 	PHP_FE(ssh2_auth_pubkey_file,				NULL)
+	PHP_FE(ssh2_auth_pubkey_memory,				NULL)
+	PHP_FE(ssh2_key_cache_clear,				NULL)
 	PHP_FE(ssh2_auth_hostbased_file,			NULL)
 
 	PHP_FE(ssh2_forward_listen,					NULL)
@@ -1372,6 +2203,7 @@ zend_function_entry ssh2_functions[] = {
 	PHP_FE(ssh2_scp_send,						NULL)
 	PHP_FE(ssh2_fetch_stream,					NULL)
 	PHP_FE(ssh2_poll,							php_ssh2_first_arg_force_ref)
+	PHP_FE(ssh2_keepalive_tick,					NULL)
 
 	/* SFTP Stuff */
 	PHP_FE(ssh2_sftp,							NULL)
@@ -1395,6 +2227,7 @@ zend_function_entry ssh2_functions[] = {
 	PHP_FE(ssh2_publickey_list,					NULL)
 
 	PHP_FE(ssh2_auth_agent,						NULL)
+	PHP_FE(ssh2_auth_auto,						NULL)
 
 	{NULL, NULL, NULL}
 };
@@ -1410,8 +2243,8 @@ zend_module_entry ssh2_module_entry = {
 	ssh2_functions,
 	PHP_MINIT(ssh2),
 	PHP_MSHUTDOWN(ssh2),
-	NULL, /* RINIT */
-	NULL, /* RSHUTDOWN */
+	PHP_RINIT(ssh2),
+	PHP_RSHUTDOWN(ssh2),
 	PHP_MINFO(ssh2),
 #if ZEND_MODULE_API_NO >= 20010901
 	PHP_SSH2_VERSION,
@@ -0,0 +1,913 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "ext/standard/file.h"
+#include "php_ssh2.h"
+#include "main/php_network.h"
+
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#elif defined(HAVE_SYS_TIME_H)
+# include <sys/time.h>
+#endif
+
+/* A session created by ssh2_connect_async() carries a php_ssh2_async_data until it is established:
+ *
+ *   CONNECTING -> HANDSHAKE -> AUTH -> (async freed, session is an ordinary blocking session)
+ *
+ * Every state only ever does what it can without blocking, the caller drives the machine
+ * with ssh2_connect_step() and waits for the socket with ssh2_connect_wait() (or its own loop)
+ * Name resolution is still done up front and may block
+ */
+
+/* *****************
+   * State Machine *
+   ***************** */
+
+/* {{{ php_ssh2_async_now
+ */
+static double php_ssh2_async_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_free
+ */
+void php_ssh2_async_free(php_ssh2_async_data *async)
+{
+	if (async->username) {
+		efree(async->username);
+	}
+	if (async->password) {
+		efree(async->password);
+	}
+	if (async->pubkey_file) {
+		efree(async->pubkey_file);
+	}
+	if (async->privkey_file) {
+		efree(async->privkey_file);
+	}
+	if (async->passphrase) {
+		efree(async->passphrase);
+	}
+	if (async->error) {
+		efree(async->error);
+	}
+	if (async->host) {
+		efree(async->host);
+	}
+	efree(async);
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_deadline
+ */
+static void php_ssh2_async_deadline(php_ssh2_async_data *async, long timeout)
+{
+	async->deadline = timeout > 0 ? php_ssh2_async_now() + timeout : 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_breaker
+ */
+static void php_ssh2_async_breaker(php_ssh2_async_data *async, int success TSRMLS_DC)
+{
+	if (async->host) {
+		php_ssh2_breaker_record(async->host, async->port, success TSRMLS_CC);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_fail
+ */
+static int php_ssh2_async_fail(LIBSSH2_SESSION *session, php_ssh2_async_data *async, char *what TSRMLS_DC)
+{
+	char *error_msg = NULL;
+	int last_error;
+
+	last_error = libssh2_session_last_error(session, &error_msg, NULL, 0);
+	spprintf(&async->error, 0, "%s(%d): %s", what, last_error, error_msg ? error_msg : "");
+
+	async->state = PHP_SSH2_ASYNC_FAILED;
+	async->want = 0;
+
+	return -1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_step
+ * Advance a pending connection as far as it goes without blocking
+ * Returns 0 once established, -1 on failure (reason left in async->error),
+ * otherwise the PHP_SSH2_ASYNC_WANT_* directions to wait for
+ */
+int php_ssh2_async_step(LIBSSH2_SESSION *session TSRMLS_DC)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	php_ssh2_async_data *async = data->async;
+	int rc;
+
+	if (!async) {
+		return 0;
+	}
+
+	if (async->deadline > 0 && async->state != PHP_SSH2_ASYNC_FAILED && php_ssh2_async_now() > async->deadline) {
+		spprintf(&async->error, 0, "Timed out %s", async->state == PHP_SSH2_ASYNC_CONNECTING ? "connecting" :
+												   (async->state == PHP_SSH2_ASYNC_HANDSHAKE ? "during handshake" : "authenticating"));
+		if (async->state != PHP_SSH2_ASYNC_AUTH) {
+			php_ssh2_async_breaker(async, 0 TSRMLS_CC);
+		}
+		async->state = PHP_SSH2_ASYNC_FAILED;
+		async->want = 0;
+		return -1;
+	}
+
+	switch (async->state) {
+		case PHP_SSH2_ASYNC_CONNECTING:
+		{
+			int error = 0;
+			socklen_t error_len = sizeof(error);
+
+			if (php_pollfd_for_ms(data->socket, POLLOUT, 0) == 0) {
+				return (async->want = PHP_SSH2_ASYNC_WANT_WRITE);
+			}
+
+			if (getsockopt(data->socket, SOL_SOCKET, SO_ERROR, (char*)&error, &error_len) != 0 || error) {
+				char *error_msg = php_socket_strerror(error ? error : php_socket_errno(), NULL, 0);
+
+				spprintf(&async->error, 0, "Unable to connect: %s", error_msg);
+				efree(error_msg);
+				php_ssh2_async_breaker(async, 0 TSRMLS_CC);
+				async->state = PHP_SSH2_ASYNC_FAILED;
+				async->want = 0;
+				return -1;
+			}
+
+			php_ssh2_latency_record(PHP_SSH2_LATENCY_CONNECT, async->phase_started TSRMLS_CC);
+			async->phase_started = php_ssh2_comp_clock();
+			async->state = PHP_SSH2_ASYNC_HANDSHAKE;
+			php_ssh2_async_deadline(async, data->timeouts[PHP_SSH2_TIMEOUT_HANDSHAKE]);
+			libssh2_session_set_blocking(session, 0);
+		}
+		/* fall through */
+		case PHP_SSH2_ASYNC_HANDSHAKE:
+			rc = libssh2_session_startup(session, data->socket);
+			if (rc == LIBSSH2_ERROR_EAGAIN) {
+				break;
+			}
+			if (rc) {
+				php_ssh2_async_breaker(async, 0 TSRMLS_CC);
+				return php_ssh2_async_fail(session, async, "Error starting up SSH connection" TSRMLS_CC);
+			}
+			php_ssh2_latency_record(PHP_SSH2_LATENCY_KEX, async->phase_started TSRMLS_CC);
+			php_ssh2_async_breaker(async, 1 TSRMLS_CC);
+
+			/* Credentials only go to a host whose key checks out */
+			if (php_ssh2_known_hosts_verify(session, &async->error TSRMLS_CC) == FAILURE) {
+				async->state = PHP_SSH2_ASYNC_FAILED;
+				async->want = 0;
+				return -1;
+			}
+
+			async->phase_started = php_ssh2_comp_clock();
+			async->state = PHP_SSH2_ASYNC_AUTH;
+			php_ssh2_async_deadline(async, data->timeouts[PHP_SSH2_TIMEOUT_AUTH]);
+		/* fall through */
+		case PHP_SSH2_ASYNC_AUTH:
+		{
+			char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+
+			if (!async->username) {
+				goto done;
+			}
+
+			if (async->password) {
+				rc = libssh2_userauth_password_ex(session, async->username, async->username_len, async->password, async->password_len, NULL);
+			} else {
+				rc = libssh2_userauth_publickey_fromfile_ex(session, async->username, async->username_len, async->pubkey_file, async->privkey_file, async->passphrase);
+			}
+			if (rc == LIBSSH2_ERROR_EAGAIN) {
+				break;
+			}
+			php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + (async->password ? PHP_SSH2_AUTH_PASSWORD : PHP_SSH2_AUTH_PUBKEY), async->phase_started TSRMLS_CC);
+			if (rc) {
+				return php_ssh2_async_fail(session, async, "Authentication failed" TSRMLS_CC);
+			}
+
+			if (async->password) {
+				php_ssh2_auth_ident(ident, async->username, async->username_len, "password", async->password, async->password_len);
+			} else {
+				php_ssh2_auth_ident_keyfile(ident, async->username, async->username_len, "publickey", async->pubkey_file, async->privkey_file, async->passphrase TSRMLS_CC);
+			}
+			php_ssh2_session_auth_remember(session, ident);
+			goto done;
+		}
+		case PHP_SSH2_ASYNC_FAILED:
+		default:
+			return -1;
+	}
+
+	/* libssh2 knows which way it was blocked, a fresh socket with nothing sent yet waits for the banner */
+	async->want = libssh2_session_block_directions(session);
+	if (!async->want) {
+		async->want = PHP_SSH2_ASYNC_WANT_READ;
+	}
+	return async->want;
+
+done:
+	libssh2_session_set_blocking(session, 1);
+	php_ssh2_session_timeout(session, libssh2_userauth_authenticated(session) ? PHP_SSH2_TIMEOUT_OPERATION : PHP_SSH2_TIMEOUT_AUTH);
+	php_ssh2_async_free(async);
+	data->async = NULL;
+
+	return 0;
+}
+/* }}} */
+
+/* ***********************
+   * Userspace Functions *
+   *********************** */
+
+/* {{{ php_ssh2_async_auth_string
+ * A copy of a string credential, anything else (NULL included) counts as absent and the caller's array is left alone
+ */
+static char *php_ssh2_async_auth_string(HashTable *ht, char *name, int name_size, int *len)
+{
+	zval **value;
+
+	if (zend_hash_find(ht, name, name_size, (void**)&value) == FAILURE || !value || !*value || Z_TYPE_PP(value) != IS_STRING) {
+		return NULL;
+	}
+
+	if (len) {
+		*len = Z_STRLEN_PP(value);
+	}
+	return estrndup(Z_STRVAL_PP(value), Z_STRLEN_PP(value));
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_prepare
+ * Set up the connection state along with the credentials from an auth array
+ */
+static php_ssh2_async_data *php_ssh2_async_prepare(zval *auth, char **error TSRMLS_DC)
+{
+	php_ssh2_async_data *async;
+
+	async = ecalloc(1, sizeof(php_ssh2_async_data));
+	async->state = PHP_SSH2_ASYNC_CONNECTING;
+
+	if (auth && (Z_TYPE_P(auth) == IS_ARRAY || Z_TYPE_P(auth) == IS_OBJECT)) {
+		HashTable *ht = HASH_OF(auth);
+
+		async->username = php_ssh2_async_auth_string(ht, "username", sizeof("username"), &async->username_len);
+		async->password = php_ssh2_async_auth_string(ht, "password", sizeof("password"), &async->password_len);
+		async->pubkey_file = php_ssh2_async_auth_string(ht, "pubkey_file", sizeof("pubkey_file"), NULL);
+		async->privkey_file = php_ssh2_async_auth_string(ht, "privkey_file", sizeof("privkey_file"), NULL);
+		async->passphrase = php_ssh2_async_auth_string(ht, "passphrase", sizeof("passphrase"), NULL);
+
+		if (async->username && !async->password && (!async->pubkey_file || !async->privkey_file)) {
+			*error = estrdup("Authentication requires either a password or a pubkey_file and privkey_file");
+			php_ssh2_async_free(async);
+			return NULL;
+		}
+		if (async->username && !async->password &&
+			(SSH2_OPENBASEDIR_CHECKPATH(async->pubkey_file) || SSH2_OPENBASEDIR_CHECKPATH(async->privkey_file))) {
+			*error = estrdup("Key file not within the allowed path(s)");
+			php_ssh2_async_free(async);
+			return NULL;
+		}
+	}
+
+	return async;
+}
+/* }}} */
+
+/* {{{ php_ssh2_async_connect
+ * Start a non-blocking connect, on failure NULL is returned and the reason is left in *error
+ */
+LIBSSH2_SESSION *php_ssh2_async_connect(char *host, int port, zval *methods, zval *callbacks, zval *auth, char **error TSRMLS_DC)
+{
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	php_ssh2_async_data *async;
+	int socket;
+	struct timeval tv;
+
+	if (php_ssh2_breaker_allow(host, port, error TSRMLS_CC) == FAILURE) {
+		return NULL;
+	}
+
+	async = php_ssh2_async_prepare(auth, error TSRMLS_CC);
+	if (!async) {
+		return NULL;
+	}
+	async->host = estrdup(host);
+	async->port = port;
+
+	tv.tv_sec = FG(default_socket_timeout);
+	tv.tv_usec = 0;
+
+	/* Without an asynchronous connect (PHP 4) the machine starts with a connected socket */
+	async->phase_started = php_ssh2_comp_clock();
+	socket = php_ssh2_connect_socket(host, port, 1, &tv, error TSRMLS_CC);
+	if (socket < 0) {
+		php_ssh2_async_breaker(async, 0 TSRMLS_CC);
+		php_ssh2_async_free(async);
+		return NULL;
+	}
+
+	session = php_ssh2_session_init(host, port, socket, methods, callbacks, 0 TSRMLS_CC);
+	if (!session) {
+		*error = estrdup("Unable to initialize SSH2 session");
+		closesocket(socket);
+		php_ssh2_async_free(async);
+		return NULL;
+	}
+
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	data->async = async;
+	php_ssh2_async_deadline(async, data->timeouts[PHP_SSH2_TIMEOUT_CONNECT]);
+
+	return session;
+}
+/* }}} */
+
+/* {{{ proto resource ssh2_connect_async(string host[, int port[, array methods[, array callbacks[, array auth]]]])
+ * Start connecting to a remote SSH server without waiting for the connection or the handshake
+ * auth may hold 'username' along with either 'password' or 'pubkey_file', 'privkey_file' and optionally 'passphrase'
+ * The returned session can not be used until ssh2_connect_step() returns true
+ */
+PHP_FUNCTION(ssh2_connect_async)
+{
+	LIBSSH2_SESSION *session;
+	zval *methods = NULL, *callbacks = NULL, *auth = NULL;
+	char *host, *error = NULL;
+	long port = PHP_SSH2_DEFAULT_PORT;
+	int host_len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|la!a!a!", &host, &host_len, &port, &methods, &callbacks, &auth) == FAILURE) {
+		return;
+	}
+
+	session = php_ssh2_async_connect(host, port, methods, callbacks, auth, &error TSRMLS_CC);
+	if (!session) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", error);
+		efree(error);
+		RETURN_FALSE;
+	}
+
+	ZEND_REGISTER_RESOURCE(return_value, session, le_ssh2_session);
+}
+/* }}} */
+
+/* {{{ proto mixed ssh2_connect_step(resource session)
+ * Advance a connection started by ssh2_connect_async() without blocking
+ * Returns true once the session is established (and authenticated if requested), false on failure,
+ * otherwise a mask of SSH2_ASYNC_WANT_READ and SSH2_ASYNC_WANT_WRITE to wait for before the next step
+ */
+PHP_FUNCTION(ssh2_connect_step)
+{
+	LIBSSH2_SESSION *session;
+	zval *zsession;
+	int rc;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zsession) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+
+	rc = php_ssh2_async_step(session TSRMLS_CC);
+	if (rc < 0) {
+		php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", data->async->error ? data->async->error : "Connection failed");
+		RETURN_FALSE;
+	}
+	if (rc == 0) {
+		RETURN_TRUE;
+	}
+	RETURN_LONG(rc);
+}
+/* }}} */
+
+/* {{{ proto array ssh2_connect_wait(array sessions[, int timeout_ms])
+ * Wait until at least one of the pending sessions can be stepped further
+ * Returns the keys of those sessions, sessions which are no longer pending are always ready
+ * A negative timeout (the default) waits indefinitely
+ */
+PHP_FUNCTION(ssh2_connect_wait)
+{
+	zval *zsessions, **zsession;
+	long timeout = -1;
+	php_pollfd *pollfds;
+	zval **keys;
+	int numfds = 0, ready = 0, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|l", &zsessions, &timeout) == FAILURE) {
+		return;
+	}
+
+	array_init(return_value);
+
+	i = zend_hash_num_elements(Z_ARRVAL_P(zsessions));
+	if (!i) {
+		return;
+	}
+	pollfds = safe_emalloc(i, sizeof(php_pollfd), 0);
+	keys = safe_emalloc(i, sizeof(zval*), 0);
+
+	for(zend_hash_internal_pointer_reset(Z_ARRVAL_P(zsessions));
+		zend_hash_get_current_data(Z_ARRVAL_P(zsessions), (void**)&zsession) == SUCCESS;
+		zend_hash_move_forward(Z_ARRVAL_P(zsessions))) {
+		LIBSSH2_SESSION *session;
+		php_ssh2_session_data *data;
+		zval *key;
+		char *skey;
+		uint skey_len;
+		ulong nkey;
+
+		session = (LIBSSH2_SESSION*)zend_fetch_resource(zsession TSRMLS_CC, -1, PHP_SSH2_SESSION_RES_NAME, NULL, 1, le_ssh2_session);
+		if (!session) {
+			/* zend_fetch_resource has already warned */
+			continue;
+		}
+		data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+		MAKE_STD_ZVAL(key);
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(zsessions), &skey, &skey_len, &nkey, 0, NULL) == HASH_KEY_IS_STRING) {
+			ZVAL_STRINGL(key, skey, skey_len - 1, 1);
+		} else {
+			ZVAL_LONG(key, nkey);
+		}
+
+		if (!data->async || !data->async->want) {
+			add_next_index_zval(return_value, key);
+			ready++;
+			continue;
+		}
+
+		pollfds[numfds].fd = data->socket;
+		pollfds[numfds].events = ((data->async->want & PHP_SSH2_ASYNC_WANT_READ) ? POLLIN : 0) |
+								 ((data->async->want & PHP_SSH2_ASYNC_WANT_WRITE) ? POLLOUT : 0);
+		pollfds[numfds].revents = 0;
+		keys[numfds++] = key;
+	}
+
+	if (numfds && php_poll2(pollfds, numfds, ready ? 0 : timeout) > 0) {
+		for(i = 0; i < numfds; i++) {
+			if (pollfds[i].revents) {
+				add_next_index_zval(return_value, keys[i]);
+				keys[i] = NULL;
+			}
+		}
+	}
+
+	for(i = 0; i < numfds; i++) {
+		if (keys[i]) {
+			zval_ptr_dtor(&keys[i]);
+		}
+	}
+	efree(keys);
+	efree(pollfds);
+}
+/* }}} */
+
+/* ****************
+   * Multi Connect *
+   **************** */
+
+typedef struct _php_ssh2_multi_target {
+	/* Borrowed from the targets array */
+	char *key;
+	uint key_len;
+	ulong index;
+	char *host;
+	int port;
+	zval *methods, *callbacks, *auth;
+
+	LIBSSH2_SESSION *session;
+	int want;
+	double deadline;
+} php_ssh2_multi_target;
+
+/* {{{ php_ssh2_multi_opt
+ */
+static zval *php_ssh2_multi_opt(HashTable *ht, char *name, int name_size, zval *def)
+{
+	zval **value;
+
+	if (ht && zend_hash_find(ht, name, name_size, (void**)&value) == SUCCESS && value && *value && Z_TYPE_PP(value) != IS_NULL) {
+		return *value;
+	}
+	return def;
+}
+/* }}} */
+
+/* {{{ php_ssh2_multi_opt_long
+ */
+static long php_ssh2_multi_opt_long(HashTable *ht, char *name, int name_size, long def)
+{
+	zval *value = php_ssh2_multi_opt(ht, name, name_size, NULL), tmp;
+
+	if (!value) {
+		return def;
+	}
+	tmp = *value;
+	zval_copy_ctor(&tmp);
+	convert_to_long(&tmp);
+
+	return Z_LVAL(tmp);
+}
+/* }}} */
+
+/* {{{ php_ssh2_multi_add
+ */
+static void php_ssh2_multi_add(zval *arr, php_ssh2_multi_target *target, zval *value)
+{
+	if (target->key) {
+		add_assoc_zval_ex(arr, target->key, target->key_len, value);
+	} else {
+		add_index_zval(arr, target->index, value);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_multi_error
+ */
+static void php_ssh2_multi_error(zval *errors, php_ssh2_multi_target *target, char *error)
+{
+	zval *zerror;
+
+	MAKE_STD_ZVAL(zerror);
+	ZVAL_STRING(zerror, error, 1);
+	php_ssh2_multi_add(errors, target, zerror);
+}
+/* }}} */
+
+#ifdef PHP_SSH2_THREADS
+/* {{{ php_ssh2_multi_threaded
+ * Hand every target to the handshake threads and wait for all of them
+ * Sessions are allocated with the persistent (malloc based) allocators so the threads may use them,
+ * userspace callbacks are only installed once a session is back on this thread
+ */
+static void php_ssh2_multi_threaded(php_ssh2_multi_target *targets, int num_targets, long threads, long timeout, zval *sessions, zval *errors TSRMLS_DC)
+{
+	php_ssh2_thread_job *jobs;
+	int num_jobs = 0, i;
+
+	jobs = safe_emalloc(num_targets, sizeof(php_ssh2_thread_job), 0);
+
+	for(i = 0; i < num_targets; i++) {
+		php_ssh2_multi_target *target = &targets[i];
+		php_ssh2_thread_job *job = &jobs[num_jobs];
+		php_ssh2_async_data *async;
+		char *error = NULL;
+
+		if (php_ssh2_breaker_allow(target->host, target->port, &error TSRMLS_CC) == FAILURE) {
+			php_ssh2_multi_error(errors, target, error);
+			efree(error);
+			continue;
+		}
+
+		async = php_ssh2_async_prepare(target->auth, &error TSRMLS_CC);
+		if (!async) {
+			php_ssh2_multi_error(errors, target, error);
+			efree(error);
+			continue;
+		}
+
+		target->session = php_ssh2_session_init(target->host, target->port, -1, target->methods, NULL, 1 TSRMLS_CC);
+		if (!target->session) {
+			php_ssh2_multi_error(errors, target, "Unable to initialize SSH2 session");
+			php_ssh2_async_free(async);
+			continue;
+		}
+
+		memset(job, 0, sizeof(php_ssh2_thread_job));
+		job->data = *(php_ssh2_session_data**)libssh2_session_abstract(target->session);
+		if (job->data->retire_bytes || job->data->retire_time) {
+			/* Persistent only so the threads may allocate, these never go back to the pool */
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "methods['retire'] only applies to pooled sessions, ignoring it");
+			job->data->retire_bytes = 0;
+			job->data->retire_time = 0;
+		}
+		if (job->data->known_hosts) {
+			/* Parse and scan the hashed entries here, the threads only read the index */
+			if (!(job->known_hosts = php_ssh2_known_hosts_get(job->data->known_hosts TSRMLS_CC))) {
+				spprintf(&error, 0, "Unable to load known hosts from %s", job->data->known_hosts);
+				php_ssh2_multi_error(errors, target, error);
+				efree(error);
+				php_ssh2_session_free(target->session TSRMLS_CC);
+				target->session = NULL;
+				php_ssh2_async_free(async);
+				continue;
+			}
+			php_ssh2_known_hosts_addref(job->known_hosts);
+			php_ssh2_known_hosts_prime(job->known_hosts, target->host, target->port);
+			job->known_hosts_strict = job->data->known_hosts_strict;
+		}
+		job->host = target->host;
+		job->port = target->port;
+		job->timeout = timeout;
+		job->session = target->session;
+		job->data->async = async;
+		job->tag = i;
+		php_ssh2_sockopts_parse(target->methods, &job->sockopts TSRMLS_CC);
+		num_jobs++;
+	}
+
+	php_ssh2_threads_run(jobs, num_jobs, threads);
+
+	for(i = 0; i < num_jobs; i++) {
+		php_ssh2_thread_job *job = &jobs[i];
+		php_ssh2_multi_target *target = &targets[job->tag];
+		php_ssh2_async_data *async = job->data->async;
+		zval *zsession;
+
+		if (job->known_hosts) {
+			php_ssh2_known_hosts_release(job->known_hosts);
+		}
+		php_ssh2_breaker_record(job->host, job->port, job->handshaken TSRMLS_CC);
+		if (job->failed) {
+			php_ssh2_multi_error(errors, target, job->error);
+			php_ssh2_session_free(target->session TSRMLS_CC);
+			target->session = NULL;
+			continue;
+		}
+
+		if (async->username) {
+			char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+
+			if (async->password) {
+				php_ssh2_auth_ident(ident, async->username, async->username_len, "password", async->password, async->password_len);
+			} else {
+				php_ssh2_auth_ident_keyfile(ident, async->username, async->username_len, "publickey", async->pubkey_file, async->privkey_file, async->passphrase TSRMLS_CC);
+			}
+			php_ssh2_session_auth_remember(target->session, ident);
+		}
+		php_ssh2_async_free(async);
+		job->data->async = NULL;
+		php_ssh2_session_timeout(target->session, libssh2_userauth_authenticated(target->session) ? PHP_SSH2_TIMEOUT_OPERATION : PHP_SSH2_TIMEOUT_AUTH);
+
+		if (target->callbacks) {
+			php_ssh2_session_set_callbacks(target->session, target->callbacks, job->data TSRMLS_CC);
+		}
+
+		MAKE_STD_ZVAL(zsession);
+		ZEND_REGISTER_RESOURCE(zsession, target->session, le_ssh2_session);
+		php_ssh2_multi_add(sessions, target, zsession);
+		target->session = NULL;
+	}
+
+	efree(jobs);
+}
+/* }}} */
+#endif
+
+/* {{{ proto array ssh2_connect_multi(array targets[, array options])
+ * Connect, handshake and optionally authenticate with many servers concurrently
+ * Each target is either a hostname or an array with 'host' and optionally 'port', 'methods', 'callbacks' and 'auth'
+ * (as for ssh2_connect_async()), options supplies defaults for those along with
+ * 'concurrency' (connections in flight, default 64) and 'timeout' (milliseconds per target, default default_socket_timeout, 0 for none)
+ * With 'threads' > 0 the handshakes run on that many native threads instead (requires --enable-ssh2-threads)
+ * Returns array('sessions' => array(key => session), 'errors' => array(key => message)) keyed like targets
+ */
+PHP_FUNCTION(ssh2_connect_multi)
+{
+	zval *ztargets, *zoptions = NULL, **ztarget, *sessions, *errors;
+	zval *def_methods, *def_callbacks, *def_auth;
+	HashTable *options = NULL;
+	php_ssh2_multi_target *targets, *target;
+	php_pollfd *pollfds;
+	int *active, *polled;
+	int num_targets = 0, next = 0, num_active = 0, i;
+	long def_port, concurrency, timeout, threads;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|a!", &ztargets, &zoptions) == FAILURE) {
+		return;
+	}
+
+	if (zoptions) {
+		options = Z_ARRVAL_P(zoptions);
+	}
+	def_port = php_ssh2_multi_opt_long(options, "port", sizeof("port"), PHP_SSH2_DEFAULT_PORT);
+	def_methods = php_ssh2_multi_opt(options, "methods", sizeof("methods"), NULL);
+	def_callbacks = php_ssh2_multi_opt(options, "callbacks", sizeof("callbacks"), NULL);
+	def_auth = php_ssh2_multi_opt(options, "auth", sizeof("auth"), NULL);
+	concurrency = php_ssh2_multi_opt_long(options, "concurrency", sizeof("concurrency"), PHP_SSH2_MULTI_CONCURRENCY);
+	timeout = php_ssh2_multi_opt_long(options, "timeout", sizeof("timeout"), FG(default_socket_timeout) * 1000);
+	if (concurrency <= 0) {
+		concurrency = PHP_SSH2_MULTI_CONCURRENCY;
+	}
+	threads = php_ssh2_multi_opt_long(options, "threads", sizeof("threads"), 0);
+#ifndef PHP_SSH2_THREADS
+	if (threads > 0) {
+		php_error_docref(NULL TSRMLS_CC, E_NOTICE, "Handshake threads are not available in this build, connecting from this thread");
+		threads = 0;
+	}
+#endif
+
+	array_init(return_value);
+	MAKE_STD_ZVAL(sessions);
+	array_init(sessions);
+	MAKE_STD_ZVAL(errors);
+	array_init(errors);
+	add_assoc_zval(return_value, "sessions", sessions);
+	add_assoc_zval(return_value, "errors", errors);
+
+	i = zend_hash_num_elements(Z_ARRVAL_P(ztargets));
+	if (!i) {
+		return;
+	}
+	if (concurrency > i) {
+		concurrency = i;
+	}
+	targets = safe_emalloc(i, sizeof(php_ssh2_multi_target), 0);
+	active = safe_emalloc(concurrency, sizeof(int), 0);
+	polled = safe_emalloc(concurrency, sizeof(int), 0);
+	pollfds = safe_emalloc(concurrency, sizeof(php_pollfd), 0);
+
+	for(zend_hash_internal_pointer_reset(Z_ARRVAL_P(ztargets));
+		zend_hash_get_current_data(Z_ARRVAL_P(ztargets), (void**)&ztarget) == SUCCESS;
+		zend_hash_move_forward(Z_ARRVAL_P(ztargets))) {
+		zval *host;
+
+		target = &targets[num_targets];
+		memset(target, 0, sizeof(php_ssh2_multi_target));
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(ztargets), &target->key, &target->key_len, &target->index, 0, NULL) != HASH_KEY_IS_STRING) {
+			target->key = NULL;
+		}
+		target->port = def_port;
+		target->methods = def_methods;
+		target->callbacks = def_callbacks;
+		target->auth = def_auth;
+
+		if (Z_TYPE_PP(ztarget) == IS_ARRAY) {
+			HashTable *ht = Z_ARRVAL_PP(ztarget);
+
+			host = php_ssh2_multi_opt(ht, "host", sizeof("host"), NULL);
+			target->port = php_ssh2_multi_opt_long(ht, "port", sizeof("port"), def_port);
+			target->methods = php_ssh2_multi_opt(ht, "methods", sizeof("methods"), def_methods);
+			target->callbacks = php_ssh2_multi_opt(ht, "callbacks", sizeof("callbacks"), def_callbacks);
+			target->auth = php_ssh2_multi_opt(ht, "auth", sizeof("auth"), def_auth);
+		} else {
+			host = *ztarget;
+		}
+
+		if (!host || Z_TYPE_P(host) != IS_STRING ||
+			(target->methods && Z_TYPE_P(target->methods) != IS_ARRAY) ||
+			(target->callbacks && Z_TYPE_P(target->callbacks) != IS_ARRAY)) {
+			php_ssh2_multi_error(errors, target, "Invalid target, expecting a hostname or an array with 'host'");
+			continue;
+		}
+		target->host = Z_STRVAL_P(host);
+		num_targets++;
+	}
+
+#ifdef PHP_SSH2_THREADS
+	if (threads > 0) {
+		php_ssh2_multi_threaded(targets, num_targets, threads, timeout, sessions, errors TSRMLS_CC);
+		num_targets = 0;
+	}
+#endif
+
+	while (next < num_targets || num_active) {
+		double now = php_ssh2_async_now(), wait = -1;
+		int num_polled = 0, step_now = 0;
+
+		/* Top up the connections in flight */
+		while (num_active < concurrency && next < num_targets) {
+			char *error = NULL;
+
+			target = &targets[next];
+			target->session = php_ssh2_async_connect(target->host, target->port, target->methods, target->callbacks, target->auth, &error TSRMLS_CC);
+			if (!target->session) {
+				php_ssh2_multi_error(errors, target, error);
+				efree(error);
+				next++;
+				continue;
+			}
+			target->want = 0;
+			target->deadline = timeout > 0 ? now + timeout : -1;
+			active[num_active++] = next++;
+		}
+
+		for(i = 0; i < num_active; i++) {
+			php_ssh2_session_data *data;
+
+			target = &targets[active[i]];
+			if (!target->want) {
+				step_now = 1;
+				continue;
+			}
+			if (target->deadline >= 0 && (wait < 0 || target->deadline - now < wait)) {
+				wait = target->deadline > now ? target->deadline - now : 0;
+			}
+
+			data = *(php_ssh2_session_data**)libssh2_session_abstract(target->session);
+			pollfds[num_polled].fd = data->socket;
+			pollfds[num_polled].events = ((target->want & PHP_SSH2_ASYNC_WANT_READ) ? POLLIN : 0) |
+										 ((target->want & PHP_SSH2_ASYNC_WANT_WRITE) ? POLLOUT : 0);
+			pollfds[num_polled].revents = 0;
+			polled[num_polled++] = active[i];
+		}
+
+		if (num_polled && php_poll2(pollfds, num_polled, step_now ? 0 : (int)wait) > 0) {
+			for(i = 0; i < num_polled; i++) {
+				if (pollfds[i].revents) {
+					targets[polled[i]].want = 0;
+				}
+			}
+		}
+
+		now = php_ssh2_async_now();
+		for(i = 0; i < num_active; i++) {
+			int rc;
+
+			target = &targets[active[i]];
+			if (target->want) {
+				php_ssh2_async_data *async;
+
+				if (target->deadline < 0 || now < target->deadline) {
+					continue;
+				}
+				/* A host that hangs counts against its breaker like one that refuses,
+				 * past the handshake the breaker has been told about the success already */
+				async = (*(php_ssh2_session_data**)libssh2_session_abstract(target->session))->async;
+				if (async && async->state != PHP_SSH2_ASYNC_AUTH) {
+					php_ssh2_async_breaker(async, 0 TSRMLS_CC);
+				}
+				php_ssh2_multi_error(errors, target, "Timed out");
+				rc = -1;
+			} else {
+				rc = php_ssh2_async_step(target->session TSRMLS_CC);
+				if (rc > 0) {
+					target->want = rc;
+					continue;
+				}
+			}
+
+			if (rc == 0) {
+				zval *zsession;
+
+				MAKE_STD_ZVAL(zsession);
+				ZEND_REGISTER_RESOURCE(zsession, target->session, le_ssh2_session);
+				php_ssh2_multi_add(sessions, target, zsession);
+			} else {
+				php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(target->session);
+
+				if (!target->want) {
+					php_ssh2_multi_error(errors, target, data->async->error ? data->async->error : "Connection failed");
+				}
+				php_ssh2_session_free(target->session TSRMLS_CC);
+			}
+			target->session = NULL;
+
+			/* Done with this one, the last in flight takes its slot */
+			active[i--] = active[--num_active];
+		}
+	}
+
+	efree(pollfds);
+	efree(polled);
+	efree(active);
+	efree(targets);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
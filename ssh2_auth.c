@@ -0,0 +1,547 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "ext/standard/md5.h"
+#include "php_ssh2.h"
+
+/* Every method tried costs a round trip, as does asking for the list of methods
+ * SSH2_G(auth_hints) remembers per user@host:port which method (and which agent identity) succeeded last,
+ * the next authentication tries that first and skips libssh2_userauth_list() when it works
+ */
+
+typedef struct _php_ssh2_auth_hint {
+	int method;
+
+	/* MD5 of the agent identity's public key blob */
+	unsigned char identity[16];
+	int has_identity;
+} php_ssh2_auth_hint;
+
+/* **************
+   * Auth hints *
+   ************** */
+
+/* {{{ php_ssh2_auth_hint_key
+ */
+static int php_ssh2_auth_hint_key(LIBSSH2_SESSION *session, char *username, int username_len, char *key, int key_size)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	int key_len;
+
+	if (!data || !data->host) {
+		return 0;
+	}
+	key_len = snprintf(key, key_size, "%.*s@%s:%d", username_len, username, data->host, data->port);
+
+	return (key_len > 0 && key_len < key_size) ? key_len + 1 : 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_auth_hint_find
+ */
+static php_ssh2_auth_hint *php_ssh2_auth_hint_find(LIBSSH2_SESSION *session, char *username, int username_len TSRMLS_DC)
+{
+	char key[512];
+	int key_len = php_ssh2_auth_hint_key(session, username, username_len, key, sizeof(key));
+	php_ssh2_auth_hint *hint;
+
+	if (key_len && zend_hash_find(&SSH2_G(auth_hints), key, key_len, (void**)&hint) == SUCCESS) {
+		return hint;
+	}
+
+	return NULL;
+}
+/* }}} */
+
+/* {{{ php_ssh2_auth_hint_record
+ * Remember what worked, method 0 forgets
+ */
+static void php_ssh2_auth_hint_record(LIBSSH2_SESSION *session, char *username, int username_len, int method,
+									const unsigned char *blob, size_t blob_len TSRMLS_DC)
+{
+	char key[512];
+	int key_len = php_ssh2_auth_hint_key(session, username, username_len, key, sizeof(key));
+	php_ssh2_auth_hint hint;
+
+	if (!key_len) {
+		return;
+	}
+	if (!method) {
+		zend_hash_del(&SSH2_G(auth_hints), key, key_len);
+		return;
+	}
+
+	memset(&hint, 0, sizeof(hint));
+	hint.method = method;
+	if (blob) {
+		PHP_MD5_CTX context;
+
+		PHP_MD5Init(&context);
+		PHP_MD5Update(&context, blob, blob_len);
+		PHP_MD5Final(hint.identity, &context);
+		hint.has_identity = 1;
+	}
+
+	if (!zend_hash_exists(&SSH2_G(auth_hints), key, key_len) &&
+		zend_hash_num_elements(&SSH2_G(auth_hints)) >= PHP_SSH2_AUTH_HINT_CACHE_SIZE) {
+		zend_hash_clean(&SSH2_G(auth_hints));
+	}
+	zend_hash_update(&SSH2_G(auth_hints), key, key_len, &hint, sizeof(php_ssh2_auth_hint), NULL);
+}
+/* }}} */
+
+/* {{{ php_ssh2_auth_method_name
+ */
+char *php_ssh2_auth_method_name(int method)
+{
+	switch (method) {
+		case PHP_SSH2_AUTH_PASSWORD:	return "password";
+		case PHP_SSH2_AUTH_KBDINT:		return "keyboard-interactive";
+		case PHP_SSH2_AUTH_PUBKEY:		return "publickey";
+		case PHP_SSH2_AUTH_AGENT:		return "agent";
+	}
+
+	return "none";
+}
+/* }}} */
+
+/* *****************
+   * Auth attempts *
+   ***************** */
+
+/* {{{ php_ssh2_kbd_callback
+ * Answer a single keyboard-interactive prompt with the password stashed in the session,
+ * never anything process wide, another thread may be authenticating at the same time
+ */
+static LIBSSH2_USERAUTH_KBDINT_RESPONSE_FUNC(php_ssh2_kbd_callback)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)abstract;
+
+	(void)name;
+	(void)name_len;
+	(void)instruction;
+	(void)instruction_len;
+	(void)prompts;
+	if (num_prompts == 1 && data && data->kbd_password) {
+		/* libssh2 frees it through the session's own allocator */
+		responses[0].text = php_ssh2_slab_alloc(&data->slab, data->kbd_password_len + 1);
+		if (responses[0].text) {
+			memcpy(responses[0].text, data->kbd_password, data->kbd_password_len);
+			responses[0].text[data->kbd_password_len] = 0;
+			responses[0].length = data->kbd_password_len;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_userauth_kbdint
+ */
+static int php_ssh2_userauth_kbdint(LIBSSH2_SESSION *session, char *username, int username_len, char *password, int password_len TSRMLS_DC)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	double started = php_ssh2_comp_clock();
+	int rc;
+
+	data->kbd_password = password;
+	data->kbd_password_len = password_len;
+	rc = libssh2_userauth_keyboard_interactive_ex(session, username, username_len, php_ssh2_kbd_callback);
+	data->kbd_password = NULL;
+	data->kbd_password_len = 0;
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + PHP_SSH2_AUTH_KBDINT, started TSRMLS_CC);
+
+	return rc;
+}
+/* }}} */
+
+/* {{{ php_ssh2_userauth_plain
+ */
+static int php_ssh2_userauth_plain(LIBSSH2_SESSION *session, char *username, int username_len, char *password, int password_len TSRMLS_DC)
+{
+	double started = php_ssh2_comp_clock();
+	int rc;
+
+	rc = libssh2_userauth_password_ex(session, username, username_len, password, password_len, NULL);
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + PHP_SSH2_AUTH_PASSWORD, started TSRMLS_CC);
+
+	return rc;
+}
+/* }}} */
+
+/* {{{ php_ssh2_userauth_password
+ * keyboard-interactive when the server offers it, then password
+ * Returns the PHP_SSH2_AUTH_* method that worked, 0 if none did
+ */
+int php_ssh2_userauth_password(LIBSSH2_SESSION *session, char *username, int username_len, char *password, int password_len TSRMLS_DC)
+{
+	php_ssh2_auth_hint *hint = php_ssh2_auth_hint_find(session, username, username_len TSRMLS_CC);
+	int tried = 0;
+	char *userauthlist;
+
+	if (hint && hint->method == PHP_SSH2_AUTH_KBDINT) {
+		if (php_ssh2_userauth_kbdint(session, username, username_len, password, password_len TSRMLS_CC) == 0) {
+			return PHP_SSH2_AUTH_KBDINT;
+		}
+		tried = PHP_SSH2_AUTH_KBDINT;
+	} else if (hint && hint->method == PHP_SSH2_AUTH_PASSWORD) {
+		if (php_ssh2_userauth_plain(session, username, username_len, password, password_len TSRMLS_CC) == 0) {
+			return PHP_SSH2_AUTH_PASSWORD;
+		}
+		tried = PHP_SSH2_AUTH_PASSWORD;
+	}
+	if (tried) {
+		php_ssh2_auth_hint_record(session, username, username_len, 0, NULL, 0 TSRMLS_CC);
+	}
+
+	userauthlist = libssh2_userauth_list(session, username, username_len);
+	if (tried != PHP_SSH2_AUTH_KBDINT && userauthlist && strstr(userauthlist, "keyboard-interactive") != NULL) {
+		if (php_ssh2_userauth_kbdint(session, username, username_len, password, password_len TSRMLS_CC) == 0) {
+			php_ssh2_auth_hint_record(session, username, username_len, PHP_SSH2_AUTH_KBDINT, NULL, 0 TSRMLS_CC);
+			return PHP_SSH2_AUTH_KBDINT;
+		}
+	}
+
+	/* TODO: Support password change callback */
+	if (tried != PHP_SSH2_AUTH_PASSWORD &&
+		php_ssh2_userauth_plain(session, username, username_len, password, password_len TSRMLS_CC) == 0) {
+		php_ssh2_auth_hint_record(session, username, username_len, PHP_SSH2_AUTH_PASSWORD, NULL, 0 TSRMLS_CC);
+		return PHP_SSH2_AUTH_PASSWORD;
+	}
+
+	return 0;
+}
+/* }}} */
+
+#ifdef PHP_SSH2_AGENT_AUTH
+/* {{{ php_ssh2_agent_identity_is
+ */
+static int php_ssh2_agent_identity_is(struct libssh2_agent_publickey *identity, unsigned char *digest)
+{
+	PHP_MD5_CTX context;
+	unsigned char identity_digest[16];
+
+	PHP_MD5Init(&context);
+	PHP_MD5Update(&context, identity->blob, identity->blob_len);
+	PHP_MD5Final(identity_digest, &context);
+
+	return memcmp(identity_digest, digest, sizeof(identity_digest)) == 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_agent_userauth
+ */
+static int php_ssh2_agent_userauth(LIBSSH2_AGENT *agent, char *username, struct libssh2_agent_publickey *identity TSRMLS_DC)
+{
+	double started = php_ssh2_comp_clock();
+	int rc;
+
+	rc = libssh2_agent_userauth(agent, username, identity);
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + PHP_SSH2_AUTH_AGENT, started TSRMLS_CC);
+
+	return rc;
+}
+/* }}} */
+
+/* {{{ php_ssh2_agent_ident
+ * A session authenticated through the agent is bound to the public key blob of the identity that worked
+ */
+static void php_ssh2_agent_ident(char *ident, char *username, int username_len, struct libssh2_agent_publickey *identity)
+{
+	php_ssh2_auth_ident(ident, username, username_len, "agent", (char*)identity->blob, identity->blob_len);
+}
+/* }}} */
+
+/* {{{ php_ssh2_agent_auth_matches
+ * Was this (pooled) session authenticated with one of the identities our own agent lists?
+ * On a match ident is set to that identity
+ */
+int php_ssh2_agent_auth_matches(LIBSSH2_SESSION *session, char *username, int username_len, char *ident TSRMLS_DC)
+{
+	struct libssh2_agent_publickey *identity, *prev_identity = NULL;
+	LIBSSH2_AGENT *agent;
+	int matches = 0;
+
+	if (!(agent = libssh2_agent_init(session))) {
+		return 0;
+	}
+	if (libssh2_agent_connect(agent)) {
+		libssh2_agent_free(agent);
+		return 0;
+	}
+
+	if (libssh2_agent_list_identities(agent) == 0) {
+		while (!matches && libssh2_agent_get_identity(agent, &identity, prev_identity) == 0) {
+			php_ssh2_agent_ident(ident, username, username_len, identity);
+			matches = php_ssh2_session_auth_matches(session, ident);
+			prev_identity = identity;
+		}
+	}
+
+	libssh2_agent_disconnect(agent);
+	libssh2_agent_free(agent);
+
+	return matches;
+}
+/* }}} */
+
+/* {{{ php_ssh2_userauth_agent
+ * Try the agent's identities, the one which worked last time first
+ * Returns SUCCESS with ident set to the identity used, or FAILURE with *error set when the agent itself failed
+ */
+int php_ssh2_userauth_agent(LIBSSH2_SESSION *session, char *username, int username_len, char *ident, char **error TSRMLS_DC)
+{
+	php_ssh2_auth_hint *hint = php_ssh2_auth_hint_find(session, username, username_len TSRMLS_CC);
+	struct libssh2_agent_publickey *identity, *prev_identity = NULL;
+	unsigned char hinted[16];
+	int has_hint = 0, rc, ret = FAILURE;
+	LIBSSH2_AGENT *agent;
+
+	*error = NULL;
+	if (hint && hint->method == PHP_SSH2_AUTH_AGENT && hint->has_identity) {
+		memcpy(hinted, hint->identity, sizeof(hinted));
+		has_hint = 1;
+	} else {
+		/* check what authentication methods are available */
+		char *userauthlist = libssh2_userauth_list(session, username, username_len);
+
+		if (!userauthlist || strstr(userauthlist, "publickey") == NULL) {
+			*error = "\"publickey\" authentication is not supported";
+			return FAILURE;
+		}
+	}
+
+	/* Connect to the ssh-agent */
+	agent = libssh2_agent_init(session);
+	if (!agent) {
+		*error = "Failure initializing ssh-agent support";
+		return FAILURE;
+	}
+
+	if (libssh2_agent_connect(agent)) {
+		*error = "Failure connecting to ssh-agent";
+		libssh2_agent_free(agent);
+		return FAILURE;
+	}
+
+	if (libssh2_agent_list_identities(agent)) {
+		*error = "Failure requesting identities to ssh-agent";
+		goto done;
+	}
+
+	/* Listing identities is local, only offering one to the server costs a round trip */
+	if (has_hint) {
+		while ((rc = libssh2_agent_get_identity(agent, &identity, prev_identity)) == 0) {
+			if (php_ssh2_agent_identity_is(identity, hinted)) {
+				if (!php_ssh2_agent_userauth(agent, username, identity TSRMLS_CC)) {
+					php_ssh2_agent_ident(ident, username, username_len, identity);
+					ret = SUCCESS;
+					goto done;
+				}
+				break;
+			}
+			prev_identity = identity;
+		}
+		php_ssh2_auth_hint_record(session, username, username_len, 0, NULL, 0 TSRMLS_CC);
+		prev_identity = NULL;
+	}
+
+	while (1) {
+		rc = libssh2_agent_get_identity(agent, &identity, prev_identity);
+
+		if (rc == 1) {
+			*error = "Couldn't continue authentication";
+			break;
+		}
+
+		if (rc < 0) {
+			*error = "Failure obtaining identity from ssh-agent support";
+			break;
+		}
+
+		if ((!has_hint || !php_ssh2_agent_identity_is(identity, hinted)) &&
+			!php_ssh2_agent_userauth(agent, username, identity TSRMLS_CC)) {
+			php_ssh2_auth_hint_record(session, username, username_len, PHP_SSH2_AUTH_AGENT, identity->blob, identity->blob_len TSRMLS_CC);
+			php_ssh2_agent_ident(ident, username, username_len, identity);
+			ret = SUCCESS;
+			break;
+		}
+		prev_identity = identity;
+	}
+
+done:
+	libssh2_agent_disconnect(agent);
+	libssh2_agent_free(agent);
+
+	return ret;
+}
+/* }}} */
+#endif /* PHP_SSH2_AGENT_AUTH */
+
+/* {{{ proto string ssh2_auth_auto(resource session, string username, array credentials)
+ * Authenticate with whatever of credentials works, trying what worked last time for this user and host first
+ * credentials may hold 'agent' => true, 'pubkey_file', 'privkey_file' and 'passphrase', 'password'
+ * Returns the method used ('agent', 'publickey', 'keyboard-interactive' or 'password'), false if none did
+ */
+PHP_FUNCTION(ssh2_auth_auto)
+{
+	LIBSSH2_SESSION *session;
+	zval *zsession, *zcredentials, **tmpzval;
+	char *username, *password = NULL, *pubkey = NULL, *privkey = NULL, *passphrase = NULL, *userauthlist = NULL;
+	int username_len, password_len = 0, agent = 0, order[4], num_order = 0, i, method = 0, hinted = 0;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	php_ssh2_auth_hint *hint;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rsa", &zsession, &username, &username_len, &zcredentials) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	if (SSH2_SESSION_PENDING(session)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet");
+		RETURN_FALSE;
+	}
+
+	if (zend_hash_find(Z_ARRVAL_P(zcredentials), "agent", sizeof("agent"), (void**)&tmpzval) == SUCCESS && zend_is_true(*tmpzval)) {
+		agent = 1;
+	}
+	if (zend_hash_find(Z_ARRVAL_P(zcredentials), "password", sizeof("password"), (void**)&tmpzval) == SUCCESS && Z_TYPE_PP(tmpzval) == IS_STRING) {
+		password = Z_STRVAL_PP(tmpzval);
+		password_len = Z_STRLEN_PP(tmpzval);
+	}
+	if (zend_hash_find(Z_ARRVAL_P(zcredentials), "pubkey_file", sizeof("pubkey_file"), (void**)&tmpzval) == SUCCESS && Z_TYPE_PP(tmpzval) == IS_STRING &&
+		zend_hash_find(Z_ARRVAL_P(zcredentials), "privkey_file", sizeof("privkey_file"), (void**)&tmpzval) == SUCCESS && Z_TYPE_PP(tmpzval) == IS_STRING) {
+		privkey = Z_STRVAL_PP(tmpzval);
+		zend_hash_find(Z_ARRVAL_P(zcredentials), "pubkey_file", sizeof("pubkey_file"), (void**)&tmpzval);
+		pubkey = Z_STRVAL_PP(tmpzval);
+		if (zend_hash_find(Z_ARRVAL_P(zcredentials), "passphrase", sizeof("passphrase"), (void**)&tmpzval) == SUCCESS && Z_TYPE_PP(tmpzval) == IS_STRING) {
+			passphrase = Z_STRVAL_PP(tmpzval);
+		}
+	}
+
+	if (libssh2_userauth_authenticated(session)) {
+		/* A pooled session is fine if one of the credentials is what it was authenticated with,
+		 * the agent has to list that identity and key files have to pass open_basedir and be readable */
+#ifdef PHP_SSH2_AGENT_AUTH
+		if (agent && php_ssh2_agent_auth_matches(session, username, username_len, ident TSRMLS_CC)) {
+			php_ssh2_session_auth_remember(session, ident);
+			RETURN_STRING("agent", 1);
+		}
+#endif
+		if (privkey && php_ssh2_auth_ident_keyfile(ident, username, username_len, "publickey", pubkey, privkey, passphrase TSRMLS_CC) == SUCCESS) {
+			if (php_ssh2_session_auth_matches(session, ident)) {
+				php_ssh2_session_auth_remember(session, ident);
+				RETURN_STRING("publickey", 1);
+			}
+		}
+		if (password) {
+			php_ssh2_auth_ident(ident, username, username_len, "password", password, password_len);
+			if (php_ssh2_session_auth_matches(session, ident)) {
+				php_ssh2_session_auth_remember(session, ident);
+				RETURN_STRING("password", 1);
+			}
+		}
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection already authenticated");
+		RETURN_FALSE;
+	}
+
+	/* What worked last time, then agent, key file and password
+	 * The hint is only copied, the attempts below update the table */
+	if ((hint = php_ssh2_auth_hint_find(session, username, username_len TSRMLS_CC))) {
+		hinted = hint->method == PHP_SSH2_AUTH_KBDINT ? PHP_SSH2_AUTH_PASSWORD : hint->method;
+		order[num_order++] = hinted;
+	}
+	if (hinted != PHP_SSH2_AUTH_AGENT) {
+		order[num_order++] = PHP_SSH2_AUTH_AGENT;
+	}
+	if (hinted != PHP_SSH2_AUTH_PUBKEY) {
+		order[num_order++] = PHP_SSH2_AUTH_PUBKEY;
+	}
+	if (hinted != PHP_SSH2_AUTH_PASSWORD) {
+		order[num_order++] = PHP_SSH2_AUTH_PASSWORD;
+	}
+
+	for(i = 0; i < num_order && !method; i++) {
+		/* Past the hinted method (or without one) ask once which methods are worth trying at all */
+		if (i == (hinted ? 1 : 0)) {
+			userauthlist = libssh2_userauth_list(session, username, username_len);
+			if (!userauthlist) {
+				if (libssh2_userauth_authenticated(session)) {
+					php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_OPERATION);
+					RETURN_STRING("none", 1);
+				}
+				break;
+			}
+		}
+
+		switch (order[i]) {
+#ifdef PHP_SSH2_AGENT_AUTH
+			case PHP_SSH2_AUTH_AGENT:
+			{
+				char *error;
+
+				if (agent && (!userauthlist || strstr(userauthlist, "publickey")) &&
+					php_ssh2_userauth_agent(session, username, username_len, ident, &error TSRMLS_CC) == SUCCESS) {
+					method = PHP_SSH2_AUTH_AGENT;
+				}
+				break;
+			}
+#endif
+			case PHP_SSH2_AUTH_PUBKEY:
+				if (privkey && (!userauthlist || strstr(userauthlist, "publickey")) &&
+					php_ssh2_userauth_publickey(session, username, username_len, pubkey, privkey, passphrase TSRMLS_CC) == 0) {
+					php_ssh2_auth_hint_record(session, username, username_len, PHP_SSH2_AUTH_PUBKEY, NULL, 0 TSRMLS_CC);
+					php_ssh2_auth_ident_keyfile(ident, username, username_len, "publickey", pubkey, privkey, passphrase TSRMLS_CC);
+					method = PHP_SSH2_AUTH_PUBKEY;
+				} else if (privkey && hinted == PHP_SSH2_AUTH_PUBKEY) {
+					php_ssh2_auth_hint_record(session, username, username_len, 0, NULL, 0 TSRMLS_CC);
+				}
+				break;
+			case PHP_SSH2_AUTH_PASSWORD:
+				if (password && (!userauthlist || strstr(userauthlist, "password") || strstr(userauthlist, "keyboard-interactive"))) {
+					method = php_ssh2_userauth_password(session, username, username_len, password, password_len TSRMLS_CC);
+					php_ssh2_auth_ident(ident, username, username_len, "password", password, password_len);
+				}
+				break;
+		}
+	}
+
+	if (!method) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Authentication failed for %s using any of the given credentials", username);
+		RETURN_FALSE;
+	}
+
+	php_ssh2_session_auth_remember(session, ident);
+	RETURN_STRING(php_ssh2_auth_method_name(method), 1);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
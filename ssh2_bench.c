@@ -0,0 +1,366 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "ext/standard/info.h"
+#include "ext/standard/php_smart_str.h"
+#include "php_ssh2.h"
+
+/* With ssh2.method_benchmark = N, MINIT spends N milliseconds on each crypt and mac method below,
+ * pushing packet sized buffers through libcrypto, which is what libssh2's OpenSSL backend does as well.
+ * Sessions then offer the methods fastest first, unless methods['client_to_server'] or
+ * methods['server_to_client'] names its own. Runs once per process, before any request or thread.
+ *
+ * Only the strong methods are in the tables, speed never moves CBC modes, 3des, hmac-sha1 or hmac-md5
+ * ahead of them, those stay behind in libssh2's own order.
+ */
+
+#ifdef PHP_SSH2_BENCHMARK
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/opensslv.h>
+
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#elif defined(HAVE_SYS_TIME_H)
+# include <sys/time.h>
+#endif
+
+/* Largest packet payload libssh2 sends */
+#define PHP_SSH2_BENCH_BLOCK	32768
+
+typedef struct _php_ssh2_bench_method {
+	const char *name;
+	const EVP_CIPHER *(*cipher)(void);
+	const EVP_MD *(*md)(void);
+
+	/* Bytes per second, 0 when not measured */
+	double rate;
+} php_ssh2_bench_method;
+
+static php_ssh2_bench_method php_ssh2_bench_crypt[] = {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
+	{ "chacha20-poly1305@openssh.com",	EVP_chacha20_poly1305,	NULL, 0.0 },
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x10001000L
+	{ "aes128-gcm@openssh.com",			EVP_aes_128_gcm,		NULL, 0.0 },
+	{ "aes256-gcm@openssh.com",			EVP_aes_256_gcm,		NULL, 0.0 },
+	{ "aes128-ctr",						EVP_aes_128_ctr,		NULL, 0.0 },
+	{ "aes192-ctr",						EVP_aes_192_ctr,		NULL, 0.0 },
+	{ "aes256-ctr",						EVP_aes_256_ctr,		NULL, 0.0 },
+#endif
+	{ NULL, NULL, NULL, 0.0 }
+};
+
+/* Encrypt-then-MAC first, it costs the same */
+static php_ssh2_bench_method php_ssh2_bench_mac[] = {
+	{ "hmac-sha2-256-etm@openssh.com",	NULL, EVP_sha256,	0.0 },
+	{ "hmac-sha2-256",					NULL, EVP_sha256,	0.0 },
+	{ "hmac-sha2-512-etm@openssh.com",	NULL, EVP_sha512,	0.0 },
+	{ "hmac-sha2-512",					NULL, EVP_sha512,	0.0 },
+	{ NULL, NULL, NULL, 0.0 }
+};
+
+/* Fastest first, persistent, NULL until a benchmark ran */
+static char *php_ssh2_bench_crypt_pref = NULL;
+static char *php_ssh2_bench_mac_pref = NULL;
+
+/* {{{ php_ssh2_bench_now
+ * Wall clock in milliseconds
+ */
+static double php_ssh2_bench_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+/* }}} */
+
+/* ***************
+   * Measurement *
+   *************** */
+
+/* {{{ php_ssh2_bench_method_run
+ * Bytes per second one method gets through in budget milliseconds
+ */
+static double php_ssh2_bench_method_run(php_ssh2_bench_method *method, unsigned char *in, unsigned char *out, long budget)
+{
+	unsigned char key[64], iv[64];
+	EVP_CIPHER_CTX *ctx = NULL;
+	double started, elapsed;
+	double bytes = 0.0;
+	int i;
+
+	memset(key, 0x5a, sizeof(key));
+	memset(iv, 0xa5, sizeof(iv));
+
+	if (method->cipher) {
+		ctx = EVP_CIPHER_CTX_new();
+		if (!ctx || !EVP_EncryptInit_ex(ctx, method->cipher(), NULL, key, iv)) {
+			if (ctx) {
+				EVP_CIPHER_CTX_free(ctx);
+			}
+			return 0.0;
+		}
+	}
+
+	started = php_ssh2_bench_now();
+	do {
+		/* Don't ask the clock after every block, it's slower than some of the ciphers */
+		for(i = 0; i < 8; i++) {
+			if (ctx) {
+				int out_len;
+
+				if (!EVP_EncryptUpdate(ctx, out, &out_len, in, PHP_SSH2_BENCH_BLOCK)) {
+					EVP_CIPHER_CTX_free(ctx);
+					return 0.0;
+				}
+			} else {
+				unsigned int md_len;
+
+				HMAC(method->md(), key, 32, in, PHP_SSH2_BENCH_BLOCK, out, &md_len);
+			}
+			bytes += PHP_SSH2_BENCH_BLOCK;
+		}
+		elapsed = php_ssh2_bench_now() - started;
+	} while (elapsed < budget);
+
+	if (ctx) {
+		EVP_CIPHER_CTX_free(ctx);
+	}
+
+	return elapsed > 0.0 ? bytes * 1000.0 / elapsed : 0.0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_bench_sort
+ * Fastest first, a stable insertion sort so equally fast methods keep the table's order
+ */
+static void php_ssh2_bench_sort(php_ssh2_bench_method *methods)
+{
+	int i, j;
+
+	/* The crypt table is empty with an OpenSSL older than 1.0.1 */
+	for(i = 1; methods[0].name && methods[i].name; i++) {
+		php_ssh2_bench_method tmp = methods[i];
+
+		for(j = i; j > 0 && methods[j - 1].rate < tmp.rate; j--) {
+			methods[j] = methods[j - 1];
+		}
+		methods[j] = tmp;
+	}
+}
+/* }}} */
+
+/* ***************
+   * Preferences *
+   *************** */
+
+#ifdef PHP_SSH2_SUPPORTED_ALGS
+/* {{{ php_ssh2_bench_listed
+ */
+static int php_ssh2_bench_listed(const char **algs, int num_algs, const char *name)
+{
+	int i;
+
+	for(i = 0; i < num_algs; i++) {
+		if (strcmp(algs[i], name) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_bench_pref
+ * Measured (strong) methods libssh2 supports fastest first, then whatever else it supports in its own order
+ * so nothing is taken away from the negotiation
+ */
+static char *php_ssh2_bench_pref(LIBSSH2_SESSION *session, int method_type, php_ssh2_bench_method *methods)
+{
+	const char **algs = NULL;
+	smart_str pref = {0};
+	int num_algs, i;
+
+	num_algs = libssh2_session_supported_algs(session, method_type, &algs);
+	if (num_algs <= 0) {
+		return NULL;
+	}
+
+	for(i = 0; methods[i].name; i++) {
+		if (methods[i].rate > 0.0 && php_ssh2_bench_listed(algs, num_algs, methods[i].name)) {
+			if (pref.len) {
+				smart_str_appendc_ex(&pref, ',', 1);
+			}
+			smart_str_appends_ex(&pref, methods[i].name, 1);
+		}
+	}
+	for(i = 0; i < num_algs; i++) {
+		int j, measured = 0;
+
+		for(j = 0; methods[j].name; j++) {
+			if (methods[j].rate > 0.0 && strcmp(methods[j].name, algs[i]) == 0) {
+				measured = 1;
+				break;
+			}
+		}
+		if (!measured) {
+			if (pref.len) {
+				smart_str_appendc_ex(&pref, ',', 1);
+			}
+			smart_str_appends_ex(&pref, algs[i], 1);
+		}
+	}
+	smart_str_0(&pref);
+	libssh2_free(session, algs);
+
+	return pref.c;
+}
+/* }}} */
+#endif
+
+/* {{{ php_ssh2_bench_run
+ * Measure every method for budget milliseconds and build the preference lists, once per process
+ */
+void php_ssh2_bench_run(long budget)
+{
+	unsigned char *in, *out;
+	int i;
+
+	if (budget <= 0 || php_ssh2_bench_crypt[0].rate > 0.0) {
+		return;
+	}
+
+	in = pemalloc(PHP_SSH2_BENCH_BLOCK, 1);
+	out = pemalloc(PHP_SSH2_BENCH_BLOCK + EVP_MAX_BLOCK_LENGTH, 1);
+	for(i = 0; i < PHP_SSH2_BENCH_BLOCK; i++) {
+		in[i] = (unsigned char)(i * 131 + 7);
+	}
+
+	for(i = 0; php_ssh2_bench_crypt[i].name; i++) {
+		php_ssh2_bench_crypt[i].rate = php_ssh2_bench_method_run(&php_ssh2_bench_crypt[i], in, out, budget);
+	}
+	for(i = 0; php_ssh2_bench_mac[i].name; i++) {
+		php_ssh2_bench_mac[i].rate = php_ssh2_bench_method_run(&php_ssh2_bench_mac[i], in, out, budget);
+	}
+	pefree(in, 1);
+	pefree(out, 1);
+
+	php_ssh2_bench_sort(php_ssh2_bench_crypt);
+	php_ssh2_bench_sort(php_ssh2_bench_mac);
+
+#ifdef PHP_SSH2_SUPPORTED_ALGS
+	{
+		/* Only used to ask which algorithms this libssh2 was built with */
+		LIBSSH2_SESSION *session = libssh2_session_init();
+
+		if (session) {
+			php_ssh2_bench_crypt_pref = php_ssh2_bench_pref(session, LIBSSH2_METHOD_CRYPT_CS, php_ssh2_bench_crypt);
+			php_ssh2_bench_mac_pref = php_ssh2_bench_pref(session, LIBSSH2_METHOD_MAC_CS, php_ssh2_bench_mac);
+			libssh2_session_free(session);
+		}
+	}
+#endif
+}
+/* }}} */
+
+/* {{{ php_ssh2_bench_prefer
+ * Offer the fastest methods first, callers overriding methods do so afterwards
+ */
+void php_ssh2_bench_prefer(LIBSSH2_SESSION *session)
+{
+	if (php_ssh2_bench_crypt_pref) {
+		libssh2_session_method_pref(session, LIBSSH2_METHOD_CRYPT_CS, php_ssh2_bench_crypt_pref);
+		libssh2_session_method_pref(session, LIBSSH2_METHOD_CRYPT_SC, php_ssh2_bench_crypt_pref);
+	}
+	if (php_ssh2_bench_mac_pref) {
+		libssh2_session_method_pref(session, LIBSSH2_METHOD_MAC_CS, php_ssh2_bench_mac_pref);
+		libssh2_session_method_pref(session, LIBSSH2_METHOD_MAC_SC, php_ssh2_bench_mac_pref);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_bench_info
+ * Results for phpinfo()
+ */
+void php_ssh2_bench_info(void)
+{
+	char buf[64];
+	int i;
+
+	if (!php_ssh2_bench_crypt[0].rate && !php_ssh2_bench_mac[0].rate) {
+		return;
+	}
+
+	php_info_print_table_start();
+	php_info_print_table_header(2, "method benchmark", "MB/s");
+	for(i = 0; php_ssh2_bench_crypt[i].name; i++) {
+		snprintf(buf, sizeof(buf), "%.1f", php_ssh2_bench_crypt[i].rate / (1024.0 * 1024.0));
+		php_info_print_table_row(2, php_ssh2_bench_crypt[i].name, buf);
+	}
+	for(i = 0; php_ssh2_bench_mac[i].name; i++) {
+		snprintf(buf, sizeof(buf), "%.1f", php_ssh2_bench_mac[i].rate / (1024.0 * 1024.0));
+		php_info_print_table_row(2, php_ssh2_bench_mac[i].name, buf);
+	}
+	php_info_print_table_end();
+}
+/* }}} */
+
+/* {{{ php_ssh2_bench_free
+ */
+void php_ssh2_bench_free(void)
+{
+	if (php_ssh2_bench_crypt_pref) {
+		pefree(php_ssh2_bench_crypt_pref, 1);
+		php_ssh2_bench_crypt_pref = NULL;
+	}
+	if (php_ssh2_bench_mac_pref) {
+		pefree(php_ssh2_bench_mac_pref, 1);
+		php_ssh2_bench_mac_pref = NULL;
+	}
+}
+/* }}} */
+
+#else
+
+void php_ssh2_bench_run(long budget) { }
+void php_ssh2_bench_prefer(LIBSSH2_SESSION *session) { }
+void php_ssh2_bench_info(void) { }
+void php_ssh2_bench_free(void) { }
+
+#endif /* PHP_SSH2_BENCHMARK */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
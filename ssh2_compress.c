@@ -0,0 +1,426 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+
+#include <math.h>
+
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#elif defined(HAVE_SYS_TIME_H)
+# include <sys/time.h>
+#endif
+#ifdef PHP_SSH2_MONOTONIC_CLOCK
+# include <time.h>
+#endif
+#ifdef PHP_SSH2_ZLIB
+# include <zlib.h>
+#endif
+
+/* Compression is negotiated once per handshake, so 'auto' in methods['client_to_server']['comp'] or
+ * methods['server_to_client']['comp'] can't switch it mid session. Instead every session samples the
+ * payload it moves (the first PHP_SSH2_COMP_SAMPLE bytes of each read or write are run through deflate, or
+ * without zlib their order-0 entropy stands in for it) and
+ * how fast it moves it, and what was learned about host:port decides the next handshake:
+ * zlib@openssh.com (or zlib) when the data compresses well and the link is slow, none otherwise
+ */
+
+typedef struct _php_ssh2_comp_host {
+	/* Estimated compressed/raw ratio and payload bytes per second, 0 when unknown */
+	double ratio[2];
+	double rate[2];
+	long sessions;
+} php_ssh2_comp_host;
+
+static char *php_ssh2_comp_names[2] = { "client_to_server", "server_to_client" };
+
+/* {{{ php_ssh2_comp_clock
+ * Milliseconds on a monotonic clock where there is one, taken before a read or write to time it
+ * Only differences between two readings mean anything, the wall clock is the last resort
+ */
+double php_ssh2_comp_clock(void)
+{
+#if defined(PHP_WIN32)
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart * 1000.0 / frequency.QuadPart;
+#elif defined(PHP_SSH2_MONOTONIC_CLOCK)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
+/* }}} */
+
+/* ************
+   * Sampling *
+   ************ */
+
+/* {{{ php_ssh2_comp_entropy
+ * Order-0 Shannon entropy in bits per byte, only an estimate of what deflate gets out of the data:
+ * repeated strings let deflate beat it, while short or evenly mixed input does worse
+ */
+static double php_ssh2_comp_entropy(const unsigned char *buf, size_t len)
+{
+	unsigned int counts[256];
+	double bits = 0.0;
+	size_t i;
+
+	memset(counts, 0, sizeof(counts));
+	for(i = 0; i < len; i++) {
+		counts[buf[i]]++;
+	}
+
+	for(i = 0; i < 256; i++) {
+		if (counts[i]) {
+			double p = (double)counts[i] / len;
+
+			bits -= p * log(p);
+		}
+	}
+
+	return bits / log(2.0);
+}
+/* }}} */
+
+#ifdef PHP_SSH2_ZLIB
+/* {{{ php_ssh2_comp_deflated
+ * Bits the fastest raw deflate needs for a sample, -1 when zlib can't be set up
+ * A 4KB window covers the whole sample and keeps the state small enough to set up per call
+ */
+static double php_ssh2_comp_deflated(const unsigned char *buf, size_t len)
+{
+	unsigned char out[PHP_SSH2_COMP_SAMPLE + 64];
+	z_stream zs;
+	int status;
+	double bits;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -12, 5, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1.0;
+	}
+	zs.next_in = (Bytef*)buf;
+	zs.avail_in = (uInt)len;
+	zs.next_out = out;
+	zs.avail_out = sizeof(out);
+
+	status = deflate(&zs, Z_FINISH);
+	/* Not fitting the buffer means it doesn't compress at all */
+	bits = status == Z_STREAM_END ? zs.total_out * 8.0 : len * 8.0;
+	deflateEnd(&zs);
+
+	return bits;
+}
+/* }}} */
+#endif
+
+/* {{{ php_ssh2_comp_sample
+ * Account for len bytes of payload moved in direction since started (php_ssh2_comp_clock())
+ */
+void php_ssh2_comp_sample(LIBSSH2_SESSION *session, int direction, const char *buf, ssize_t len, double started)
+{
+	php_ssh2_session_data *data;
+
+	if (!session || len <= 0) {
+		return;
+	}
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	if (!data) {
+		return;
+	}
+
+	data->payload[direction] += len;
+	data->busy[direction] += php_ssh2_comp_clock() - started;
+
+	if (data->sampled[direction] < PHP_SSH2_COMP_SAMPLE_MAX) {
+		size_t n = len > PHP_SSH2_COMP_SAMPLE ? PHP_SSH2_COMP_SAMPLE : (size_t)len;
+		double bits = -1.0;
+
+#ifdef PHP_SSH2_ZLIB
+		bits = php_ssh2_comp_deflated((const unsigned char*)buf, n);
+#endif
+		if (bits < 0.0) {
+			bits = php_ssh2_comp_entropy((const unsigned char*)buf, n) * n;
+		}
+		data->sampled_bits[direction] += bits;
+		data->sampled[direction] += n;
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_comp_ratio
+ * Estimated compressed/raw ratio of what a session sampled, 0 when it sampled too little to tell
+ */
+static double php_ssh2_comp_ratio(php_ssh2_session_data *data, int direction)
+{
+	if (data->sampled[direction] < PHP_SSH2_COMP_SAMPLE) {
+		return 0.0;
+	}
+
+	return data->sampled_bits[direction] / data->sampled[direction] / 8.0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_comp_rate
+ * Payload bytes per second while reading or writing, 0 when nothing was timed
+ */
+static double php_ssh2_comp_rate(php_ssh2_session_data *data, int direction)
+{
+	if (data->busy[direction] <= 0.0 || data->sampled[direction] < PHP_SSH2_COMP_SAMPLE) {
+		return 0.0;
+	}
+
+	return data->payload[direction] * 1000.0 / data->busy[direction];
+}
+/* }}} */
+
+/* {{{ php_ssh2_comp_worth
+ * Compressible enough to pay for itself and not on a link so fast that deflate becomes the bottleneck
+ */
+static int php_ssh2_comp_worth(double ratio, double rate TSRMLS_DC)
+{
+	if (ratio <= 0.0 || ratio > SSH2_G(compression_threshold)) {
+		return 0;
+	}
+	if (rate > 0.0 && SSH2_G(compression_max_rate) > 0 && rate >= SSH2_G(compression_max_rate)) {
+		return 0;
+	}
+
+	return 1;
+}
+/* }}} */
+
+/* *******************
+   * Per Host Memory *
+   ******************* */
+
+/* {{{ php_ssh2_comp_key
+ */
+static int php_ssh2_comp_key(char *key, int key_size, char *host, int port)
+{
+	return snprintf(key, key_size, "%s:%d", host, port) + 1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_comp_learn
+ * Fold what a finished session sampled into its host's averages
+ */
+void php_ssh2_comp_learn(php_ssh2_session_data *data TSRMLS_DC)
+{
+	HashTable *hosts = &SSH2_G(comp_hosts);
+	php_ssh2_comp_host *entry, fresh;
+	char key[1024];
+	int key_len, i;
+
+	if (!data->host || (data->sampled[PHP_SSH2_COMP_CS] < PHP_SSH2_COMP_SAMPLE && data->sampled[PHP_SSH2_COMP_SC] < PHP_SSH2_COMP_SAMPLE)) {
+		return;
+	}
+
+	key_len = php_ssh2_comp_key(key, sizeof(key), data->host, data->port);
+	if (zend_hash_find(hosts, key, key_len, (void**)&entry) == FAILURE) {
+		if (zend_hash_num_elements(hosts) >= PHP_SSH2_COMP_CACHE_SIZE) {
+			/* Only a hint, cheaper to start over than to track age */
+			zend_hash_clean(hosts);
+		}
+		memset(&fresh, 0, sizeof(fresh));
+		if (zend_hash_add(hosts, key, key_len, &fresh, sizeof(fresh), (void**)&entry) == FAILURE) {
+			return;
+		}
+	}
+
+	for(i = PHP_SSH2_COMP_CS; i <= PHP_SSH2_COMP_SC; i++) {
+		double ratio = php_ssh2_comp_ratio(data, i), rate = php_ssh2_comp_rate(data, i);
+
+		/* Smoothed so one odd transfer doesn't flip the decision */
+		if (ratio > 0.0) {
+			entry->ratio[i] = entry->ratio[i] > 0.0 ? entry->ratio[i] * 0.7 + ratio * 0.3 : ratio;
+		}
+		if (rate > 0.0) {
+			entry->rate[i] = entry->rate[i] > 0.0 ? entry->rate[i] * 0.7 + rate * 0.3 : rate;
+		}
+	}
+	entry->sessions++;
+}
+/* }}} */
+
+/* {{{ php_ssh2_comp_auto
+ * Resolve 'auto' comp methods from what earlier sessions to the same host:port have seen
+ */
+void php_ssh2_comp_auto(LIBSSH2_SESSION *session, zval *methods TSRMLS_DC)
+{
+	static int method_types[2] = { LIBSSH2_METHOD_COMP_CS, LIBSSH2_METHOD_COMP_SC };
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	php_ssh2_comp_host *entry = NULL;
+	int i;
+
+	if (!methods || Z_TYPE_P(methods) != IS_ARRAY) {
+		return;
+	}
+
+	if (data->host) {
+		char key[1024];
+		int key_len = php_ssh2_comp_key(key, sizeof(key), data->host, data->port);
+
+		if (zend_hash_find(&SSH2_G(comp_hosts), key, key_len, (void**)&entry) == FAILURE) {
+			entry = NULL;
+		}
+	}
+
+	for(i = PHP_SSH2_COMP_CS; i <= PHP_SSH2_COMP_SC; i++) {
+		zval **container, **value;
+
+		if (zend_hash_find(Z_ARRVAL_P(methods), php_ssh2_comp_names[i], strlen(php_ssh2_comp_names[i]) + 1, (void**)&container) == FAILURE ||
+			!container || !*container || Z_TYPE_PP(container) != IS_ARRAY ||
+			zend_hash_find(Z_ARRVAL_PP(container), "comp", sizeof("comp"), (void**)&value) == FAILURE ||
+			!value || !*value || Z_TYPE_PP(value) != IS_STRING || strcmp(Z_STRVAL_PP(value), "auto")) {
+			continue;
+		}
+
+		/* Hosts we know nothing about yet stay uncompressed while we learn */
+		if (entry && php_ssh2_comp_worth(entry->ratio[i], entry->rate[i] TSRMLS_CC)) {
+#ifdef LIBSSH2_FLAG_COMPRESS
+			libssh2_session_flag(session, LIBSSH2_FLAG_COMPRESS, 1);
+#endif
+			if (libssh2_session_method_pref(session, method_types[i], "zlib@openssh.com,zlib,none") == 0) {
+				continue;
+			}
+		}
+		libssh2_session_method_pref(session, method_types[i], "none");
+	}
+}
+/* }}} */
+
+/* *************
+   * Reporting *
+   ************* */
+
+/* {{{ php_ssh2_comp_direction
+ */
+static zval *php_ssh2_comp_direction(double ratio, double rate, php_ssh2_uint64 raw, const char *method TSRMLS_DC)
+{
+	zval *entry;
+
+	MAKE_STD_ZVAL(entry);
+	array_init(entry);
+	if (method) {
+		add_assoc_string(entry, "method", (char*)method, 1);
+	}
+	if (raw) {
+		php_ssh2_add_assoc_counter(entry, "raw_bytes", raw);
+	}
+	add_assoc_double(entry, "estimated_ratio", ratio);
+	add_assoc_double(entry, "rate", rate);
+	add_assoc_string(entry, "recommended", php_ssh2_comp_worth(ratio, rate TSRMLS_CC) ? "zlib@openssh.com" : "none", 1);
+
+	return entry;
+}
+/* }}} */
+
+/* {{{ proto array ssh2_compression_stats([resource session])
+Compressibility and throughput per direction for a session, or what was learned per host:port */
+PHP_FUNCTION(ssh2_compression_stats)
+{
+	static int method_types[2] = { LIBSSH2_METHOD_COMP_CS, LIBSSH2_METHOD_COMP_SC };
+	zval *zsession = NULL;
+	LIBSSH2_SESSION *session = NULL;
+	int i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|r", &zsession) == FAILURE) {
+		return;
+	}
+
+	if (zsession) {
+		/* Before return_value becomes an array, a wrong resource returns false */
+		ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	}
+
+	array_init(return_value);
+
+	if (session) {
+		php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+		for(i = PHP_SSH2_COMP_CS; i <= PHP_SSH2_COMP_SC; i++) {
+			const char *method = SSH2_SESSION_PENDING(session) ? NULL : libssh2_session_methods(session, method_types[i]);
+
+			add_assoc_zval(return_value, php_ssh2_comp_names[i],
+				php_ssh2_comp_direction(php_ssh2_comp_ratio(data, i), php_ssh2_comp_rate(data, i), data->payload[i], method TSRMLS_CC));
+		}
+#ifdef PHP_SSH2_TRAFFIC_COUNTERS
+		/* Compressed, encrypted and framed, compare with raw_bytes */
+		php_ssh2_add_assoc_counter(return_value, "wire_bytes_sent", data->bytes_sent);
+		php_ssh2_add_assoc_counter(return_value, "wire_bytes_received", data->bytes_received);
+#endif
+	} else {
+		HashTable *hosts = &SSH2_G(comp_hosts);
+		HashPosition pos;
+		php_ssh2_comp_host *entry;
+		char *key;
+		uint key_len;
+		ulong index;
+
+		for(zend_hash_internal_pointer_reset_ex(hosts, &pos);
+			zend_hash_get_current_data_ex(hosts, (void**)&entry, &pos) == SUCCESS;
+			zend_hash_move_forward_ex(hosts, &pos)) {
+			zval *zhost;
+
+			if (zend_hash_get_current_key_ex(hosts, &key, &key_len, &index, 0, &pos) != HASH_KEY_IS_STRING) {
+				continue;
+			}
+
+			MAKE_STD_ZVAL(zhost);
+			array_init(zhost);
+			for(i = PHP_SSH2_COMP_CS; i <= PHP_SSH2_COMP_SC; i++) {
+				add_assoc_zval(zhost, php_ssh2_comp_names[i], php_ssh2_comp_direction(entry->ratio[i], entry->rate[i], 0, NULL TSRMLS_CC));
+			}
+			add_assoc_long(zhost, "sessions", entry->sessions);
+			add_assoc_zval_ex(return_value, key, key_len, zhost);
+		}
+	}
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -34,23 +34,23 @@ static size_t php_ssh2_channel_stream_write(php_stream *stream, const char *buf,
 	php_ssh2_channel_data *abstract = (php_ssh2_channel_data*)stream->abstract;
 	size_t writestate;
 	LIBSSH2_SESSION *session;
+	double started;
 
 	libssh2_channel_set_blocking(abstract->channel, abstract->is_blocking);
 	session = (LIBSSH2_SESSION *)zend_fetch_resource(NULL TSRMLS_CC, abstract->session_rsrc, PHP_SSH2_SESSION_RES_NAME, NULL, 1, le_ssh2_session);
 
-#ifdef PHP_SSH2_SESSION_TIMEOUT
 	if (abstract->is_blocking) {
-		libssh2_session_set_timeout(session, abstract->timeout);
+		php_ssh2_session_timeout_ms(session, abstract->timeout);
 	}
-#endif
 
+	started = php_ssh2_comp_clock();
 	writestate = libssh2_channel_write_ex(abstract->channel, abstract->streamid, buf, count);
+	php_ssh2_comp_sample(session, PHP_SSH2_COMP_CS, buf, writestate, started);
+	php_ssh2_stats_io(session, PHP_SSH2_COMP_CS, writestate, started);
 
-#ifdef PHP_SSH2_SESSION_TIMEOUT
 	if (abstract->is_blocking) {
-		libssh2_session_set_timeout(session, 0);
+		php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_OPERATION);
 	}
-#endif
 	if (writestate == LIBSSH2_ERROR_EAGAIN) {
 		writestate = 0;
 	}
@@ -64,6 +64,7 @@ static size_t php_ssh2_channel_stream_write(php_stream *stream, const char *buf,
 		stream->eof = 1;
 		writestate = 0;
 	}
+	abstract->bytes_written += writestate;
 
 	return writestate;
 }
@@ -73,24 +74,29 @@ static size_t php_ssh2_channel_stream_read(php_stream *stream, char *buf, size_t
 	php_ssh2_channel_data *abstract = (php_ssh2_channel_data*)stream->abstract;
 	ssize_t readstate;
 	LIBSSH2_SESSION *session;
+	double started;
 
 	stream->eof = libssh2_channel_eof(abstract->channel);
 	libssh2_channel_set_blocking(abstract->channel, abstract->is_blocking);
 	session = (LIBSSH2_SESSION *)zend_fetch_resource(NULL TSRMLS_CC, abstract->session_rsrc, PHP_SSH2_SESSION_RES_NAME, NULL, 1, le_ssh2_session);
 
-#ifdef PHP_SSH2_SESSION_TIMEOUT
+	/* Long quiet reads are where NAT tables forget about us */
+	if (session) {
+		php_ssh2_keepalive(session);
+	}
+
 	if (abstract->is_blocking) {
-		libssh2_session_set_timeout(session, abstract->timeout);
+		php_ssh2_session_timeout_ms(session, abstract->timeout);
 	}
-#endif
 
+	started = php_ssh2_comp_clock();
 	readstate = libssh2_channel_read_ex(abstract->channel, abstract->streamid, buf, count);
+	php_ssh2_comp_sample(session, PHP_SSH2_COMP_SC, buf, readstate, started);
+	php_ssh2_stats_io(session, PHP_SSH2_COMP_SC, readstate, started);
 
-#ifdef PHP_SSH2_SESSION_TIMEOUT
 	if (abstract->is_blocking) {
-		libssh2_session_set_timeout(session, 0);
+		php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_OPERATION);
 	}
-#endif
 	if (readstate == LIBSSH2_ERROR_EAGAIN) {
 		readstate = 0;
 	}
@@ -104,6 +110,8 @@ static size_t php_ssh2_channel_stream_read(php_stream *stream, char *buf, size_t
 		stream->eof = 1;
 		readstate = 0;
 	}
+	abstract->bytes_read += readstate;
+
 	return readstate;
 }
 
@@ -116,8 +124,14 @@ static int php_ssh2_channel_stream_close(php_stream *stream, int close_handle TS
 		if (abstract->refcount) {
 			efree(abstract->refcount);
 		}
+		LIBSSH2_SESSION *session;
+		int type;
+
+		if (!(session = (LIBSSH2_SESSION*)zend_list_find(abstract->session_rsrc, &type)) || type != le_ssh2_session) {
+			session = NULL;
+		}
 		libssh2_channel_eof(abstract->channel);
-		libssh2_channel_free(abstract->channel);
+		php_ssh2_channel_free(session, abstract->channel);
 		zend_list_delete(abstract->session_rsrc);
 	}
 	efree(abstract);
@@ -146,6 +160,11 @@ static int php_ssh2_channel_stream_set_option(php_stream *stream, int option, in
 
 		case PHP_STREAM_OPTION_META_DATA_API:
 			add_assoc_long((zval*)ptrparam, "exit_status", libssh2_channel_get_exit_status(abstract->channel));
+			php_ssh2_add_assoc_counter((zval*)ptrparam, "bytes_read", abstract->bytes_read);
+			php_ssh2_add_assoc_counter((zval*)ptrparam, "bytes_written", abstract->bytes_written);
+			add_assoc_long((zval*)ptrparam, "stream_buffer", (long)(stream->writepos - stream->readpos));
+			php_ssh2_channel_meta((zval*)ptrparam, abstract->channel);
+			php_ssh2_session_meta((zval*)ptrparam, abstract->session_rsrc TSRMLS_CC);
 			break;
 
 		case PHP_STREAM_OPTION_READ_TIMEOUT:
@@ -185,6 +204,127 @@ php_stream_ops php_ssh2_channel_stream_ops = {
    * Magic Path Helper *
    ********************* */
 
+/* Connections made for URLs carrying their own credentials are kept until the end of the request,
+ * SSH2_G(wrapper_cache) maps scheme, host, port, username, methods and a digest of the credentials
+ * to a reference on the session (or the SFTP resource which holds the session)
+ */
+typedef struct _php_ssh2_wrapper_conn {
+	int session_rsrcid;
+	int sftp_rsrcid;
+} php_ssh2_wrapper_conn;
+
+/* {{{ php_ssh2_wrapper_cache_dtor
+ */
+void php_ssh2_wrapper_cache_dtor(void *pDest)
+{
+	php_ssh2_wrapper_conn *conn = (php_ssh2_wrapper_conn*)pDest;
+
+	zend_list_delete(conn->sftp_rsrcid ? conn->sftp_rsrcid : conn->session_rsrcid);
+}
+/* }}} */
+
+/* {{{ php_ssh2_wrapper_cache_key
+ */
+static void php_ssh2_wrapper_cache_key(smart_str *key, char *type, char *host, int port, char *username, int username_len, zval *methods,
+										char *password, int password_len, char *pubkey_file, char *privkey_file TSRMLS_DC)
+{
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	smart_str credential = {0};
+
+	if (password) {
+		smart_str_appendl(&credential, password, password_len);
+	}
+	smart_str_appendc(&credential, '\0');
+	if (pubkey_file) {
+		smart_str_appends(&credential, pubkey_file);
+	}
+	smart_str_appendc(&credential, '\0');
+	if (privkey_file) {
+		smart_str_appends(&credential, privkey_file);
+	}
+	php_ssh2_auth_ident(ident, username, username_len, "wrapper", credential.c, credential.len);
+	smart_str_free(&credential);
+
+	smart_str_appends(key, type);
+	smart_str_appendc(key, '|');
+	php_ssh2_pool_key(key, host, port, username, username_len, methods TSRMLS_CC);
+	smart_str_appendc(key, '|');
+	smart_str_appendl(key, ident, PHP_SSH2_AUTH_IDENT_LEN);
+	smart_str_0(key);
+}
+/* }}} */
+
+/* {{{ php_ssh2_wrapper_cache_find
+ * Hand out another reference on a cached connection, dropping entries whose resources were closed meanwhile
+ */
+static int php_ssh2_wrapper_cache_find(smart_str *key, LIBSSH2_SESSION **psession, int *presource_id,
+										LIBSSH2_SFTP **psftp, int *psftp_rsrcid TSRMLS_DC)
+{
+	php_ssh2_wrapper_conn *conn;
+	LIBSSH2_SESSION *session;
+	int type;
+
+	if (zend_hash_find(&SSH2_G(wrapper_cache), key->c, key->len + 1, (void**)&conn) == FAILURE) {
+		return FAILURE;
+	}
+
+	session = (LIBSSH2_SESSION*)zend_list_find(conn->session_rsrcid, &type);
+	if (!session || type != le_ssh2_session) {
+		zend_hash_del(&SSH2_G(wrapper_cache), key->c, key->len + 1);
+		return FAILURE;
+	}
+	if (psftp) {
+		php_ssh2_sftp_data *sftp_data = (php_ssh2_sftp_data*)zend_list_find(conn->sftp_rsrcid, &type);
+
+		if (!sftp_data || type != le_ssh2_sftp) {
+			zend_hash_del(&SSH2_G(wrapper_cache), key->c, key->len + 1);
+			return FAILURE;
+		}
+		zend_list_addref(conn->sftp_rsrcid);
+		*psftp_rsrcid = conn->sftp_rsrcid;
+		*psftp = sftp_data->sftp;
+	} else {
+		zend_list_addref(conn->session_rsrcid);
+	}
+	*presource_id = conn->session_rsrcid;
+	*psession = session;
+	SSH2_G(wrapper_cache_hits)++;
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ php_ssh2_wrapper_cache_add
+ */
+static void php_ssh2_wrapper_cache_add(smart_str *key, int session_rsrcid, int sftp_rsrcid TSRMLS_DC)
+{
+	php_ssh2_wrapper_conn conn;
+
+	conn.session_rsrcid = session_rsrcid;
+	conn.sftp_rsrcid = sftp_rsrcid;
+	zend_list_addref(sftp_rsrcid ? sftp_rsrcid : session_rsrcid);
+	zend_hash_update(&SSH2_G(wrapper_cache), key->c, key->len + 1, &conn, sizeof(php_ssh2_wrapper_conn), NULL);
+}
+/* }}} */
+
+/* {{{ php_ssh2_wrapper_context_flag
+ */
+static int php_ssh2_wrapper_context_flag(php_stream_context *context, char *name, int def)
+{
+	zval **tmpzval;
+
+	if (context && php_stream_context_get_option(context, "ssh2", name, &tmpzval) == SUCCESS && tmpzval && *tmpzval) {
+		zval tmp = **tmpzval;
+
+		zval_copy_ctor(&tmp);
+		convert_to_boolean(&tmp);
+		return Z_BVAL(tmp);
+	}
+
+	return def;
+}
+/* }}} */
+
 /* {{{ php_ssh2_fopen_wraper_parse_path
  * Parse an ssh2.*:// path
  */
@@ -193,13 +333,17 @@ php_url *php_ssh2_fopen_wraper_parse_path(	char *path, char *type, php_stream_co
 											LIBSSH2_SFTP **psftp, int *psftp_rsrcid
 											TSRMLS_DC)
 {
-	php_ssh2_sftp_data *sftp_data = NULL;
 	LIBSSH2_SESSION *session;
 	php_url *resource;
-	zval *methods = NULL, *callbacks = NULL, zsession, **tmpzval;
+	zval *methods = NULL, *callbacks = NULL, *merged_methods = NULL, zsession, **tmpzval;
+	static char *context_methods[] = { "socket", "timeouts", "keepalive", "retire", "memory" };
 	long resource_id;
 	char *s, *username = NULL, *password = NULL, *pubkey_file = NULL, *privkey_file = NULL;
-	int username_len = 0, password_len = 0;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	int username_len = 0, password_len = 0, i, reuse, persistent;
+	smart_str cache_key = {0};
+	double started;
+	int rc;
 
 	resource = php_url_parse(path);
 	if (!resource || !resource->path) {
@@ -251,21 +395,22 @@ php_url *php_ssh2_fopen_wraper_parse_path(	char *path, char *type, php_stream_co
 			}
 		}
 		session = (LIBSSH2_SESSION *)zend_fetch_resource(NULL TSRMLS_CC, resource_id, PHP_SSH2_SESSION_RES_NAME, NULL, 1, le_ssh2_session);
+		if (session && SSH2_SESSION_LOCKED(session)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not authenticated");
+			php_url_free(resource);
+			return NULL;
+		}
 		if (session) {
 			if (psftp) {
-				/* We need an sftp layer too */
-				LIBSSH2_SFTP *sftp = libssh2_sftp_init(session);
+				/* We need an sftp layer too, the session keeps one around for that */
+				LIBSSH2_SFTP *sftp = php_ssh2_session_sftp(session);
 
 				if (!sftp) {
 					php_url_free(resource);
 					return NULL;
 				}
-				sftp_data = emalloc(sizeof(php_ssh2_sftp_data));
-				sftp_data->sftp = sftp;
-				sftp_data->session = session;
-				sftp_data->session_rsrcid = resource_id;
 				zend_list_addref(resource_id);
-				*psftp_rsrcid = ZEND_REGISTER_RESOURCE(NULL, sftp_data, le_ssh2_sftp);
+				*psftp_rsrcid = php_ssh2_sftp_register_shared(session, resource_id TSRMLS_CC);
 				*psftp = sftp;
 				*presource_id = resource_id;
 				*psession = session;
@@ -297,22 +442,22 @@ php_url *php_ssh2_fopen_wraper_parse_path(	char *path, char *type, php_stream_co
 		php_stream_context_get_option(context, "ssh2", "session", &tmpzval) == SUCCESS &&
 		Z_TYPE_PP(tmpzval) == IS_RESOURCE) {
 		session = (LIBSSH2_SESSION *)zend_fetch_resource(tmpzval TSRMLS_CC, -1, PHP_SSH2_SESSION_RES_NAME, NULL, 1, le_ssh2_session);
+		if (session && SSH2_SESSION_LOCKED(session)) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not authenticated");
+			php_url_free(resource);
+			return NULL;
+		}
 		if (session) {
 			if (psftp) {
 				/* We need an SFTP layer too! */
-				LIBSSH2_SFTP *sftp = libssh2_sftp_init(session);
-				php_ssh2_sftp_data *sftp_data;
+				LIBSSH2_SFTP *sftp = php_ssh2_session_sftp(session);
 
 				if (!sftp) {
 					php_url_free(resource);
 					return NULL;
 				}
-				sftp_data = emalloc(sizeof(php_ssh2_sftp_data));
-				sftp_data->sftp = sftp;
-				sftp_data->session = session;
-				sftp_data->session_rsrcid = Z_LVAL_PP(tmpzval);
 				zend_list_addref(Z_LVAL_PP(tmpzval));
-				*psftp_rsrcid = ZEND_REGISTER_RESOURCE(NULL, sftp_data, le_ssh2_sftp);
+				*psftp_rsrcid = php_ssh2_sftp_register_shared(session, Z_LVAL_PP(tmpzval) TSRMLS_CC);
 				*psftp = sftp;
 				*presource_id = Z_LVAL_PP(tmpzval);
 				*psession = session;
@@ -392,65 +537,157 @@ php_url *php_ssh2_fopen_wraper_parse_path(	char *path, char *type, php_stream_co
 		return NULL;
 	}
 
-	session = php_ssh2_session_connect(resource->host, resource->port, methods, callbacks TSRMLS_CC);
+	/* Socket tuning, timeouts, keepalive and retirement limits may be given on their own, they end up in methods[] under
+	 * the same name unless methods has those already */
+	for(i = 0; i < sizeof(context_methods) / sizeof(context_methods[0]); i++) {
+		char *name = context_methods[i];
+
+		if (context &&
+			php_stream_context_get_option(context, "ssh2", name, &tmpzval) == SUCCESS &&
+			Z_TYPE_PP(tmpzval) == IS_ARRAY &&
+			(!methods || !zend_hash_exists(Z_ARRVAL_P(methods), name, strlen(name) + 1))) {
+			zval *tmp;
+
+			if (!merged_methods) {
+				MAKE_STD_ZVAL(merged_methods);
+				array_init(merged_methods);
+				if (methods) {
+					zend_hash_copy(Z_ARRVAL_P(merged_methods), Z_ARRVAL_P(methods), (copy_ctor_func_t) zval_add_ref, (void*)&tmp, sizeof(zval*));
+				}
+				methods = merged_methods;
+			}
+			zval_add_ref(tmpzval);
+			add_assoc_zval(merged_methods, name, *tmpzval);
+		}
+	}
+
+	/* Userspace callbacks belong to the context they came with, such connections are never shared */
+	reuse = !callbacks && php_ssh2_wrapper_context_flag(context, "reuse", 1);
+	persistent = php_ssh2_wrapper_context_flag(context, "persistent", 0);
+
+	if (reuse) {
+		php_ssh2_wrapper_cache_key(&cache_key, type, resource->host, resource->port, username, username_len, methods,
+									password, password_len, pubkey_file, privkey_file TSRMLS_CC);
+		if (php_ssh2_wrapper_cache_find(&cache_key, psession, presource_id, psftp, psftp_rsrcid TSRMLS_CC) == SUCCESS) {
+			smart_str_free(&cache_key);
+			if (merged_methods) {
+				zval_ptr_dtor(&merged_methods);
+			}
+			return resource;
+		}
+	}
+
+	session = NULL;
+	if (persistent) {
+		smart_str pool_key = {0};
+
+		php_ssh2_pool_key(&pool_key, resource->host, resource->port, username, username_len, methods TSRMLS_CC);
+		session = php_ssh2_pool_checkout(pool_key.c, pool_key.len TSRMLS_CC);
+		if (session) {
+			php_ssh2_session_reconfigure(session, methods TSRMLS_CC);
+			/* Pooled sessions can't authenticate again, only take one that already is what we'd become,
+			 * key files have to pass open_basedir and be readable for that */
+			if (pubkey_file && privkey_file &&
+				php_ssh2_auth_ident_keyfile(ident, username, username_len, "publickey", pubkey_file, privkey_file, password TSRMLS_CC) == SUCCESS) {
+				if (php_ssh2_session_auth_matches(session, ident)) {
+					php_ssh2_session_auth_remember(session, ident);
+					goto session_pooled;
+				}
+			}
+			if (password) {
+				php_ssh2_auth_ident(ident, username, username_len, "password", password, password_len);
+				if (php_ssh2_session_auth_matches(session, ident)) {
+					php_ssh2_session_auth_remember(session, ident);
+					goto session_pooled;
+				}
+			}
+			if (php_ssh2_pool_release(session TSRMLS_CC) == FAILURE) {
+				php_ssh2_session_destroy(session TSRMLS_CC);
+			}
+			session = NULL;
+		}
+		if (!session) {
+			session = php_ssh2_session_connect_ex(resource->host, resource->port, methods, callbacks, 1 TSRMLS_CC);
+			if (session) {
+				php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+				data->pool_key = pestrndup(pool_key.c, pool_key.len, 1);
+				data->pool_key_len = pool_key.len;
+			}
+		}
+session_pooled:
+		smart_str_free(&pool_key);
+	} else {
+		session = php_ssh2_session_connect(resource->host, resource->port, methods, callbacks TSRMLS_CC);
+	}
+	if (merged_methods) {
+		zval_ptr_dtor(&merged_methods);
+	}
 	if (!session) {
 		/* Unable to connect! */
+		smart_str_free(&cache_key);
 		php_url_free(resource);
 		return NULL;
 	}
+	if (libssh2_userauth_authenticated(session)) {
+		goto session_authed;
+	}
 
 	/* Authenticate */
 	if (pubkey_file && privkey_file) {
-		if (SSH2_OPENBASEDIR_CHECKPATH(pubkey_file) || SSH2_OPENBASEDIR_CHECKPATH(privkey_file)) {
-			php_url_free(resource);
-			return NULL;
-		}
-
-		/* Attempt pubkey authentication */
-		if (!libssh2_userauth_publickey_fromfile(session, username, pubkey_file, privkey_file, password)) {
+		/* Attempt pubkey authentication, open_basedir is checked on the way */
+		if (!php_ssh2_userauth_publickey(session, username, username_len, pubkey_file, privkey_file, password TSRMLS_CC)) {
+			php_ssh2_auth_ident_keyfile(ident, username, username_len, "publickey", pubkey_file, privkey_file, password TSRMLS_CC);
+			php_ssh2_session_auth_remember(session, ident);
 			goto session_authed;
 		}
 	}
 
 	if (password) {
 		/* Attempt password authentication */
-		if (libssh2_userauth_password_ex(session, username, username_len, password, password_len, NULL) == 0) {
+		started = php_ssh2_comp_clock();
+		rc = libssh2_userauth_password_ex(session, username, username_len, password, password_len, NULL);
+		php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + PHP_SSH2_AUTH_PASSWORD, started TSRMLS_CC);
+		if (rc == 0) {
+			php_ssh2_auth_ident(ident, username, username_len, "password", password, password_len);
+			php_ssh2_session_auth_remember(session, ident);
 			goto session_authed;
 		}
 	}
 
 	/* Auth failure */
+	php_ssh2_session_destroy(session TSRMLS_CC);
+	smart_str_free(&cache_key);
 	php_url_free(resource);
-	zend_list_delete(Z_LVAL(zsession));
 	return NULL;
 
 session_authed:
+	php_ssh2_session_timeout(session, PHP_SSH2_TIMEOUT_OPERATION);
 	ZEND_REGISTER_RESOURCE(&zsession, session, le_ssh2_session);
 
 	if (psftp) {
 		LIBSSH2_SFTP *sftp;
-		zval zsftp;
 
-		sftp = libssh2_sftp_init(session);
+		sftp = php_ssh2_session_sftp(session);
 		if (!sftp) {
+			smart_str_free(&cache_key);
 			php_url_free(resource);
 			zend_list_delete(Z_LVAL(zsession));
 			return NULL;
 		}
 
-		sftp_data = emalloc(sizeof(php_ssh2_sftp_data));
-		sftp_data->session = session;
-		sftp_data->sftp = sftp;
-		sftp_data->session_rsrcid = Z_LVAL(zsession);
-
-		ZEND_REGISTER_RESOURCE(&zsftp, sftp_data, le_ssh2_sftp);
-		*psftp_rsrcid = Z_LVAL(zsftp);
+		*psftp_rsrcid = php_ssh2_sftp_register_shared(session, Z_LVAL(zsession) TSRMLS_CC);
 		*psftp = sftp;
 	}
 
 	*presource_id = Z_LVAL(zsession);
 	*psession = session;
 
+	if (reuse) {
+		php_ssh2_wrapper_cache_add(&cache_key, Z_LVAL(zsession), psftp ? *psftp_rsrcid : 0 TSRMLS_CC);
+		smart_str_free(&cache_key);
+	}
+
 	return resource;
 }
 /* }}} */
@@ -467,10 +704,13 @@ static php_stream *php_ssh2_shell_open(LIBSSH2_SESSION *session, int resource_id
 	LIBSSH2_CHANNEL *channel;
 	php_ssh2_channel_data *channel_data;
 	php_stream *stream;
+	double started;
 
 	libssh2_session_set_blocking(session, 1);
 
+	started = php_ssh2_comp_clock();
 	channel = libssh2_channel_open_session(session);
+	php_ssh2_stats_channel_open(session, PHP_SSH2_CHANNEL_SHELL, channel, started);
 	if (!channel) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to request a channel from remote host");
 		return NULL;
@@ -506,25 +746,25 @@ static php_stream *php_ssh2_shell_open(LIBSSH2_SESSION *session, int resource_id
 	if (type == PHP_SSH2_TERM_UNIT_CHARS) {
 		if (libssh2_channel_request_pty_ex(channel, term, term_len, NULL, 0, width, height, 0, 0)) {
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed allocating %s pty at %ldx%ld characters", term, width, height);
-			libssh2_channel_free(channel);
+			php_ssh2_channel_free(session, channel);
 			return NULL;
 		}
 	} else {
 		if (libssh2_channel_request_pty_ex(channel, term, term_len, NULL, 0, 0, 0, width, height)) {
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed allocating %s pty at %ldx%ld pixels", term, width, height);
-			libssh2_channel_free(channel);
+			php_ssh2_channel_free(session, channel);
 			return NULL;
 		}
 	}
 
 	if (libssh2_channel_shell(channel)) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to request shell from remote host");
-		libssh2_channel_free(channel);
+		php_ssh2_channel_free(session, channel);
 		return NULL;
 	}
 
 	/* Turn it into a stream */
-	channel_data = emalloc(sizeof(php_ssh2_channel_data));
+	channel_data = ecalloc(1, sizeof(php_ssh2_channel_data));
 	channel_data->channel = channel;
 	channel_data->streamid = 0;
 	channel_data->is_blocking = 0;
@@ -713,10 +953,13 @@ static php_stream *php_ssh2_exec_command(LIBSSH2_SESSION *session, int resource_
 	LIBSSH2_CHANNEL *channel;
 	php_ssh2_channel_data *channel_data;
 	php_stream *stream;
+	double started;
 
 	libssh2_session_set_blocking(session, 1);
 
+	started = php_ssh2_comp_clock();
 	channel = libssh2_channel_open_session(session);
+	php_ssh2_stats_channel_open(session, PHP_SSH2_CHANNEL_EXEC, channel, started);
 	if (!channel) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to request a channel from remote host");
 		return NULL;
@@ -753,13 +996,13 @@ static php_stream *php_ssh2_exec_command(LIBSSH2_SESSION *session, int resource_
 		if (type == PHP_SSH2_TERM_UNIT_CHARS) {
 			if (libssh2_channel_request_pty_ex(channel, term, term_len, NULL, 0, width, height, 0, 0)) {
 				php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed allocating %s pty at %ldx%ld characters", term, width, height);
-				libssh2_channel_free(channel);
+				php_ssh2_channel_free(session, channel);
 				return NULL;
 			}
 		} else {
 			if (libssh2_channel_request_pty_ex(channel, term, term_len, NULL, 0, 0, 0, width, height)) {
 				php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed allocating %s pty at %ldx%ld pixels", term, width, height);
-				libssh2_channel_free(channel);
+				php_ssh2_channel_free(session, channel);
 				return NULL;
 			}
 		}
@@ -767,12 +1010,12 @@ static php_stream *php_ssh2_exec_command(LIBSSH2_SESSION *session, int resource_
 
 	if (libssh2_channel_exec(channel, command)) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to request command execution on remote host");
-		libssh2_channel_free(channel);
+		php_ssh2_channel_free(session, channel);
 		return NULL;
 	}
 
 	/* Turn it into a stream */
-	channel_data = emalloc(sizeof(php_ssh2_channel_data));
+	channel_data = ecalloc(1, sizeof(php_ssh2_channel_data));
 	channel_data->channel = channel;
 	channel_data->streamid = 0;
 	channel_data->is_blocking = 0;
@@ -951,8 +1194,10 @@ static php_stream *php_ssh2_scp_xfer(LIBSSH2_SESSION *session, int resource_id,
 	LIBSSH2_CHANNEL *channel;
 	php_ssh2_channel_data *channel_data;
 	php_stream *stream;
+	double started = php_ssh2_comp_clock();
 
 	channel = libssh2_scp_recv(session, filename, NULL);
+	php_ssh2_stats_channel_open(session, PHP_SSH2_CHANNEL_SCP, channel, started);
 	if (!channel) {
 		char *error = "";
 		libssh2_session_last_error(session, &error, NULL, 0);
@@ -961,7 +1206,7 @@ static php_stream *php_ssh2_scp_xfer(LIBSSH2_SESSION *session, int resource_id,
 	}
 
 	/* Turn it into a stream */
-	channel_data = emalloc(sizeof(php_ssh2_channel_data));
+	channel_data = ecalloc(1, sizeof(php_ssh2_channel_data));
 	channel_data->channel = channel;
 	channel_data->streamid = 0;
 	channel_data->is_blocking = 0;
@@ -1031,6 +1276,7 @@ PHP_FUNCTION(ssh2_scp_recv)
 {
 	LIBSSH2_SESSION *session;
 	LIBSSH2_CHANNEL *remote_file;
+	double open_started;
 	struct stat sb;
 	php_stream *local_file;
 	zval *zsession;
@@ -1044,7 +1290,9 @@ PHP_FUNCTION(ssh2_scp_recv)
 
 	SSH2_FETCH_AUTHENTICATED_SESSION(session, zsession);
 
+	open_started = php_ssh2_comp_clock();
 	remote_file = libssh2_scp_recv(session, remote_filename, &sb);
+	php_ssh2_stats_channel_open(session, PHP_SSH2_CHANNEL_SCP, remote_file, open_started);
 	if (!remote_file) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to receive remote file");
 		RETURN_FALSE;
@@ -1054,18 +1302,21 @@ PHP_FUNCTION(ssh2_scp_recv)
 	local_file = php_stream_open_wrapper(local_filename, "wb", ENFORCE_SAFE_MODE | REPORT_ERRORS, NULL);
 	if (!local_file) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to write to local file");
-		libssh2_channel_free(remote_file);
+		php_ssh2_channel_free(session, remote_file);
 		RETURN_FALSE;
 	}
 
 	while (sb.st_size) {
 		char buffer[8192];
 		int bytes_read;
+		double started = php_ssh2_comp_clock();
 
 		bytes_read = libssh2_channel_read(remote_file, buffer, sb.st_size > 8192 ? 8192 : sb.st_size);
+		php_ssh2_comp_sample(session, PHP_SSH2_COMP_SC, buffer, bytes_read, started);
+		php_ssh2_stats_io(session, PHP_SSH2_COMP_SC, bytes_read, started);
 		if (bytes_read < 0) {
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Error reading from remote file");
-			libssh2_channel_free(remote_file);
+			php_ssh2_channel_free(session, remote_file);
 			php_stream_close(local_file);
 			RETURN_FALSE;
 		}
@@ -1073,7 +1324,7 @@ PHP_FUNCTION(ssh2_scp_recv)
 		sb.st_size -= bytes_read;
 	}
 
-	libssh2_channel_free(remote_file);
+	php_ssh2_channel_free(session, remote_file);
 	php_stream_close(local_file);
 
 	RETURN_TRUE;
@@ -1087,6 +1338,7 @@ PHP_FUNCTION(ssh2_scp_send)
 {
 	LIBSSH2_SESSION *session;
 	LIBSSH2_CHANNEL *remote_file;
+	double open_started;
 	php_stream *local_file;
 	zval *zsession;
 	char *local_filename, *remote_filename;
@@ -1118,7 +1370,9 @@ PHP_FUNCTION(ssh2_scp_send)
 		create_mode = ssb.sb.st_mode & 0777;
 	}
 
+	open_started = php_ssh2_comp_clock();
 	remote_file = libssh2_scp_send_ex(session, remote_filename, create_mode, ssb.sb.st_size, ssb.sb.st_atime, ssb.sb.st_mtime);
+	php_ssh2_stats_channel_open(session, PHP_SSH2_CHANNEL_SCP, remote_file, open_started);
 	if (!remote_file) {
 		int last_error = 0;
 		char *error_msg = NULL;
@@ -1140,13 +1394,18 @@ PHP_FUNCTION(ssh2_scp_send)
 		if (bytesread <= 0 || bytesread > toread) {
 			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed copying file 2");
 			php_stream_close(local_file);
-			libssh2_channel_free(remote_file);
+			php_ssh2_channel_free(session, remote_file);
 			RETURN_FALSE;
 		}
 
 
 		while (bytesread - sent > 0) {
-			if ((justsent = libssh2_channel_write(remote_file, (buffer + sent), bytesread - sent)) < 0) {
+			double started = php_ssh2_comp_clock();
+
+			justsent = libssh2_channel_write(remote_file, (buffer + sent), bytesread - sent);
+			php_ssh2_comp_sample(session, PHP_SSH2_COMP_CS, buffer + sent, (ssize_t)justsent, started);
+			php_ssh2_stats_io(session, PHP_SSH2_COMP_CS, (ssize_t)justsent, started);
+			if (justsent < 0) {
 
 				switch (justsent) {
 					case LIBSSH2_ERROR_EAGAIN:
@@ -1171,7 +1430,7 @@ PHP_FUNCTION(ssh2_scp_send)
 				}
 
 				php_stream_close(local_file);
-				libssh2_channel_free(remote_file);
+				php_ssh2_channel_free(session, remote_file);
 				RETURN_FALSE;
 			}
 			sent = sent + justsent;
@@ -1181,7 +1440,7 @@ PHP_FUNCTION(ssh2_scp_send)
 
 	libssh2_channel_flush_ex(remote_file, LIBSSH2_CHANNEL_FLUSH_ALL);
 	php_stream_close(local_file);
-	libssh2_channel_free(remote_file);
+	php_ssh2_channel_free(session, remote_file);
 	RETURN_TRUE;
 }
 /* }}} */
@@ -1198,15 +1457,17 @@ static php_stream *php_ssh2_direct_tcpip(LIBSSH2_SESSION *session, int resource_
 	LIBSSH2_CHANNEL *channel;
 	php_ssh2_channel_data *channel_data;
 	php_stream *stream;
+	double started = php_ssh2_comp_clock();
 
 	channel = libssh2_channel_direct_tcpip(session, host, port);
+	php_ssh2_stats_channel_open(session, PHP_SSH2_CHANNEL_DIRECT_TCPIP, channel, started);
 	if (!channel) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to request a channel from remote host");
 		return NULL;
 	}
 
 	/* Turn it into a stream */
-	channel_data = emalloc(sizeof(php_ssh2_channel_data));
+	channel_data = ecalloc(1, sizeof(php_ssh2_channel_data));
 	channel_data->channel = channel;
 	channel_data->streamid = 0;
 	channel_data->is_blocking = 0;
@@ -1369,6 +1630,8 @@ PHP_FUNCTION(ssh2_fetch_stream)
 	stream_data = emalloc(sizeof(php_ssh2_channel_data));
 	memcpy(stream_data, data, sizeof(php_ssh2_channel_data));
 	stream_data->streamid = streamid;
+	stream_data->bytes_read = 0;
+	stream_data->bytes_written = 0;
 
 	stream = php_stream_alloc(&php_ssh2_channel_stream_ops, stream_data, 0, "r+");
 	if (!stream) {
@@ -0,0 +1,410 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "ext/standard/md5.h"
+#include "php_ssh2.h"
+
+/* Key files named to ssh2_auth_pubkey_file() or the wrappers' pubkey_file/privkey_file are read once per process
+ * and kept in SSH2_G(key_files) until their mtime or size changes, authentication then goes through
+ * libssh2_userauth_publickey_frommemory() without touching the disk
+ *
+ * Decrypting a private key (the passphrase KDF) is the expensive part, with ssh2.key_cache_decrypted_ttl > 0
+ * PEM keys decrypted through libcrypto are kept in SSH2_G(key_plain) for that many seconds,
+ * ssh2_key_cache_clear() wipes them (or everything) at any time
+ */
+
+#ifdef PHP_SSH2_KEY_DECRYPT
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#endif
+
+typedef struct _php_ssh2_key {
+	time_t mtime;
+	off_t size;
+	time_t expires;
+
+	char *data;
+	size_t len;
+} php_ssh2_key;
+
+/* {{{ php_ssh2_key_dtor
+ * Destructor for SSH2_G(key_files) and SSH2_G(key_plain), key material never lingers in freed memory
+ */
+void php_ssh2_key_dtor(void *pDest)
+{
+	php_ssh2_key *key = *(php_ssh2_key**)pDest;
+
+	memset(key->data, 0, key->len);
+	pefree(key->data, 1);
+	pefree(key, 1);
+}
+/* }}} */
+
+/* {{{ php_ssh2_key_store
+ */
+static php_ssh2_key *php_ssh2_key_store(HashTable *ht, char *name, uint name_len, struct stat *sb, time_t expires, char *data, size_t len)
+{
+	php_ssh2_key *key = pemalloc(sizeof(php_ssh2_key), 1);
+
+	key->mtime = sb->st_mtime;
+	key->size = sb->st_size;
+	key->expires = expires;
+	key->data = pemalloc(len + 1, 1);
+	memcpy(key->data, data, len);
+	key->data[len] = '\0';
+	key->len = len;
+
+	/* Room for at least the public and private key of one login */
+	if (SSH2_G(key_cache_size) > 0 && zend_hash_num_elements(ht) >= MAX(SSH2_G(key_cache_size), 2)) {
+		zend_hash_clean(ht);
+	}
+	zend_hash_update(ht, name, name_len, &key, sizeof(php_ssh2_key*), NULL);
+
+	return key;
+}
+/* }}} */
+
+/* {{{ php_ssh2_key_expand
+ * Resolve '~/' against the home directory looked up once per process, returns an emalloc'd path
+ */
+static char *php_ssh2_key_expand(char *path TSRMLS_DC)
+{
+#ifndef PHP_WIN32
+	if (path[0] == '~' && path[1] == '/') {
+		char *expanded;
+
+		if (!SSH2_G(key_home)) {
+			struct passwd *pws = getpwuid(geteuid());
+
+			if (!pws || !pws->pw_dir) {
+				return estrdup(path);
+			}
+			SSH2_G(key_home) = pestrdup(pws->pw_dir, 1);
+		}
+		spprintf(&expanded, 0, "%s%s", SSH2_G(key_home), path + 1);
+		return expanded;
+	}
+#endif
+
+	return estrdup(path);
+}
+/* }}} */
+
+/* {{{ php_ssh2_key_file
+ * The contents of a key file, read again only once it changed
+ */
+static php_ssh2_key *php_ssh2_key_file(char *path, struct stat *sb TSRMLS_DC)
+{
+	php_ssh2_key **cached, *key;
+	php_stream *stream;
+	char *data = NULL;
+	size_t len;
+
+	if (SSH2_OPENBASEDIR_CHECKPATH(path) || VCWD_STAT(path, sb) != 0) {
+		return NULL;
+	}
+
+	if (zend_hash_find(&SSH2_G(key_files), path, strlen(path) + 1, (void**)&cached) == SUCCESS &&
+		(*cached)->mtime == sb->st_mtime && (*cached)->size == sb->st_size) {
+		return *cached;
+	}
+
+	stream = php_stream_open_wrapper(path, "rb", ENFORCE_SAFE_MODE | REPORT_ERRORS, NULL);
+	if (!stream) {
+		return NULL;
+	}
+	len = php_stream_copy_to_mem(stream, &data, PHP_STREAM_COPY_ALL, 0);
+	php_stream_close(stream);
+	if (!data || !len) {
+		if (data) {
+			efree(data);
+		}
+		return NULL;
+	}
+
+	key = php_ssh2_key_store(&SSH2_G(key_files), path, strlen(path) + 1, sb, 0, data, len);
+	memset(data, 0, len);
+	efree(data);
+
+	return key;
+}
+/* }}} */
+
+/* {{{ php_ssh2_auth_ident_key
+ * Identity of a key login: the private key itself and its passphrase rather than where the key came from,
+ * a pooled session authenticated with them only opens up for a caller holding both
+ */
+void php_ssh2_auth_ident_key(char *ident, char *username, int username_len, char *method, char *key, size_t key_len, char *passphrase)
+{
+	PHP_MD5_CTX context;
+	unsigned char digest[16];
+
+	if (!passphrase) {
+		passphrase = "";
+	}
+
+	PHP_MD5Init(&context);
+	PHP_MD5Update(&context, (unsigned char*)username, username_len + 1);
+	PHP_MD5Update(&context, (unsigned char*)method, strlen(method) + 1);
+	PHP_MD5Update(&context, (unsigned char*)key, key_len);
+	PHP_MD5Update(&context, (unsigned char*)passphrase, strlen(passphrase) + 1);
+	PHP_MD5Final(digest, &context);
+	make_digest(ident, digest);
+}
+/* }}} */
+
+/* {{{ php_ssh2_auth_ident_keyfile
+ * php_ssh2_auth_ident_key() for key files, open_basedir is checked on both of them before anything is read
+ * Returns FAILURE and leaves ident empty (matching no session) when they can't be used
+ */
+int php_ssh2_auth_ident_keyfile(char *ident, char *username, int username_len, char *method, char *pubkey, char *privkey, char *passphrase TSRMLS_DC)
+{
+	char *pubkey_path = php_ssh2_key_expand(pubkey TSRMLS_CC);
+	char *privkey_path = php_ssh2_key_expand(privkey TSRMLS_CC);
+	php_ssh2_key *key = NULL;
+	struct stat sb;
+
+	ident[0] = '\0';
+	if (!SSH2_OPENBASEDIR_CHECKPATH(pubkey_path)) {
+		key = php_ssh2_key_file(privkey_path, &sb TSRMLS_CC);
+	}
+	efree(pubkey_path);
+	efree(privkey_path);
+	if (!key) {
+		return FAILURE;
+	}
+
+	php_ssh2_auth_ident_key(ident, username, username_len, method, key->data, key->len, passphrase);
+
+	return SUCCESS;
+}
+/* }}} */
+
+#ifdef PHP_SSH2_KEY_DECRYPT
+/* {{{ php_ssh2_key_passphrase_cb
+ */
+static int php_ssh2_key_passphrase_cb(char *buf, int size, int rwflag, void *userdata)
+{
+	int len = strlen((char*)userdata);
+
+	if (len > size) {
+		return -1;
+	}
+	memcpy(buf, userdata, len);
+
+	return len;
+}
+/* }}} */
+
+/* {{{ php_ssh2_key_decrypted
+ * The unencrypted PEM form of a passphrase protected private key, NULL when it can't or shouldn't be kept
+ * OpenSSH's own key format (bcrypt-pbkdf) is beyond libcrypto and left to libssh2
+ */
+static php_ssh2_key *php_ssh2_key_decrypted(char *path, php_ssh2_key *encrypted, struct stat *sb, char *passphrase TSRMLS_DC)
+{
+	char name[MAXPATHLEN + PHP_SSH2_AUTH_IDENT_LEN + 2], digest_hex[33], *pem;
+	unsigned char digest[16];
+	int name_len;
+	long pem_len;
+	php_ssh2_key **cached, *key = NULL;
+	PHP_MD5_CTX context;
+	time_t now = time(NULL);
+	BIO *in, *out;
+	EVP_PKEY *pkey;
+
+	if (SSH2_G(key_cache_decrypted_ttl) <= 0 || strstr(encrypted->data, "OPENSSH PRIVATE KEY")) {
+		return NULL;
+	}
+
+	PHP_MD5Init(&context);
+	PHP_MD5Update(&context, (unsigned char*)passphrase, strlen(passphrase));
+	PHP_MD5Final(digest, &context);
+	make_digest(digest_hex, digest);
+	name_len = snprintf(name, sizeof(name), "%s|%s", path, digest_hex);
+	if (name_len <= 0 || name_len >= (int)sizeof(name)) {
+		return NULL;
+	}
+
+	if (zend_hash_find(&SSH2_G(key_plain), name, name_len + 1, (void**)&cached) == SUCCESS) {
+		if ((*cached)->mtime == sb->st_mtime && (*cached)->size == sb->st_size && (*cached)->expires > now) {
+			return *cached;
+		}
+		zend_hash_del(&SSH2_G(key_plain), name, name_len + 1);
+	}
+
+	if (!(in = BIO_new_mem_buf(encrypted->data, encrypted->len))) {
+		return NULL;
+	}
+	pkey = PEM_read_bio_PrivateKey(in, NULL, php_ssh2_key_passphrase_cb, passphrase);
+	BIO_free(in);
+	if (!pkey) {
+		return NULL;
+	}
+
+	if ((out = BIO_new(BIO_s_mem()))) {
+		if (PEM_write_bio_PrivateKey(out, pkey, NULL, NULL, 0, NULL, NULL) &&
+			(pem_len = BIO_get_mem_data(out, &pem)) > 0) {
+			key = php_ssh2_key_store(&SSH2_G(key_plain), name, name_len + 1, sb, now + SSH2_G(key_cache_decrypted_ttl), pem, pem_len);
+			memset(pem, 0, pem_len);
+		}
+		BIO_free(out);
+	}
+	EVP_PKEY_free(pkey);
+
+	return key;
+}
+/* }}} */
+#endif
+
+/* {{{ php_ssh2_userauth_publickey
+ * Public key authentication from (cached) key files
+ * Returns 0 on success, a libssh2 error code or PHP_SSH2_KEY_UNREADABLE
+ */
+int php_ssh2_userauth_publickey(LIBSSH2_SESSION *session, char *username, int username_len, char *pubkey, char *privkey, char *passphrase TSRMLS_DC)
+{
+	char *pubkey_path = php_ssh2_key_expand(pubkey TSRMLS_CC);
+	char *privkey_path = php_ssh2_key_expand(privkey TSRMLS_CC);
+	int rc = PHP_SSH2_KEY_UNREADABLE;
+	double started;
+#ifdef PHP_SSH2_PUBKEY_MEMORY
+	php_ssh2_key *pub, *priv, *plain = NULL;
+	struct stat pub_sb, priv_sb;
+
+	if (!php_ssh2_key_file(pubkey_path, &pub_sb TSRMLS_CC) ||
+		!(priv = php_ssh2_key_file(privkey_path, &priv_sb TSRMLS_CC))) {
+		goto done;
+	}
+	/* Fetched again, storing the private key may have flushed a full cache */
+	if (!(pub = php_ssh2_key_file(pubkey_path, &pub_sb TSRMLS_CC))) {
+		goto done;
+	}
+
+#ifdef PHP_SSH2_KEY_DECRYPT
+	if (passphrase && *passphrase) {
+		plain = php_ssh2_key_decrypted(privkey_path, priv, &priv_sb, passphrase TSRMLS_CC);
+	}
+#endif
+
+	started = php_ssh2_comp_clock();
+	if (plain) {
+		rc = libssh2_userauth_publickey_frommemory(session, username, username_len, pub->data, pub->len, plain->data, plain->len, NULL);
+	} else {
+		rc = libssh2_userauth_publickey_frommemory(session, username, username_len, pub->data, pub->len, priv->data, priv->len, passphrase);
+	}
+#else
+	if (SSH2_OPENBASEDIR_CHECKPATH(pubkey_path) || SSH2_OPENBASEDIR_CHECKPATH(privkey_path)) {
+		goto done;
+	}
+	started = php_ssh2_comp_clock();
+	rc = libssh2_userauth_publickey_fromfile_ex(session, username, username_len, pubkey_path, privkey_path, passphrase);
+#endif
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + PHP_SSH2_AUTH_PUBKEY, started TSRMLS_CC);
+
+done:
+	efree(pubkey_path);
+	efree(privkey_path);
+
+	return rc;
+}
+/* }}} */
+
+/* {{{ proto bool ssh2_auth_pubkey_memory(resource session, string username, string pubkeydata, string privkeydata[, string passphrase])
+ * Authenticate using a public key given as a string rather than a file
+ * An empty pubkeydata has libssh2 derive the public key from the private one
+ */
+PHP_FUNCTION(ssh2_auth_pubkey_memory)
+{
+#ifdef PHP_SSH2_PUBKEY_MEMORY
+	LIBSSH2_SESSION *session;
+	zval *zsession;
+	char *username, *pubkey, *privkey, *passphrase = NULL;
+	int username_len, pubkey_len, privkey_len, passphrase_len;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	double started;
+	int rc;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rsss|s", &zsession,	&username, &username_len,
+																				&pubkey, &pubkey_len,
+																				&privkey, &privkey_len,
+																				&passphrase, &passphrase_len) == FAILURE) {
+		return;
+	}
+
+	php_ssh2_auth_ident_key(ident, username, username_len, "publickey", privkey, privkey_len, passphrase);
+	SSH2_FETCH_NONAUTHENTICATED_SESSION_IDENT(session, zsession, ident);
+
+	started = php_ssh2_comp_clock();
+	rc = libssh2_userauth_publickey_frommemory(session, username, username_len, pubkey, pubkey_len, privkey, privkey_len, passphrase);
+	php_ssh2_latency_record(PHP_SSH2_LATENCY_AUTH + PHP_SSH2_AUTH_PUBKEY, started TSRMLS_CC);
+	if (rc) {
+		char *buf;
+		int len;
+		libssh2_session_last_error(session, &buf, &len, 0);
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Authentication failed for %s using public key: %s", username, buf);
+		RETURN_FALSE;
+	}
+
+	php_ssh2_session_auth_remember(session, ident);
+	RETURN_TRUE;
+#else
+	php_error_docref(NULL TSRMLS_CC, E_WARNING, "Upgrade the libssh2 library (needs 1.6.0 or higher) and reinstall the ssh2 extension for in-memory key support");
+	RETURN_FALSE;
+#endif /* PHP_SSH2_PUBKEY_MEMORY */
+}
+/* }}} */
+
+/* {{{ proto int ssh2_key_cache_clear([bool decrypted_only])
+ * Wipe cached key material, returns the number of keys dropped
+ */
+PHP_FUNCTION(ssh2_key_cache_clear)
+{
+	zend_bool decrypted_only = 0;
+	long dropped;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &decrypted_only) == FAILURE) {
+		return;
+	}
+
+	dropped = zend_hash_num_elements(&SSH2_G(key_plain));
+	zend_hash_clean(&SSH2_G(key_plain));
+	if (!decrypted_only) {
+		dropped += zend_hash_num_elements(&SSH2_G(key_files));
+		zend_hash_clean(&SSH2_G(key_files));
+	}
+
+	RETURN_LONG(dropped);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,785 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "ext/standard/base64.h"
+#include "ext/standard/php_string.h"
+#include "ext/standard/sha1.h"
+#include "php_ssh2.h"
+
+/* OpenSSH known_hosts files are parsed once into hash tables and kept until their mtime or size changes:
+ *   plain names:   "host" or "[host]:port" => keys
+ *   hashed names:  salt => (HMAC-SHA1(salt, name) => keys), every salt has to be tried once per name,
+ *                  so which hashed keys a name maps to is remembered as well, OpenSSH writes one line
+ *                  with its own salt per key type, so a name usually has several chains
+ *   patterns:      lines with wildcards or negations, matched one by one
+ * Lookups without memoize never allocate and only read, so handshake threads may use a file primed by the PHP thread
+ */
+
+#define PHP_SSH2_KH_HASH_LEN		20
+#define PHP_SSH2_KH_MEMO_SIZE		4096
+
+typedef struct _php_ssh2_kh_key {
+	/* "ssh-rsa", "ssh-ed25519", ... only keys of the type the server offered are compared */
+	char *keytype;
+	unsigned char *blob;
+	int blob_len;
+	int revoked;
+	struct _php_ssh2_kh_key *next;
+} php_ssh2_kh_key;
+
+typedef struct _php_ssh2_kh_memo {
+	int count;
+	php_ssh2_kh_key *chains[1];
+} php_ssh2_kh_memo;
+
+typedef struct _php_ssh2_kh_pattern {
+	char *patterns;
+	php_ssh2_kh_key *key;
+	struct _php_ssh2_kh_pattern *next;
+} php_ssh2_kh_pattern;
+
+struct _php_ssh2_known_hosts {
+	/* SSH2_G(known_hosts) holds one, every handshake thread job another */
+	int refcount;
+
+	time_t mtime;
+	off_t size;
+	long entries;
+
+	HashTable names;
+	HashTable salts;
+	HashTable salt_memo;
+	php_ssh2_kh_pattern *patterns;
+};
+
+/* {{{ php_ssh2_kh_key_free
+ */
+static void php_ssh2_kh_key_free(php_ssh2_kh_key *key)
+{
+	while (key) {
+		php_ssh2_kh_key *next = key->next;
+
+		pefree(key->keytype, 1);
+		pefree(key->blob, 1);
+		pefree(key, 1);
+		key = next;
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_chain_dtor
+ */
+static void php_ssh2_kh_chain_dtor(void *pDest)
+{
+	php_ssh2_kh_key_free(*(php_ssh2_kh_key**)pDest);
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_memo_dtor
+ */
+static void php_ssh2_kh_memo_dtor(void *pDest)
+{
+	pefree(*(php_ssh2_kh_memo**)pDest, 1);
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_salt_dtor
+ */
+static void php_ssh2_kh_salt_dtor(void *pDest)
+{
+	HashTable *hashes = *(HashTable**)pDest;
+
+	zend_hash_destroy(hashes);
+	pefree(hashes, 1);
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_free
+ */
+static void php_ssh2_known_hosts_free(php_ssh2_known_hosts *kh)
+{
+	php_ssh2_kh_pattern *pattern = kh->patterns;
+
+	while (pattern) {
+		php_ssh2_kh_pattern *next = pattern->next;
+
+		php_ssh2_kh_key_free(pattern->key);
+		pefree(pattern->patterns, 1);
+		pefree(pattern, 1);
+		pattern = next;
+	}
+	zend_hash_destroy(&kh->salt_memo);
+	zend_hash_destroy(&kh->salts);
+	zend_hash_destroy(&kh->names);
+	pefree(kh, 1);
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_addref
+ * Keep a parsed file alive after SSH2_G(known_hosts) reloaded or dropped it
+ */
+void php_ssh2_known_hosts_addref(php_ssh2_known_hosts *kh)
+{
+	kh->refcount++;
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_release
+ */
+void php_ssh2_known_hosts_release(php_ssh2_known_hosts *kh)
+{
+	if (--kh->refcount == 0) {
+		php_ssh2_known_hosts_free(kh);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_dtor
+ * Destructor for SSH2_G(known_hosts)
+ */
+void php_ssh2_known_hosts_dtor(void *pDest)
+{
+	php_ssh2_known_hosts_release(*(php_ssh2_known_hosts**)pDest);
+}
+/* }}} */
+
+/* ***********
+   * Parsing *
+   *********** */
+
+/* {{{ php_ssh2_kh_key_new
+ */
+static php_ssh2_kh_key *php_ssh2_kh_key_new(char *keytype, unsigned char *blob, int blob_len, int revoked)
+{
+	php_ssh2_kh_key *key = pemalloc(sizeof(php_ssh2_kh_key), 1);
+
+	key->keytype = pestrdup(keytype, 1);
+	key->blob = pemalloc(blob_len, 1);
+	memcpy(key->blob, blob, blob_len);
+	key->blob_len = blob_len;
+	key->revoked = revoked;
+	key->next = NULL;
+
+	return key;
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_add
+ * Prepend a key to the chain stored under name
+ */
+static void php_ssh2_kh_add(HashTable *ht, char *name, uint name_len, char *keytype, unsigned char *blob, int blob_len, int revoked)
+{
+	php_ssh2_kh_key *key = php_ssh2_kh_key_new(keytype, blob, blob_len, revoked), **chain;
+
+	if (zend_hash_find(ht, name, name_len, (void**)&chain) == SUCCESS) {
+		key->next = *chain;
+		*chain = key;
+		return;
+	}
+	zend_hash_add(ht, name, name_len, &key, sizeof(php_ssh2_kh_key*), NULL);
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_add_hashed
+ * "|1|base64(salt)|base64(HMAC-SHA1(salt, name))"
+ */
+static int php_ssh2_kh_add_hashed(php_ssh2_known_hosts *kh, char *entry, char *keytype, unsigned char *blob, int blob_len, int revoked)
+{
+	char *sep;
+	unsigned char *salt, *hash;
+	int salt_len, hash_len, ret = FAILURE;
+	HashTable **hashes;
+
+	entry += sizeof("|1|") - 1;
+	if (!(sep = strchr(entry, '|'))) {
+		return FAILURE;
+	}
+
+	salt = php_base64_decode((unsigned char*)entry, sep - entry, &salt_len);
+	hash = php_base64_decode((unsigned char*)sep + 1, strlen(sep + 1), &hash_len);
+	if (!salt || !hash || salt_len <= 0 || hash_len != PHP_SSH2_KH_HASH_LEN) {
+		goto done;
+	}
+
+	if (zend_hash_find(&kh->salts, (char*)salt, salt_len, (void**)&hashes) == FAILURE) {
+		HashTable *fresh = pemalloc(sizeof(HashTable), 1);
+
+		zend_hash_init(fresh, 1, NULL, php_ssh2_kh_chain_dtor, 1);
+		zend_hash_add(&kh->salts, (char*)salt, salt_len, &fresh, sizeof(HashTable*), (void**)&hashes);
+	}
+	php_ssh2_kh_add(*hashes, (char*)hash, hash_len, keytype, blob, blob_len, revoked);
+	ret = SUCCESS;
+
+done:
+	if (salt) {
+		efree(salt);
+	}
+	if (hash) {
+		efree(hash);
+	}
+	return ret;
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_parse_line
+ * [@marker] hostpatterns keytype base64key [comment]
+ */
+static void php_ssh2_kh_parse_line(php_ssh2_known_hosts *kh, char *line)
+{
+	char *hosts, *keytype, *b64, *host, *last = NULL;
+	unsigned char *blob;
+	int blob_len, revoked = 0;
+
+	while (*line == ' ' || *line == '\t') {
+		line++;
+	}
+	if (!*line || *line == '#') {
+		return;
+	}
+
+	if (*line == '@') {
+		if (strncmp(line, "@revoked", sizeof("@revoked") - 1) != 0) {
+			/* @cert-authority needs certificate checking, which libssh2 can't do */
+			return;
+		}
+		revoked = 1;
+		line += sizeof("@revoked") - 1;
+	}
+
+	hosts = php_strtok_r(line, " \t", &last);
+	keytype = php_strtok_r(NULL, " \t", &last);
+	b64 = php_strtok_r(NULL, " \t", &last);
+	if (!hosts || !keytype || !b64) {
+		return;
+	}
+
+	blob = php_base64_decode((unsigned char*)b64, strlen(b64), &blob_len);
+	if (!blob || blob_len <= 0) {
+		if (blob) {
+			efree(blob);
+		}
+		return;
+	}
+
+	if (strpbrk(hosts, "*?!")) {
+		php_ssh2_kh_pattern *pattern = pemalloc(sizeof(php_ssh2_kh_pattern), 1);
+
+		pattern->patterns = pestrdup(hosts, 1);
+		php_strtolower(pattern->patterns, strlen(pattern->patterns));
+		pattern->key = php_ssh2_kh_key_new(keytype, blob, blob_len, revoked);
+		pattern->next = kh->patterns;
+		kh->patterns = pattern;
+		kh->entries++;
+		efree(blob);
+		return;
+	}
+
+	for(host = php_strtok_r(hosts, ",", &last); host; host = php_strtok_r(NULL, ",", &last)) {
+		if (strncmp(host, "|1|", sizeof("|1|") - 1) == 0) {
+			if (php_ssh2_kh_add_hashed(kh, host, keytype, blob, blob_len, revoked) == SUCCESS) {
+				kh->entries++;
+			}
+		} else {
+			php_strtolower(host, strlen(host));
+			php_ssh2_kh_add(&kh->names, host, strlen(host) + 1, keytype, blob, blob_len, revoked);
+			kh->entries++;
+		}
+	}
+	efree(blob);
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_load
+ */
+static php_ssh2_known_hosts *php_ssh2_kh_load(char *filename, struct stat *sb TSRMLS_DC)
+{
+	php_stream *stream;
+	php_ssh2_known_hosts *kh;
+	char *line;
+	size_t line_len;
+
+	stream = php_stream_open_wrapper(filename, "rb", ENFORCE_SAFE_MODE | REPORT_ERRORS, NULL);
+	if (!stream) {
+		return NULL;
+	}
+
+	kh = pecalloc(1, sizeof(php_ssh2_known_hosts), 1);
+	kh->refcount = 1;
+	kh->mtime = sb->st_mtime;
+	kh->size = sb->st_size;
+	zend_hash_init(&kh->names, 1024, NULL, php_ssh2_kh_chain_dtor, 1);
+	zend_hash_init(&kh->salts, 1024, NULL, php_ssh2_kh_salt_dtor, 1);
+	zend_hash_init(&kh->salt_memo, 64, NULL, php_ssh2_kh_memo_dtor, 1);
+
+	/* One line per key, the line end is cut off here, the tokenizer only splits on blanks */
+	while ((line = php_stream_get_line(stream, NULL, 0, &line_len))) {
+		while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
+			line[--line_len] = '\0';
+		}
+		php_ssh2_kh_parse_line(kh, line);
+		efree(line);
+	}
+	php_stream_close(stream);
+
+	return kh;
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_get
+ * The parsed file, (re)loaded when it changed on disk since it was last parsed
+ */
+php_ssh2_known_hosts *php_ssh2_known_hosts_get(char *filename TSRMLS_DC)
+{
+	php_ssh2_known_hosts **cached, *kh;
+	struct stat sb;
+
+	if (php_check_open_basedir(filename TSRMLS_CC) || VCWD_STAT(filename, &sb) != 0) {
+		return NULL;
+	}
+
+	if (zend_hash_find(&SSH2_G(known_hosts), filename, strlen(filename) + 1, (void**)&cached) == SUCCESS &&
+		(*cached)->mtime == sb.st_mtime && (*cached)->size == sb.st_size) {
+		return *cached;
+	}
+
+	if (!(kh = php_ssh2_kh_load(filename, &sb TSRMLS_CC))) {
+		return NULL;
+	}
+	zend_hash_update(&SSH2_G(known_hosts), filename, strlen(filename) + 1, &kh, sizeof(php_ssh2_known_hosts*), NULL);
+
+	return kh;
+}
+/* }}} */
+
+/* ************
+   * Matching *
+   ************ */
+
+/* {{{ php_ssh2_kh_hmac_sha1
+ */
+static void php_ssh2_kh_hmac_sha1(const unsigned char *salt, uint salt_len, const char *name, int name_len, unsigned char *digest)
+{
+	PHP_SHA1_CTX context;
+	unsigned char ipad[64], opad[64], inner[PHP_SSH2_KH_HASH_LEN];
+	int i;
+
+	memset(ipad, 0x36, sizeof(ipad));
+	memset(opad, 0x5c, sizeof(opad));
+	/* OpenSSH salts are the size of the digest, never longer than the block */
+	for(i = 0; i < (int)salt_len && i < 64; i++) {
+		ipad[i] ^= salt[i];
+		opad[i] ^= salt[i];
+	}
+
+	PHP_SHA1Init(&context);
+	PHP_SHA1Update(&context, ipad, sizeof(ipad));
+	PHP_SHA1Update(&context, (const unsigned char*)name, name_len);
+	PHP_SHA1Final(inner, &context);
+
+	PHP_SHA1Init(&context);
+	PHP_SHA1Update(&context, opad, sizeof(opad));
+	PHP_SHA1Update(&context, inner, sizeof(inner));
+	PHP_SHA1Final(digest, &context);
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_glob
+ * Case folded '*' and '?' matching, the name is lower case already
+ */
+static int php_ssh2_kh_glob(const char *pattern, int pattern_len, const char *name)
+{
+	while (pattern_len > 0) {
+		if (*pattern == '*') {
+			pattern++;
+			pattern_len--;
+			if (!pattern_len) {
+				return 1;
+			}
+			for(; *name; name++) {
+				if (php_ssh2_kh_glob(pattern, pattern_len, name)) {
+					return 1;
+				}
+			}
+			return 0;
+		}
+		if (!*name || (*pattern != '?' && *pattern != *name)) {
+			return 0;
+		}
+		pattern++;
+		pattern_len--;
+		name++;
+	}
+
+	return !*name;
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_pattern_match
+ * A comma separated list matches if any positive pattern does and no negated one does
+ */
+static int php_ssh2_kh_pattern_match(char *patterns, char *name)
+{
+	int matched = 0;
+
+	while (*patterns) {
+		char *end = strchr(patterns, ',');
+		int len = end ? end - patterns : strlen(patterns);
+
+		if (*patterns == '!') {
+			if (php_ssh2_kh_glob(patterns + 1, len - 1, name)) {
+				return 0;
+			}
+		} else if (php_ssh2_kh_glob(patterns, len, name)) {
+			matched = 1;
+		}
+
+		if (!end) {
+			break;
+		}
+		patterns = end + 1;
+	}
+
+	return matched;
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_type_name
+ * The known_hosts keytype of a host key from libssh2_session_hostkey(), types this libssh2
+ * has no constant for are read from the blob, which starts with the type as an SSH string
+ */
+static void php_ssh2_kh_type_name(int type, const char *blob, size_t blob_len, char *name, int name_size)
+{
+	const unsigned char *p = (const unsigned char*)blob;
+	size_t len;
+
+	name[0] = '\0';
+	switch (type) {
+#ifdef LIBSSH2_HOSTKEY_TYPE_RSA
+		case LIBSSH2_HOSTKEY_TYPE_RSA:			strlcpy(name, "ssh-rsa", name_size);				return;
+		case LIBSSH2_HOSTKEY_TYPE_DSS:			strlcpy(name, "ssh-dss", name_size);				return;
+#endif
+#ifdef LIBSSH2_HOSTKEY_TYPE_ECDSA_256
+		case LIBSSH2_HOSTKEY_TYPE_ECDSA_256:	strlcpy(name, "ecdsa-sha2-nistp256", name_size);	return;
+		case LIBSSH2_HOSTKEY_TYPE_ECDSA_384:	strlcpy(name, "ecdsa-sha2-nistp384", name_size);	return;
+		case LIBSSH2_HOSTKEY_TYPE_ECDSA_521:	strlcpy(name, "ecdsa-sha2-nistp521", name_size);	return;
+#endif
+#ifdef LIBSSH2_HOSTKEY_TYPE_ED25519
+		case LIBSSH2_HOSTKEY_TYPE_ED25519:		strlcpy(name, "ssh-ed25519", name_size);			return;
+#endif
+	}
+
+	if (blob_len < 4) {
+		return;
+	}
+	len = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+	if (len > 0 && len < (size_t)name_size && len <= blob_len - 4) {
+		memcpy(name, p + 4, len);
+		name[len] = '\0';
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_kh_check_chain
+ * Fold one chain of candidate keys into the result so far
+ * Keys of another type than the offered one don't count, the host may just have several
+ */
+static int php_ssh2_kh_check_chain(php_ssh2_kh_key *key, const char *keytype, const char *blob, size_t blob_len, int result)
+{
+	for(; key; key = key->next) {
+		if (*keytype && strcmp(key->keytype, keytype) != 0) {
+			continue;
+		}
+		if (key->blob_len == (int)blob_len && memcmp(key->blob, blob, blob_len) == 0) {
+			if (key->revoked) {
+				return PHP_SSH2_KNOWNHOST_REVOKED;
+			}
+			if (result != PHP_SSH2_KNOWNHOST_REVOKED) {
+				result = PHP_SSH2_KNOWNHOST_MATCH;
+			}
+		} else if (!key->revoked && result == PHP_SSH2_KNOWNHOST_NOTFOUND) {
+			result = PHP_SSH2_KNOWNHOST_MISMATCH;
+		}
+	}
+
+	return result;
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_lookup
+ * Check a host key blob and type (as from libssh2_session_hostkey()) against the keys listed for host:port
+ * Returns one of PHP_SSH2_KNOWNHOST_*, a revoked key wins over everything else, a match over a mismatch,
+ * a host only listed with keys of other types is NOTFOUND
+ * Only the PHP thread may pass memoize, handshake threads rely on php_ssh2_known_hosts_prime()
+ */
+int php_ssh2_known_hosts_lookup(php_ssh2_known_hosts *kh, char *host, int port, const char *blob, size_t blob_len, int type, int memoize)
+{
+	char name[1024], keytype[64];
+	int name_len, result = PHP_SSH2_KNOWNHOST_NOTFOUND, i;
+	php_ssh2_kh_key **chain;
+	php_ssh2_kh_memo **cached, *memo = NULL;
+	php_ssh2_kh_pattern *pattern;
+
+	if (port == PHP_SSH2_DEFAULT_PORT) {
+		name_len = snprintf(name, sizeof(name), "%s", host);
+	} else {
+		name_len = snprintf(name, sizeof(name), "[%s]:%d", host, port);
+	}
+	if (name_len <= 0 || name_len >= (int)sizeof(name)) {
+		return PHP_SSH2_KNOWNHOST_NOTFOUND;
+	}
+	php_strtolower(name, name_len);
+	php_ssh2_kh_type_name(type, blob, blob_len, keytype, sizeof(keytype));
+
+	if (zend_hash_find(&kh->names, name, name_len + 1, (void**)&chain) == SUCCESS) {
+		result = php_ssh2_kh_check_chain(*chain, keytype, blob, blob_len, result);
+	}
+
+	if (zend_hash_find(&kh->salt_memo, name, name_len + 1, (void**)&cached) == SUCCESS) {
+		for(i = 0; i < (*cached)->count && result != PHP_SSH2_KNOWNHOST_REVOKED; i++) {
+			result = php_ssh2_kh_check_chain((*cached)->chains[i], keytype, blob, blob_len, result);
+		}
+	} else if (zend_hash_num_elements(&kh->salts)) {
+		HashPosition pos;
+		HashTable **hashes;
+		int size = 0;
+
+		for(zend_hash_internal_pointer_reset_ex(&kh->salts, &pos);
+			zend_hash_get_current_data_ex(&kh->salts, (void**)&hashes, &pos) == SUCCESS;
+			zend_hash_move_forward_ex(&kh->salts, &pos)) {
+			unsigned char digest[PHP_SSH2_KH_HASH_LEN];
+			char *salt;
+			uint salt_len;
+			ulong index;
+
+			if (zend_hash_get_current_key_ex(&kh->salts, &salt, &salt_len, &index, 0, &pos) != HASH_KEY_IS_STRING) {
+				continue;
+			}
+			php_ssh2_kh_hmac_sha1((unsigned char*)salt, salt_len, name, name_len, digest);
+			if (zend_hash_find(*hashes, (char*)digest, sizeof(digest), (void**)&chain) == SUCCESS) {
+				result = php_ssh2_kh_check_chain(*chain, keytype, blob, blob_len, result);
+				if (!memoize) {
+					if (result == PHP_SSH2_KNOWNHOST_REVOKED) {
+						break;
+					}
+					continue;
+				}
+				/* Every salt maps to its own chain, the memo has to list all of them */
+				if (!memo) {
+					size = 4;
+					memo = pemalloc(sizeof(php_ssh2_kh_memo) + (size - 1) * sizeof(php_ssh2_kh_key*), 1);
+					memo->count = 0;
+				} else if (memo->count == size) {
+					size *= 2;
+					memo = perealloc(memo, sizeof(php_ssh2_kh_memo) + (size - 1) * sizeof(php_ssh2_kh_key*), 1);
+				}
+				memo->chains[memo->count++] = *chain;
+			}
+		}
+		if (memoize) {
+			if (!memo) {
+				/* Remember that there is nothing hashed for this name either */
+				memo = pemalloc(sizeof(php_ssh2_kh_memo), 1);
+				memo->count = 0;
+			}
+			if (zend_hash_num_elements(&kh->salt_memo) >= PHP_SSH2_KH_MEMO_SIZE) {
+				zend_hash_clean(&kh->salt_memo);
+			}
+			zend_hash_update(&kh->salt_memo, name, name_len + 1, &memo, sizeof(php_ssh2_kh_memo*), NULL);
+		}
+	}
+
+	for(pattern = kh->patterns; pattern && result != PHP_SSH2_KNOWNHOST_REVOKED; pattern = pattern->next) {
+		if (php_ssh2_kh_pattern_match(pattern->patterns, name)) {
+			result = php_ssh2_kh_check_chain(pattern->key, keytype, blob, blob_len, result);
+		}
+	}
+
+	return result;
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_prime
+ * Scan the hashed entries for host:port now so handshake threads find the result remembered
+ */
+void php_ssh2_known_hosts_prime(php_ssh2_known_hosts *kh, char *host, int port)
+{
+	php_ssh2_known_hosts_lookup(kh, host, port, "", 0, 0, 1);
+}
+/* }}} */
+
+/* ****************
+   * Session glue *
+   **************** */
+
+/* {{{ php_ssh2_known_hosts_policy
+ * methods['known_hosts'] as a file name or array('file' => ..., 'strict' => bool),
+ * ssh2.known_hosts otherwise, *file is NULL when checking is off
+ */
+void php_ssh2_known_hosts_policy(zval *methods, char **pfile, int *pstrict TSRMLS_DC)
+{
+	char *file = SSH2_G(known_hosts_file);
+	int strict = SSH2_G(known_hosts_strict);
+	zval **container, **value;
+
+	if (methods && Z_TYPE_P(methods) == IS_ARRAY &&
+		zend_hash_find(Z_ARRVAL_P(methods), "known_hosts", sizeof("known_hosts"), (void**)&container) == SUCCESS &&
+		container && *container) {
+		if (Z_TYPE_PP(container) == IS_ARRAY) {
+			if (zend_hash_find(Z_ARRVAL_PP(container), "file", sizeof("file"), (void**)&value) == SUCCESS &&
+				value && *value && Z_TYPE_PP(value) == IS_STRING) {
+				file = Z_STRVAL_PP(value);
+			}
+			if (zend_hash_find(Z_ARRVAL_PP(container), "strict", sizeof("strict"), (void**)&value) == SUCCESS &&
+				value && *value) {
+				zval tmp = **value;
+
+				zval_copy_ctor(&tmp);
+				convert_to_boolean(&tmp);
+				strict = Z_BVAL(tmp);
+			}
+		} else if (Z_TYPE_PP(container) == IS_STRING) {
+			file = Z_STRVAL_PP(container);
+		} else if (Z_TYPE_PP(container) == IS_BOOL && !Z_BVAL_PP(container)) {
+			file = NULL;
+		}
+	}
+
+	*pfile = (file && *file) ? file : NULL;
+	*pstrict = strict;
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_config
+ */
+void php_ssh2_known_hosts_config(php_ssh2_session_data *data, zval *methods TSRMLS_DC)
+{
+	char *file;
+	int strict;
+
+	php_ssh2_known_hosts_policy(methods, &file, &strict TSRMLS_CC);
+	if (file) {
+		data->known_hosts = pestrdup(file, 1);
+		data->known_hosts_strict = strict;
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_known_hosts_verify
+ * Check a freshly started session's host key, FAILURE (with *error set) means don't talk to it
+ */
+int php_ssh2_known_hosts_verify(LIBSSH2_SESSION *session, char **error TSRMLS_DC)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	php_ssh2_known_hosts *kh;
+	const char *blob;
+	size_t blob_len;
+	int type;
+
+	if (!data || !data->known_hosts) {
+		return SUCCESS;
+	}
+
+	if (!data->host || !(blob = libssh2_session_hostkey(session, &blob_len, &type))) {
+		*error = estrdup("Unable to retrieve host key");
+		return FAILURE;
+	}
+
+	if (!(kh = php_ssh2_known_hosts_get(data->known_hosts TSRMLS_CC))) {
+		spprintf(error, 0, "Unable to load known hosts from %s", data->known_hosts);
+		return FAILURE;
+	}
+
+	switch (php_ssh2_known_hosts_lookup(kh, data->host, data->port, blob, blob_len, type, 1)) {
+		case PHP_SSH2_KNOWNHOST_MATCH:
+			return SUCCESS;
+		case PHP_SSH2_KNOWNHOST_NOTFOUND:
+			if (!data->known_hosts_strict) {
+				return SUCCESS;
+			}
+			spprintf(error, 0, "No host key for %s known in %s", data->host, data->known_hosts);
+			return FAILURE;
+		case PHP_SSH2_KNOWNHOST_REVOKED:
+			spprintf(error, 0, "Host key for %s is revoked in %s", data->host, data->known_hosts);
+			return FAILURE;
+		default:
+			spprintf(error, 0, "Host key for %s does not match %s", data->host, data->known_hosts);
+			return FAILURE;
+	}
+}
+/* }}} */
+
+/* {{{ proto int ssh2_known_hosts_check(resource session[, string file])
+Check the session's host key against an OpenSSH known_hosts file, returns one of SSH2_KNOWNHOST_* */
+PHP_FUNCTION(ssh2_known_hosts_check)
+{
+	zval *zsession;
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	php_ssh2_known_hosts *kh;
+	char *file = NULL;
+	int file_len = 0, type;
+	const char *blob;
+	size_t blob_len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r|s", &zsession, &file, &file_len) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	if (SSH2_SESSION_PENDING(session)) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Connection not established yet");
+		RETURN_FALSE;
+	}
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	if (!file_len) {
+		file = data->known_hosts ? data->known_hosts : SSH2_G(known_hosts_file);
+	}
+	if (!file || !*file) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "No known hosts file given");
+		RETURN_FALSE;
+	}
+	if (!data->host || !(blob = libssh2_session_hostkey(session, &blob_len, &type))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to retrieve host key from specified session");
+		RETURN_FALSE;
+	}
+	if (!(kh = php_ssh2_known_hosts_get(file TSRMLS_CC))) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to load known hosts from %s", file);
+		RETURN_FALSE;
+	}
+
+	RETURN_LONG(php_ssh2_known_hosts_lookup(kh, data->host, data->port, blob, blob_len, type, 1));
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,294 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+
+/* Latency histograms per operation, kept per process (per thread with ZTS) in SSH2_G(latency)
+ *
+ * Durations are recorded in microseconds into log-linear buckets, HDR histogram style:
+ * values below 2^PHP_SSH2_LATENCY_SUB_BITS get a bucket each, every power of two above
+ * is split into 2^PHP_SSH2_LATENCY_SUB_BITS linear buckets, so a percentile is reported
+ * within 1/32 (about 3%) of the recorded value, from 1us up to 2^41us (25 days).
+ */
+
+#define PHP_SSH2_LATENCY_SUB_BITS		5
+#define PHP_SSH2_LATENCY_SUB			(1 << PHP_SSH2_LATENCY_SUB_BITS)
+#define PHP_SSH2_LATENCY_MAX_BIT		40
+#define PHP_SSH2_LATENCY_BUCKETS		(PHP_SSH2_LATENCY_SUB * (PHP_SSH2_LATENCY_MAX_BIT - PHP_SSH2_LATENCY_SUB_BITS + 2))
+
+struct _php_ssh2_latency {
+	long count;
+	/* Milliseconds */
+	double sum;
+	double min;
+	double max;
+
+	long buckets[PHP_SSH2_LATENCY_BUCKETS];
+};
+
+static char *php_ssh2_latency_names[PHP_SSH2_LATENCY_COUNT] = {
+	"connect", "kex",
+	"auth.password", "auth.keyboard-interactive", "auth.publickey", "auth.agent",
+	"channel.shell", "channel.exec", "channel.scp", "channel.direct-tcpip", "channel.forwarded-tcpip",
+	"sftp.open", "sftp.read", "sftp.write", "sftp.close", "sftp.stat", "sftp.setstat", "sftp.opendir", "sftp.readdir",
+	"sftp.mkdir", "sftp.rmdir", "sftp.rename", "sftp.unlink", "sftp.symlink", "sftp.readlink", "sftp.realpath"
+};
+
+/* {{{ php_ssh2_latency_bucket
+ */
+static int php_ssh2_latency_bucket(php_ssh2_uint64 usec)
+{
+	int bit = PHP_SSH2_LATENCY_SUB_BITS;
+
+	if (usec < PHP_SSH2_LATENCY_SUB) {
+		return (int)usec;
+	}
+	if (usec >> (PHP_SSH2_LATENCY_MAX_BIT + 1)) {
+		return PHP_SSH2_LATENCY_BUCKETS - 1;
+	}
+	while (usec >> (bit + 1)) {
+		bit++;
+	}
+
+	return PHP_SSH2_LATENCY_SUB + (bit - PHP_SSH2_LATENCY_SUB_BITS) * PHP_SSH2_LATENCY_SUB +
+		(int)(usec >> (bit - PHP_SSH2_LATENCY_SUB_BITS)) - PHP_SSH2_LATENCY_SUB;
+}
+/* }}} */
+
+/* {{{ php_ssh2_latency_bucket_max
+ * Highest value in microseconds which lands in bucket
+ */
+static php_ssh2_uint64 php_ssh2_latency_bucket_max(int bucket)
+{
+	int shift;
+
+	if (bucket < PHP_SSH2_LATENCY_SUB) {
+		return bucket;
+	}
+	shift = (bucket - PHP_SSH2_LATENCY_SUB) / PHP_SSH2_LATENCY_SUB;
+
+	return ((php_ssh2_uint64)(PHP_SSH2_LATENCY_SUB + (bucket % PHP_SSH2_LATENCY_SUB) + 1) << shift) - 1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_latency_record
+ * Record the time since started (php_ssh2_comp_clock()) into histogram (PHP_SSH2_LATENCY_*)
+ */
+void php_ssh2_latency_record(int histogram, double started TSRMLS_DC)
+{
+	php_ssh2_latency *latency = SSH2_G(latency)[histogram];
+	double elapsed = php_ssh2_comp_clock() - started;
+
+	if (!latency) {
+		latency = SSH2_G(latency)[histogram] = pecalloc(1, sizeof(php_ssh2_latency), 1);
+	}
+	if (elapsed < 0) {
+		/* Wall clock stepped back */
+		elapsed = 0;
+	}
+
+	if (!latency->count || elapsed < latency->min) {
+		latency->min = elapsed;
+	}
+	if (elapsed > latency->max) {
+		latency->max = elapsed;
+	}
+	latency->count++;
+	latency->sum += elapsed;
+	latency->buckets[php_ssh2_latency_bucket((php_ssh2_uint64)(elapsed * 1000.0))]++;
+}
+/* }}} */
+
+/* {{{ php_ssh2_latency_percentile
+ * Milliseconds percentile percent of the recorded values stayed at or below
+ */
+static double php_ssh2_latency_percentile(php_ssh2_latency *latency, double percent)
+{
+	long rank, seen = 0;
+	int i;
+
+	if (percent <= 0) {
+		return latency->min;
+	}
+	if (percent >= 100) {
+		return latency->max;
+	}
+
+	rank = (long)(percent / 100.0 * latency->count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+	for(i = 0; i < PHP_SSH2_LATENCY_BUCKETS; i++) {
+		seen += latency->buckets[i];
+		if (seen >= rank) {
+			double value = php_ssh2_latency_bucket_max(i) / 1000.0;
+
+			/* The bucket is wider than what was actually seen at either end */
+			return value > latency->max ? latency->max : (value < latency->min ? latency->min : value);
+		}
+	}
+
+	return latency->max;
+}
+/* }}} */
+
+/* {{{ php_ssh2_latency_lookup
+ * Histogram index by name, -1 if there is no such histogram
+ */
+static int php_ssh2_latency_lookup(char *name)
+{
+	int i;
+
+	for(i = 0; i < PHP_SSH2_LATENCY_COUNT; i++) {
+		if (strcmp(php_ssh2_latency_names[i], name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_latency_free
+ */
+void php_ssh2_latency_free(php_ssh2_latency **latency)
+{
+	int i;
+
+	for(i = 0; i < PHP_SSH2_LATENCY_COUNT; i++) {
+		if (latency[i]) {
+			pefree(latency[i], 1);
+			latency[i] = NULL;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ proto array ssh2_latency_stats([array percentiles[, string name]])
+ * count, min, max, mean and the requested percentiles (50, 90, 99 and 99.9 by default) in milliseconds
+ * for every operation recorded so far in this process, or just for name
+ */
+PHP_FUNCTION(ssh2_latency_stats)
+{
+	zval *zpercentiles = NULL, **zpercent;
+	char *name = NULL;
+	int name_len, i, first = 0, last = PHP_SSH2_LATENCY_COUNT - 1;
+	static double default_percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a!s", &zpercentiles, &name, &name_len) == FAILURE) {
+		return;
+	}
+
+	if (name) {
+		if ((first = last = php_ssh2_latency_lookup(name)) < 0) {
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unknown operation '%s'", name);
+			RETURN_FALSE;
+		}
+	}
+
+	array_init(return_value);
+	for(i = first; i <= last; i++) {
+		php_ssh2_latency *latency = SSH2_G(latency)[i];
+		zval *entry, *percentiles;
+
+		if (!latency || !latency->count) {
+			continue;
+		}
+
+		MAKE_STD_ZVAL(entry);
+		array_init(entry);
+		add_assoc_long(entry, "count", latency->count);
+		add_assoc_double(entry, "min", latency->min);
+		add_assoc_double(entry, "max", latency->max);
+		add_assoc_double(entry, "mean", latency->sum / latency->count);
+
+		MAKE_STD_ZVAL(percentiles);
+		array_init(percentiles);
+		if (zpercentiles) {
+			for(zend_hash_internal_pointer_reset(Z_ARRVAL_P(zpercentiles));
+				zend_hash_get_current_data(Z_ARRVAL_P(zpercentiles), (void**)&zpercent) == SUCCESS;
+				zend_hash_move_forward(Z_ARRVAL_P(zpercentiles))) {
+				zval tmp = **zpercent;
+				char key[32];
+
+				zval_copy_ctor(&tmp);
+				convert_to_double(&tmp);
+				snprintf(key, sizeof(key), "%g", Z_DVAL(tmp));
+				add_assoc_double(percentiles, key, php_ssh2_latency_percentile(latency, Z_DVAL(tmp)));
+			}
+		} else {
+			int j;
+
+			for(j = 0; j < sizeof(default_percentiles) / sizeof(default_percentiles[0]); j++) {
+				char key[32];
+
+				snprintf(key, sizeof(key), "%g", default_percentiles[j]);
+				add_assoc_double(percentiles, key, php_ssh2_latency_percentile(latency, default_percentiles[j]));
+			}
+		}
+		add_assoc_zval(entry, "percentiles", percentiles);
+
+		add_assoc_zval(return_value, php_ssh2_latency_names[i], entry);
+	}
+}
+/* }}} */
+
+/* {{{ proto bool ssh2_latency_reset([string name])
+ * Forget what was recorded for name, or for every operation
+ */
+PHP_FUNCTION(ssh2_latency_reset)
+{
+	char *name = NULL;
+	int name_len, i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|s", &name, &name_len) == FAILURE) {
+		return;
+	}
+
+	if (!name) {
+		php_ssh2_latency_free(SSH2_G(latency));
+		RETURN_TRUE;
+	}
+
+	if ((i = php_ssh2_latency_lookup(name)) < 0) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unknown operation '%s'", name);
+		RETURN_FALSE;
+	}
+	if (SSH2_G(latency)[i]) {
+		pefree(SSH2_G(latency)[i], 1);
+		SSH2_G(latency)[i] = NULL;
+	}
+
+	RETURN_TRUE;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ */
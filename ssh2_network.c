@@ -0,0 +1,871 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+#include "main/php_network.h"
+
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#elif defined(HAVE_SYS_TIME_H)
+# include <sys/time.h>
+#endif
+
+#ifndef PHP_WIN32
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#endif
+
+#if PHP_MAJOR_VERSION > 5 || (PHP_MAJOR_VERSION == 5 && PHP_MINOR_VERSION > 0)
+# define PHP_SSH2_OWN_CONNECT	1
+#endif
+
+/* {{{ php_ssh2_connect_now
+ * Wall clock in milliseconds
+ */
+static double php_ssh2_connect_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+/* }}} */
+
+/* ******************
+   * Resolver Cache *
+   ****************** */
+
+/* Lookups are cached per process (per thread under ZTS) in SSH2_G(dns_cache), keyed by hostname
+ * getaddrinfo() does not hand out the record TTL so entries live for ssh2.dns_cache_ttl seconds,
+ * failed lookups for ssh2.dns_cache_negative_ttl seconds
+ */
+
+typedef struct _php_ssh2_dns_entry {
+	time_t expires;
+	int num_addrs;
+	php_sockaddr_storage *addrs;
+
+	/* Negative entries keep the resolver's complaint */
+	char *error;
+} php_ssh2_dns_entry;
+
+#ifdef PHP_SSH2_OWN_CONNECT
+/* {{{ php_ssh2_sockaddr_len
+ */
+static socklen_t php_ssh2_sockaddr_len(struct sockaddr *sa)
+{
+#ifdef HAVE_IPV6
+	if (sa->sa_family == AF_INET6) {
+		return sizeof(struct sockaddr_in6);
+	}
+#endif
+	return sizeof(struct sockaddr_in);
+}
+/* }}} */
+#endif
+
+/* {{{ php_ssh2_dns_entry_dtor
+ */
+void php_ssh2_dns_entry_dtor(void *pDest)
+{
+	php_ssh2_dns_entry *entry = (php_ssh2_dns_entry*)pDest;
+
+	if (entry->addrs) {
+		pefree(entry->addrs, 1);
+	}
+	if (entry->error) {
+		pefree(entry->error, 1);
+	}
+}
+/* }}} */
+
+#ifdef PHP_SSH2_OWN_CONNECT
+/* {{{ php_ssh2_dns_evict
+ * Make room for one more entry, dropping whatever expires first
+ */
+static void php_ssh2_dns_evict(TSRMLS_D)
+{
+	HashTable *cache = &SSH2_G(dns_cache);
+	HashPosition pos;
+	php_ssh2_dns_entry *entry;
+	char *key, *victim = NULL;
+	uint key_len, victim_len = 0;
+	ulong index;
+	time_t oldest = 0;
+
+	for(zend_hash_internal_pointer_reset_ex(cache, &pos);
+		zend_hash_get_current_data_ex(cache, (void**)&entry, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(cache, &pos)) {
+		if (zend_hash_get_current_key_ex(cache, &key, &key_len, &index, 0, &pos) != HASH_KEY_IS_STRING) {
+			continue;
+		}
+		if (!victim || entry->expires < oldest) {
+			victim = key;
+			victim_len = key_len;
+			oldest = entry->expires;
+		}
+	}
+
+	if (victim) {
+		zend_hash_del(cache, victim, victim_len);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_dns_copy
+ * Hand out a cached entry in the same shape php_network_getaddresses() produces
+ */
+static int php_ssh2_dns_copy(php_ssh2_dns_entry *entry, struct sockaddr ***sal, char **error)
+{
+	int i;
+
+	if (!entry->num_addrs) {
+		*error = estrdup(entry->error ? entry->error : "Unable to resolve host");
+		return 0;
+	}
+
+	*sal = safe_emalloc(entry->num_addrs + 1, sizeof(struct sockaddr*), 0);
+	for(i = 0; i < entry->num_addrs; i++) {
+		(*sal)[i] = emalloc(sizeof(php_sockaddr_storage));
+		memcpy((*sal)[i], &entry->addrs[i], sizeof(php_sockaddr_storage));
+	}
+	(*sal)[i] = NULL;
+
+	return entry->num_addrs;
+}
+/* }}} */
+
+/* {{{ php_ssh2_resolve
+ * Resolve host through the cache, the result is freed with php_network_freeaddresses()
+ * Returns the number of addresses, 0 with *error set on failure
+ */
+int php_ssh2_resolve(char *host, struct sockaddr ***sal, char **error TSRMLS_DC)
+{
+	HashTable *cache = &SSH2_G(dns_cache);
+	php_ssh2_dns_entry *found, entry;
+	int host_len = strlen(host), n, i;
+	time_t now;
+
+	*error = NULL;
+	if (SSH2_G(dns_cache_size) <= 0) {
+		return php_network_getaddresses(host, SOCK_STREAM, sal, error TSRMLS_CC);
+	}
+
+	now = time(NULL);
+	if (zend_hash_find(cache, host, host_len + 1, (void**)&found) == SUCCESS) {
+		if (found->expires > now) {
+			SSH2_G(dns_cache_hits)++;
+			return php_ssh2_dns_copy(found, sal, error);
+		}
+		zend_hash_del(cache, host, host_len + 1);
+	}
+	SSH2_G(dns_cache_misses)++;
+
+	n = php_network_getaddresses(host, SOCK_STREAM, sal, error TSRMLS_CC);
+
+	memset(&entry, 0, sizeof(entry));
+	if (n > 0) {
+		entry.expires = now + SSH2_G(dns_cache_ttl);
+		entry.num_addrs = n;
+		entry.addrs = pemalloc(n * sizeof(php_sockaddr_storage), 1);
+		for(i = 0; i < n; i++) {
+			memcpy(&entry.addrs[i], (*sal)[i], php_ssh2_sockaddr_len((*sal)[i]));
+		}
+	} else {
+		if (SSH2_G(dns_cache_negative_ttl) <= 0) {
+			return n;
+		}
+		entry.expires = now + SSH2_G(dns_cache_negative_ttl);
+		entry.error = *error ? pestrdup(*error, 1) : NULL;
+	}
+
+	while (zend_hash_num_elements(cache) >= (uint)SSH2_G(dns_cache_size)) {
+		php_ssh2_dns_evict(TSRMLS_C);
+	}
+	zend_hash_update(cache, host, host_len + 1, &entry, sizeof(entry), NULL);
+
+	return n;
+}
+/* }}} */
+#endif
+
+/* ******************
+   * Happy Eyeballs *
+   ****************** */
+
+/* Addresses are tried alternating between families (RFC 8305), starting with whichever family
+ * last won for this host, IPv6 when we have not connected to it before
+ * Blocking connects race: a new attempt starts every ssh2.connect_attempt_delay milliseconds
+ * (or as soon as one fails) while earlier attempts keep going, the first to complete wins
+ * The winning family is remembered per host in SSH2_G(family_cache)
+ */
+
+#ifdef PHP_SSH2_OWN_CONNECT
+/* {{{ php_ssh2_family_remember
+ */
+static void php_ssh2_family_remember(char *host, int family TSRMLS_DC)
+{
+	HashTable *cache = &SSH2_G(family_cache);
+	long limit = SSH2_G(dns_cache_size) > 0 ? SSH2_G(dns_cache_size) : PHP_SSH2_FAMILY_CACHE_SIZE;
+
+	if (zend_hash_num_elements(cache) >= (uint)limit && !zend_hash_exists(cache, host, strlen(host) + 1)) {
+		/* Only a hint, cheaper to start over than to track age */
+		zend_hash_clean(cache);
+	}
+	zend_hash_update(cache, host, strlen(host) + 1, &family, sizeof(int), NULL);
+}
+/* }}} */
+
+/* {{{ php_ssh2_family_order
+ * Interleave the address families in place, preferred family first
+ */
+static void php_ssh2_family_order(char *host, struct sockaddr **sal, int n TSRMLS_DC)
+{
+	struct sockaddr **first, **second;
+	int *preferred, family, num_first = 0, num_second = 0, i, j;
+
+#ifdef HAVE_IPV6
+	family = AF_INET6;
+#else
+	family = AF_INET;
+#endif
+	if (zend_hash_find(&SSH2_G(family_cache), host, strlen(host) + 1, (void**)&preferred) == SUCCESS) {
+		family = *preferred;
+	}
+
+	first = safe_emalloc(n, sizeof(struct sockaddr*), 0);
+	second = safe_emalloc(n, sizeof(struct sockaddr*), 0);
+	for(i = 0; i < n; i++) {
+		if (sal[i]->sa_family == family) {
+			first[num_first++] = sal[i];
+		} else {
+			second[num_second++] = sal[i];
+		}
+	}
+
+	for(i = 0, j = 0; i < num_first || j < num_second; ) {
+		if (i < num_first) {
+			*sal++ = first[i++];
+		}
+		if (j < num_second) {
+			*sal++ = second[j++];
+		}
+	}
+
+	efree(first);
+	efree(second);
+}
+/* }}} */
+
+/* {{{ php_ssh2_connect_race
+ * Staggered parallel connects over the (already ordered) addresses, returns the winning socket in blocking mode
+ */
+static int php_ssh2_connect_race(struct sockaddr **sal, int n, struct timeval *timeout, char **error TSRMLS_DC)
+{
+	php_pollfd *pollfds;
+	int num_inflight = 0, next = 0, winner = -1, i;
+	double now = php_ssh2_connect_now(), deadline = -1, next_attempt = now;
+
+	if (timeout) {
+		deadline = now + timeout->tv_sec * 1000.0 + timeout->tv_usec / 1000.0;
+	}
+	pollfds = safe_emalloc(n, sizeof(php_pollfd), 0);
+
+	while (winner < 0) {
+		double wait = -1;
+		int sock, rc;
+
+		if (next < n && (!num_inflight || now >= next_attempt)) {
+			struct sockaddr *sa = sal[next++];
+
+			next_attempt = now + SSH2_G(connect_attempt_delay);
+
+			sock = socket(sa->sa_family, SOCK_STREAM, 0);
+			if (sock == SOCK_ERR) {
+				continue;
+			}
+			php_set_sock_blocking(sock, 0 TSRMLS_CC);
+
+			if (connect(sock, sa, php_ssh2_sockaddr_len(sa)) == 0) {
+				winner = sock;
+				break;
+			}
+			rc = php_socket_errno();
+			if (rc != EINPROGRESS && rc != EWOULDBLOCK) {
+				if (*error) {
+					efree(*error);
+				}
+				*error = php_socket_strerror(rc, NULL, 0);
+				closesocket(sock);
+				/* Failed straight away, no reason to hold back the next one */
+				next_attempt = now;
+				continue;
+			}
+
+			pollfds[num_inflight].fd = sock;
+			pollfds[num_inflight].events = POLLOUT;
+			pollfds[num_inflight].revents = 0;
+			num_inflight++;
+		}
+
+		if (!num_inflight) {
+			if (next >= n) {
+				break;
+			}
+			continue;
+		}
+
+		if (deadline >= 0) {
+			if (now >= deadline) {
+				if (*error) {
+					efree(*error);
+				}
+				*error = estrdup("Connection timed out");
+				break;
+			}
+			wait = deadline - now;
+		}
+		if (next < n && (wait < 0 || next_attempt - now < wait)) {
+			wait = next_attempt > now ? next_attempt - now : 0;
+		}
+
+		if (php_poll2(pollfds, num_inflight, (int)wait) > 0) {
+			for(i = 0; i < num_inflight; i++) {
+				int so_error = 0;
+				socklen_t so_error_len = sizeof(so_error);
+
+				if (!pollfds[i].revents) {
+					continue;
+				}
+				if (getsockopt(pollfds[i].fd, SOL_SOCKET, SO_ERROR, (char*)&so_error, &so_error_len) == 0 && !so_error) {
+					winner = pollfds[i].fd;
+					pollfds[i--] = pollfds[--num_inflight];
+					break;
+				}
+
+				if (*error) {
+					efree(*error);
+				}
+				*error = php_socket_strerror(so_error ? so_error : php_socket_errno(), NULL, 0);
+				closesocket(pollfds[i].fd);
+				pollfds[i--] = pollfds[--num_inflight];
+				next_attempt = now;
+			}
+		}
+		now = php_ssh2_connect_now();
+	}
+
+	/* Losers and leftovers */
+	for(i = 0; i < num_inflight; i++) {
+		closesocket(pollfds[i].fd);
+	}
+	efree(pollfds);
+
+	if (winner >= 0) {
+		php_set_sock_blocking(winner, 1 TSRMLS_CC);
+		if (*error) {
+			efree(*error);
+			*error = NULL;
+		}
+	}
+
+	return winner;
+}
+/* }}} */
+
+/* {{{ php_ssh2_connect_sequential
+ * One address after the other, each getting the full timeout
+ */
+static int php_ssh2_connect_sequential(struct sockaddr **sal, int n, int asynchronous, struct timeval *timeout, char **error TSRMLS_DC)
+{
+	int sock = -1, i;
+
+	for(i = 0; i < n; i++) {
+		struct sockaddr *sa = sal[i];
+
+		sock = socket(sa->sa_family, SOCK_STREAM, 0);
+		if (sock == SOCK_ERR) {
+			sock = -1;
+			continue;
+		}
+
+		if (*error) {
+			efree(*error);
+			*error = NULL;
+		}
+		if (php_network_connect_socket(sock, sa, php_ssh2_sockaddr_len(sa), asynchronous, timeout, error, NULL) == 0) {
+			break;
+		}
+
+		closesocket(sock);
+		sock = -1;
+	}
+
+	return sock;
+}
+/* }}} */
+#endif
+
+/* ***********
+   * Connect *
+   *********** */
+
+/* {{{ php_ssh2_connect_socket
+ * Connect a TCP socket to host, see Happy Eyeballs above for the order addresses are tried in
+ * With asynchronous set the connect may still be in progress when the socket is returned,
+ * there is no racing then and the first address that does not fail straight away is used
+ * Returns -1 and sets *error on failure
+ */
+int php_ssh2_connect_socket(char *host, int port, int asynchronous, struct timeval *timeout, char **error TSRMLS_DC)
+{
+#ifdef PHP_SSH2_OWN_CONNECT
+	struct sockaddr **sal;
+	int sock = -1, n = 0, i;
+
+	*error = NULL;
+	if (php_ssh2_resolve(host, &sal, error TSRMLS_CC) <= 0) {
+		return -1;
+	}
+
+	/* Drop anything we can not connect to and fill in the port */
+	for(i = 0; sal[i]; i++) {
+		struct sockaddr *sa = sal[i];
+
+		switch (sa->sa_family) {
+#ifdef HAVE_IPV6
+			case AF_INET6:
+				((struct sockaddr_in6*)sa)->sin6_port = htons(port);
+				sal[n++] = sa;
+				break;
+#endif
+			case AF_INET:
+				((struct sockaddr_in*)sa)->sin_port = htons(port);
+				sal[n++] = sa;
+				break;
+			default:
+				efree(sa);
+		}
+	}
+	sal[n] = NULL;
+
+	if (n) {
+		php_ssh2_family_order(host, sal, n TSRMLS_CC);
+
+		if (!asynchronous && n > 1 && SSH2_G(connect_attempt_delay) > 0) {
+			sock = php_ssh2_connect_race(sal, n, timeout, error TSRMLS_CC);
+		} else {
+			sock = php_ssh2_connect_sequential(sal, n, asynchronous, timeout, error TSRMLS_CC);
+		}
+	}
+
+	if (sock >= 0 && !asynchronous) {
+		php_sockaddr_storage sa;
+		socklen_t sa_len = sizeof(sa);
+
+		if (getpeername(sock, (struct sockaddr*)&sa, &sa_len) == 0) {
+			php_ssh2_family_remember(host, ((struct sockaddr*)&sa)->sa_family TSRMLS_CC);
+		}
+	}
+	php_network_freeaddresses(sal);
+
+	if (sock < 0 && !*error) {
+		spprintf(error, 0, "Unable to connect to %s on port %d", host, port);
+	}
+
+	return sock;
+#else
+	int sock;
+
+	*error = NULL;
+# if PHP_MAJOR_VERSION == 5
+	sock = php_network_connect_socket_to_host(host, port, SOCK_STREAM, asynchronous, timeout, error, NULL TSRMLS_CC);
+# else
+	sock = php_hostconnect(host, port, SOCK_STREAM, timeout TSRMLS_CC);
+# endif
+	if (sock <= 0 && !*error) {
+		spprintf(error, 0, "Unable to connect to %s on port %d", host, port);
+	}
+
+	return sock <= 0 ? -1 : sock;
+#endif
+}
+/* }}} */
+
+/* *******************
+   * Circuit Breaker *
+   ******************* */
+
+/* Hosts which fail to connect or complete the handshake are tracked per process in SSH2_G(breakers), keyed "host:port"
+ *
+ *   closed     connects go ahead, ssh2.breaker_threshold failures in a row open the circuit
+ *   open       connects fail immediately until the backoff (ssh2.breaker_backoff, doubling up to
+ *              ssh2.breaker_backoff_max milliseconds) has passed
+ *   half-open  a single trial connect goes ahead, success closes the circuit, failure opens it again
+ *
+ * Hosts only have an entry while they are failing, a successful connect removes it
+ * Authentication failures say nothing about the host's health and are not counted
+ * At most PHP_SSH2_BREAKER_CACHE_SIZE hosts are tracked, a full table first forgets hosts whose circuit
+ * is closed or whose open window has passed, hosts failing beyond that go untracked until there is room
+ */
+
+#define PHP_SSH2_BREAKER_CLOSED		0
+#define PHP_SSH2_BREAKER_OPEN		1
+#define PHP_SSH2_BREAKER_HALF_OPEN	2
+
+typedef struct _php_ssh2_breaker {
+	int state;
+	long failures;
+	long backoff;
+	long opened;
+	double retry_at;
+	double trial_started;
+} php_ssh2_breaker;
+
+/* {{{ php_ssh2_breaker_key
+ * 0 when host:port doesn't fit, such hosts are never tracked
+ */
+static int php_ssh2_breaker_key(char *key, int key_size, char *host, int port)
+{
+	int key_len = snprintf(key, key_size, "%s:%d", host, port);
+
+	return (key_len > 0 && key_len < key_size) ? key_len + 1 : 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_breaker_expired
+ * zend_hash_apply_with_argument() callback, *argument is the current time
+ */
+static int php_ssh2_breaker_expired(void *pDest, void *argument TSRMLS_DC)
+{
+	php_ssh2_breaker *breaker = (php_ssh2_breaker*)pDest;
+
+	if (breaker->state == PHP_SSH2_BREAKER_CLOSED ||
+		(breaker->state == PHP_SSH2_BREAKER_OPEN && *(double*)argument >= breaker->retry_at)) {
+		return ZEND_HASH_APPLY_REMOVE;
+	}
+
+	return ZEND_HASH_APPLY_KEEP;
+}
+/* }}} */
+
+/* {{{ php_ssh2_breaker_allow
+ * May we try to connect to host:port? FAILURE (with *error set) means the circuit is open
+ */
+int php_ssh2_breaker_allow(char *host, int port, char **error TSRMLS_DC)
+{
+	php_ssh2_breaker *breaker;
+	char key[1024];
+	int key_len;
+	double now;
+
+	if (SSH2_G(breaker_threshold) <= 0) {
+		return SUCCESS;
+	}
+
+	key_len = php_ssh2_breaker_key(key, sizeof(key), host, port);
+	if (!key_len || zend_hash_find(&SSH2_G(breakers), key, key_len, (void**)&breaker) == FAILURE) {
+		return SUCCESS;
+	}
+
+	now = php_ssh2_connect_now();
+	switch (breaker->state) {
+		case PHP_SSH2_BREAKER_OPEN:
+			if (now >= breaker->retry_at) {
+				breaker->state = PHP_SSH2_BREAKER_HALF_OPEN;
+				breaker->trial_started = now;
+				return SUCCESS;
+			}
+			break;
+		case PHP_SSH2_BREAKER_HALF_OPEN:
+			/* A trial which never reported back (session freed mid connect) does not block forever */
+			if (now - breaker->trial_started >= breaker->backoff) {
+				breaker->trial_started = now;
+				return SUCCESS;
+			}
+			break;
+		default:
+			return SUCCESS;
+	}
+
+	SSH2_G(breaker_fast_failures)++;
+	if (error) {
+		spprintf(error, 0, "Circuit open for %s after %ld failures, retrying in %ld ms", key, breaker->failures,
+				 breaker->retry_at > now ? (long)(breaker->retry_at - now) : 0);
+	}
+	return FAILURE;
+}
+/* }}} */
+
+/* {{{ php_ssh2_breaker_record
+ * Report how connecting to host:port went
+ */
+void php_ssh2_breaker_record(char *host, int port, int success TSRMLS_DC)
+{
+	php_ssh2_breaker *breaker, new_breaker;
+	char key[1024];
+	int key_len;
+
+	if (SSH2_G(breaker_threshold) <= 0) {
+		return;
+	}
+
+	key_len = php_ssh2_breaker_key(key, sizeof(key), host, port);
+	if (!key_len) {
+		return;
+	}
+	if (success) {
+		zend_hash_del(&SSH2_G(breakers), key, key_len);
+		return;
+	}
+
+	if (zend_hash_find(&SSH2_G(breakers), key, key_len, (void**)&breaker) == FAILURE) {
+		if (zend_hash_num_elements(&SSH2_G(breakers)) >= PHP_SSH2_BREAKER_CACHE_SIZE) {
+			double now = php_ssh2_connect_now();
+
+			zend_hash_apply_with_argument(&SSH2_G(breakers), php_ssh2_breaker_expired, &now TSRMLS_CC);
+			if (zend_hash_num_elements(&SSH2_G(breakers)) >= PHP_SSH2_BREAKER_CACHE_SIZE) {
+				return;
+			}
+		}
+		memset(&new_breaker, 0, sizeof(new_breaker));
+		zend_hash_update(&SSH2_G(breakers), key, key_len, &new_breaker, sizeof(new_breaker), (void**)&breaker);
+	}
+	breaker->failures++;
+
+	if (breaker->state == PHP_SSH2_BREAKER_HALF_OPEN) {
+		breaker->backoff *= 2;
+		if (breaker->backoff > SSH2_G(breaker_backoff_max)) {
+			breaker->backoff = SSH2_G(breaker_backoff_max);
+		}
+	} else if (breaker->state == PHP_SSH2_BREAKER_CLOSED && breaker->failures >= SSH2_G(breaker_threshold)) {
+		breaker->backoff = SSH2_G(breaker_backoff);
+	} else {
+		return;
+	}
+
+	breaker->state = PHP_SSH2_BREAKER_OPEN;
+	breaker->retry_at = php_ssh2_connect_now() + breaker->backoff;
+	breaker->opened++;
+}
+/* }}} */
+
+/* {{{ proto array ssh2_breaker_stats()
+ * State of every host the circuit breaker is tracking, keyed "host:port"
+ */
+PHP_FUNCTION(ssh2_breaker_stats)
+{
+	HashTable *breakers = &SSH2_G(breakers);
+	HashPosition pos;
+	php_ssh2_breaker *breaker;
+	double now = php_ssh2_connect_now();
+	char *key;
+	uint key_len;
+	ulong index;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "") == FAILURE) {
+		return;
+	}
+
+	array_init(return_value);
+	for(zend_hash_internal_pointer_reset_ex(breakers, &pos);
+		zend_hash_get_current_data_ex(breakers, (void**)&breaker, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(breakers, &pos)) {
+		zval *entry;
+
+		if (zend_hash_get_current_key_ex(breakers, &key, &key_len, &index, 0, &pos) != HASH_KEY_IS_STRING) {
+			continue;
+		}
+
+		MAKE_STD_ZVAL(entry);
+		array_init(entry);
+		switch (breaker->state) {
+			case PHP_SSH2_BREAKER_OPEN:
+				add_assoc_string(entry, "state", "open", 1);
+				break;
+			case PHP_SSH2_BREAKER_HALF_OPEN:
+				add_assoc_string(entry, "state", "half-open", 1);
+				break;
+			default:
+				add_assoc_string(entry, "state", "closed", 1);
+		}
+		add_assoc_long(entry, "failures", breaker->failures);
+		add_assoc_long(entry, "opened", breaker->opened);
+		add_assoc_long(entry, "backoff", breaker->backoff);
+		add_assoc_long(entry, "retry_in", breaker->state == PHP_SSH2_BREAKER_OPEN && breaker->retry_at > now ? (long)(breaker->retry_at - now) : 0);
+		add_assoc_zval_ex(return_value, key, key_len, entry);
+	}
+}
+/* }}} */
+
+/* ******************
+   * Socket Options *
+   ****************** */
+
+/* Read from the 'socket' entry of the methods array (or the "socket" option of the ssh2 stream context):
+ *
+ *   tcp_nodelay     bool    disable Nagle, for interactive shell/exec traffic
+ *   sndbuf, rcvbuf  int     SO_SNDBUF/SO_RCVBUF in bytes, for bulk transfers on long fat links
+ *   keepalive       bool    SO_KEEPALIVE
+ *   keepidle, keepintvl, keepcnt   int   TCP keepalive probe tuning (seconds, seconds, count)
+ *   user_timeout    int     TCP_USER_TIMEOUT in milliseconds (Linux)
+ *   tos             int     IP_TOS / IPV6_TCLASS
+ *
+ * Parsing and applying are kept apart so the handshake threads can apply without touching zvals
+ */
+
+/* {{{ php_ssh2_sockopts_long
+ * Anything but a number from 0 to INT_MAX is refused with a warning and leaves the option alone
+ */
+static void php_ssh2_sockopts_long(HashTable *ht, char *name, int name_size, int *value TSRMLS_DC)
+{
+	zval **zvalue, tmp;
+
+	if (zend_hash_find(ht, name, name_size, (void**)&zvalue) == FAILURE || !zvalue || !*zvalue || Z_TYPE_PP(zvalue) == IS_NULL) {
+		return;
+	}
+	switch (Z_TYPE_PP(zvalue)) {
+		case IS_LONG:
+		case IS_DOUBLE:
+		case IS_BOOL:
+			break;
+		case IS_STRING:
+			if (is_numeric_string(Z_STRVAL_PP(zvalue), Z_STRLEN_PP(zvalue), NULL, NULL, 0)) {
+				break;
+			}
+			/* fall through */
+		default:
+			php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid value for socket option %s, expecting a non-negative integer", name);
+			return;
+	}
+	tmp = **zvalue;
+	zval_copy_ctor(&tmp);
+	convert_to_long(&tmp);
+	if (Z_LVAL(tmp) < 0 || Z_LVAL(tmp) > INT_MAX) {
+		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Invalid value for socket option %s, expecting a non-negative integer", name);
+		return;
+	}
+	*value = Z_LVAL(tmp);
+}
+/* }}} */
+
+/* {{{ php_ssh2_sockopts_parse
+ * Fill opts from methods['socket'], anything not given is left at -1
+ */
+void php_ssh2_sockopts_parse(zval *methods, php_ssh2_sockopts *opts TSRMLS_DC)
+{
+	zval **socket;
+	HashTable *ht;
+
+	memset(opts, -1, sizeof(php_ssh2_sockopts));
+	if (!methods || Z_TYPE_P(methods) != IS_ARRAY ||
+		zend_hash_find(Z_ARRVAL_P(methods), "socket", sizeof("socket"), (void**)&socket) == FAILURE ||
+		!socket || !*socket || Z_TYPE_PP(socket) != IS_ARRAY) {
+		return;
+	}
+	ht = Z_ARRVAL_PP(socket);
+
+	php_ssh2_sockopts_long(ht, "tcp_nodelay", sizeof("tcp_nodelay"), &opts->tcp_nodelay TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "sndbuf", sizeof("sndbuf"), &opts->sndbuf TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "rcvbuf", sizeof("rcvbuf"), &opts->rcvbuf TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "keepalive", sizeof("keepalive"), &opts->keepalive TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "keepidle", sizeof("keepidle"), &opts->keepidle TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "keepintvl", sizeof("keepintvl"), &opts->keepintvl TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "keepcnt", sizeof("keepcnt"), &opts->keepcnt TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "user_timeout", sizeof("user_timeout"), &opts->user_timeout TSRMLS_CC);
+	php_ssh2_sockopts_long(ht, "tos", sizeof("tos"), &opts->tos TSRMLS_CC);
+}
+/* }}} */
+
+#define PHP_SSH2_SETSOCKOPT(level, name, value) \
+	if ((value) >= 0 && setsockopt(sock, (level), (name), (char*)&(value), sizeof(value)) != 0) { \
+		return #name; \
+	}
+
+/* {{{ php_ssh2_sockopts_apply
+ * Returns NULL on success or the name of the option the socket refused
+ * Options the platform does not know about are skipped silently
+ */
+const char *php_ssh2_sockopts_apply(int sock, php_ssh2_sockopts *opts)
+{
+	int value;
+
+	if (opts->tcp_nodelay >= 0) {
+		value = opts->tcp_nodelay ? 1 : 0;
+		PHP_SSH2_SETSOCKOPT(IPPROTO_TCP, TCP_NODELAY, value);
+	}
+	PHP_SSH2_SETSOCKOPT(SOL_SOCKET, SO_SNDBUF, opts->sndbuf);
+	PHP_SSH2_SETSOCKOPT(SOL_SOCKET, SO_RCVBUF, opts->rcvbuf);
+	if (opts->keepalive >= 0) {
+		value = opts->keepalive ? 1 : 0;
+		PHP_SSH2_SETSOCKOPT(SOL_SOCKET, SO_KEEPALIVE, value);
+	}
+#ifdef TCP_KEEPIDLE
+	PHP_SSH2_SETSOCKOPT(IPPROTO_TCP, TCP_KEEPIDLE, opts->keepidle);
+#elif defined(TCP_KEEPALIVE)
+	/* Darwin spells it differently */
+	PHP_SSH2_SETSOCKOPT(IPPROTO_TCP, TCP_KEEPALIVE, opts->keepidle);
+#endif
+#ifdef TCP_KEEPINTVL
+	PHP_SSH2_SETSOCKOPT(IPPROTO_TCP, TCP_KEEPINTVL, opts->keepintvl);
+#endif
+#ifdef TCP_KEEPCNT
+	PHP_SSH2_SETSOCKOPT(IPPROTO_TCP, TCP_KEEPCNT, opts->keepcnt);
+#endif
+#ifdef TCP_USER_TIMEOUT
+	PHP_SSH2_SETSOCKOPT(IPPROTO_TCP, TCP_USER_TIMEOUT, opts->user_timeout);
+#endif
+	if (opts->tos >= 0) {
+		php_sockaddr_storage sa;
+		socklen_t sa_len = sizeof(sa);
+
+		if (getsockname(sock, (struct sockaddr*)&sa, &sa_len) != 0) {
+			return "IP_TOS";
+		}
+#if defined(HAVE_IPV6) && defined(IPV6_TCLASS)
+		if (((struct sockaddr*)&sa)->sa_family == AF_INET6) {
+			PHP_SSH2_SETSOCKOPT(IPPROTO_IPV6, IPV6_TCLASS, opts->tos);
+		} else
+#endif
+		{
+#ifdef IP_TOS
+			PHP_SSH2_SETSOCKOPT(IPPROTO_IP, IP_TOS, opts->tos);
+#endif
+		}
+	}
+
+	return NULL;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
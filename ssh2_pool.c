@@ -0,0 +1,819 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+#include "main/php_network.h"
+
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#elif defined(HAVE_SYS_TIME_H)
+# include <sys/time.h>
+#endif
+
+/* Idle sessions live in EG(persistent_list), one bucket per pool key:
+ *
+ *   "ssh2_pool:" host ":" port ":" username ":" method preferences ":" known_hosts policy
+ *
+ * Everything that only applies while a session is in use (timeouts, memory limit, keepalive,
+ * socket options) is set again by php_ssh2_session_reconfigure() when it is checked out.
+ *
+ * Each bucket holds a singly linked list of idle sessions, most recently used first.
+ * Sessions which are checked out are ordinary le_ssh2_session resources, their
+ * destructor hands them back through php_ssh2_pool_release().
+ */
+
+typedef struct _php_ssh2_pool_bucket {
+	php_ssh2_session_data *idle;
+	int num_idle;
+
+	char *host;
+	int port;
+} php_ssh2_pool_bucket;
+
+/* ***************
+   * Pool Keying *
+   *************** */
+
+/* {{{ php_ssh2_pool_key_method
+ */
+static void php_ssh2_pool_key_method(smart_str *key, HashTable *ht, char *method, int method_len)
+{
+	zval **value;
+
+	smart_str_appendc(key, ':');
+	if (zend_hash_find(ht, method, method_len + 1, (void**)&value) == SUCCESS &&
+		value && *value && Z_TYPE_PP(value) == IS_STRING) {
+		smart_str_appendl(key, Z_STRVAL_PP(value), Z_STRLEN_PP(value));
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_key_direction
+ */
+static void php_ssh2_pool_key_direction(smart_str *key, HashTable *ht, char *direction, int direction_len)
+{
+	zval **container;
+
+	if (zend_hash_find(ht, direction, direction_len + 1, (void**)&container) == SUCCESS &&
+		container && *container && Z_TYPE_PP(container) == IS_ARRAY) {
+		php_ssh2_pool_key_method(key, HASH_OF(*container), "crypt", sizeof("crypt") - 1);
+		php_ssh2_pool_key_method(key, HASH_OF(*container), "mac", sizeof("mac") - 1);
+		php_ssh2_pool_key_method(key, HASH_OF(*container), "comp", sizeof("comp") - 1);
+		php_ssh2_pool_key_method(key, HASH_OF(*container), "lang", sizeof("lang") - 1);
+	} else {
+		smart_str_appendl(key, "::::", sizeof("::::") - 1);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_key
+ * Build the key idle sessions are filed under
+ */
+void php_ssh2_pool_key(smart_str *key, char *host, int port, char *username, int username_len, zval *methods TSRMLS_DC)
+{
+	char *known_hosts;
+	int strict;
+
+	smart_str_appendl(key, "ssh2_pool:", sizeof("ssh2_pool:") - 1);
+	smart_str_appends(key, host);
+	smart_str_appendc(key, ':');
+	smart_str_append_long(key, port);
+	smart_str_appendc(key, ':');
+	if (username) {
+		smart_str_appendl(key, username, username_len);
+	}
+
+	if (methods) {
+		php_ssh2_pool_key_method(key, HASH_OF(methods), "kex", sizeof("kex") - 1);
+		php_ssh2_pool_key_method(key, HASH_OF(methods), "hostkey", sizeof("hostkey") - 1);
+		php_ssh2_pool_key_direction(key, HASH_OF(methods), "client_to_server", sizeof("client_to_server") - 1);
+		php_ssh2_pool_key_direction(key, HASH_OF(methods), "server_to_client", sizeof("server_to_client") - 1);
+	}
+
+	/* A session whose host key was never checked must not go to someone who wants it checked */
+	php_ssh2_known_hosts_policy(methods, &known_hosts, &strict TSRMLS_CC);
+	smart_str_appendc(key, ':');
+	if (known_hosts) {
+		smart_str_appendc(key, strict ? 's' : 'l');
+		smart_str_appends(key, known_hosts);
+	}
+	smart_str_0(key);
+}
+/* }}} */
+
+/* ********************
+   * Pool Maintenance *
+   ******************** */
+
+/* {{{ php_ssh2_pool_session_alive
+ * Cheap liveness check, a healthy idle connection has nothing to read
+ * If it is readable, it must not be EOF or in error
+ */
+static int php_ssh2_pool_session_alive(php_ssh2_session_data *data)
+{
+	int revents;
+	char c;
+
+	revents = php_pollfd_for_ms(data->socket, PHP_POLLREADABLE, 0);
+	if (revents == 0) {
+		return 1;
+	}
+	if (revents < 0 || (revents & (POLLERR | POLLHUP | POLLNVAL))) {
+		return 0;
+	}
+
+	return recv(data->socket, &c, 1, MSG_PEEK) > 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_session_usable
+ * Alive and still within its methods['retire'] limits, a session past them is retired so the next user gets fresh keys
+ */
+static int php_ssh2_pool_session_usable(php_ssh2_session_data *data TSRMLS_DC)
+{
+	if (!php_ssh2_pool_session_alive(data)) {
+		return 0;
+	}
+	if (php_ssh2_retire_due(data)) {
+		SSH2_G(pool_retired)++;
+		return 0;
+	}
+
+	return 1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_discard
+ * Destroy an idle session which was unlinked from its bucket
+ */
+static void php_ssh2_pool_discard(php_ssh2_session_data *data TSRMLS_DC)
+{
+	SSH2_G(pool_num_idle)--;
+	php_ssh2_session_destroy(data->session TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_sweep
+ * Disconnect sessions which have been idle for longer than ssh2.pool_idle_ttl
+ * and keep the others alive, a session whose keepalive fails is dead already
+ */
+static void php_ssh2_pool_sweep(time_t now TSRMLS_DC)
+{
+	HashPosition pos;
+	zend_rsrc_list_entry *le;
+
+	if (SSH2_G(pool_num_idle) == 0) {
+		return;
+	}
+
+	for(zend_hash_internal_pointer_reset_ex(&EG(persistent_list), &pos);
+		zend_hash_get_current_data_ex(&EG(persistent_list), (void**)&le, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&EG(persistent_list), &pos)) {
+		php_ssh2_pool_bucket *bucket;
+		php_ssh2_session_data **pdata;
+
+		if (le->type != le_ssh2_pool) {
+			continue;
+		}
+		bucket = (php_ssh2_pool_bucket*)le->ptr;
+
+		/* MRU first, so once one entry is expired the rest of the list is too */
+		for(pdata = &bucket->idle; *pdata; ) {
+			php_ssh2_session_data *data = *pdata;
+
+			if (SSH2_G(pool_idle_ttl) > 0 && data->last_used + SSH2_G(pool_idle_ttl) <= now) {
+				break;
+			}
+			if (php_ssh2_keepalive(data->session) < 0) {
+				*pdata = data->pool_next;
+				bucket->num_idle--;
+				php_ssh2_pool_discard(data TSRMLS_CC);
+				continue;
+			}
+			pdata = &data->pool_next;
+		}
+		while (*pdata) {
+			php_ssh2_session_data *data = *pdata;
+
+			*pdata = data->pool_next;
+			bucket->num_idle--;
+			php_ssh2_pool_discard(data TSRMLS_CC);
+		}
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_host_idle
+ * Count idle sessions to host:port across all buckets
+ */
+static int php_ssh2_pool_host_idle(char *host, int port TSRMLS_DC)
+{
+	HashPosition pos;
+	zend_rsrc_list_entry *le;
+	int num_idle = 0;
+
+	for(zend_hash_internal_pointer_reset_ex(&EG(persistent_list), &pos);
+		zend_hash_get_current_data_ex(&EG(persistent_list), (void**)&le, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&EG(persistent_list), &pos)) {
+		php_ssh2_pool_bucket *bucket;
+
+		if (le->type != le_ssh2_pool) {
+			continue;
+		}
+		bucket = (php_ssh2_pool_bucket*)le->ptr;
+		if (bucket->port == port && strcmp(bucket->host, host) == 0) {
+			num_idle += bucket->num_idle;
+		}
+	}
+
+	return num_idle;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_evict_lru
+ * Disconnect the least recently used idle session of the whole pool
+ */
+static void php_ssh2_pool_evict_lru(TSRMLS_D)
+{
+	HashPosition pos;
+	zend_rsrc_list_entry *le;
+	php_ssh2_pool_bucket *victim_bucket = NULL;
+	php_ssh2_session_data **victim = NULL;
+
+	for(zend_hash_internal_pointer_reset_ex(&EG(persistent_list), &pos);
+		zend_hash_get_current_data_ex(&EG(persistent_list), (void**)&le, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&EG(persistent_list), &pos)) {
+		php_ssh2_pool_bucket *bucket;
+		php_ssh2_session_data **pdata;
+
+		if (le->type != le_ssh2_pool) {
+			continue;
+		}
+		bucket = (php_ssh2_pool_bucket*)le->ptr;
+		if (!bucket->idle) {
+			continue;
+		}
+
+		/* The tail of each bucket is its least recently used session */
+		for(pdata = &bucket->idle; (*pdata)->pool_next; pdata = &(*pdata)->pool_next);
+		if (!victim || (*pdata)->last_used < (*victim)->last_used) {
+			victim = pdata;
+			victim_bucket = bucket;
+		}
+	}
+
+	if (victim) {
+		php_ssh2_session_data *data = *victim;
+
+		*victim = NULL;
+		victim_bucket->num_idle--;
+		php_ssh2_pool_discard(data TSRMLS_CC);
+	}
+}
+/* }}} */
+
+#ifdef ZTS
+/* ***************
+   * Shared Pool *
+   *************** */
+
+/* With ssh2.pool_shared a threaded SAPI files idle sessions here instead of into the
+ * calling thread's persistent_list, so a session released by one worker thread can be
+ * checked out by any other.  A session is either on this list or owned by exactly one
+ * thread, never both, which is what keeps libssh2 (one session, one thread) happy.
+ * Buckets are stored by pointer and only ever touched with the lock held.
+ */
+static MUTEX_T php_ssh2_pool_shared_lock;
+static HashTable php_ssh2_pool_shared_buckets;
+static long php_ssh2_pool_shared_idle;
+
+/* {{{ php_ssh2_pool_shared_startup
+ */
+void php_ssh2_pool_shared_startup(void)
+{
+	php_ssh2_pool_shared_lock = tsrm_mutex_alloc();
+	zend_hash_init(&php_ssh2_pool_shared_buckets, 8, NULL, NULL, 1);
+	php_ssh2_pool_shared_idle = 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_shared_shutdown
+ * Disconnect whatever is still idle, no other thread is running by now
+ */
+void php_ssh2_pool_shared_shutdown(TSRMLS_D)
+{
+	php_ssh2_pool_bucket **pbucket;
+
+	for(zend_hash_internal_pointer_reset(&php_ssh2_pool_shared_buckets);
+		zend_hash_get_current_data(&php_ssh2_pool_shared_buckets, (void**)&pbucket) == SUCCESS;
+		zend_hash_move_forward(&php_ssh2_pool_shared_buckets)) {
+		php_ssh2_pool_bucket *bucket = *pbucket;
+
+		while (bucket->idle) {
+			php_ssh2_session_data *data = bucket->idle;
+
+			bucket->idle = data->pool_next;
+			php_ssh2_session_destroy(data->session TSRMLS_CC);
+		}
+		pefree(bucket->host, 1);
+		pefree(bucket, 1);
+	}
+	zend_hash_destroy(&php_ssh2_pool_shared_buckets);
+	php_ssh2_pool_shared_idle = 0;
+
+	tsrm_mutex_free(php_ssh2_pool_shared_lock);
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_shared_host_idle
+ * Count idle sessions to host:port, lock must be held
+ */
+static int php_ssh2_pool_shared_host_idle(char *host, int port)
+{
+	HashPosition pos;
+	php_ssh2_pool_bucket **pbucket;
+	int num_idle = 0;
+
+	for(zend_hash_internal_pointer_reset_ex(&php_ssh2_pool_shared_buckets, &pos);
+		zend_hash_get_current_data_ex(&php_ssh2_pool_shared_buckets, (void**)&pbucket, &pos) == SUCCESS;
+		zend_hash_move_forward_ex(&php_ssh2_pool_shared_buckets, &pos)) {
+		if ((*pbucket)->port == port && strcmp((*pbucket)->host, host) == 0) {
+			num_idle += (*pbucket)->num_idle;
+		}
+	}
+
+	return num_idle;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_shared_checkout
+ * Take the most recently used live session filed under key off the shared list
+ * Liveness is checked and dead sessions are disconnected outside of the lock
+ */
+static LIBSSH2_SESSION *php_ssh2_pool_shared_checkout(char *key, int key_len TSRMLS_DC)
+{
+	time_t now = time(NULL);
+
+	for(;;) {
+		php_ssh2_pool_bucket **pbucket;
+		php_ssh2_session_data *data = NULL, *expired = NULL;
+
+		tsrm_mutex_lock(php_ssh2_pool_shared_lock);
+		if (zend_hash_find(&php_ssh2_pool_shared_buckets, key, key_len + 1, (void**)&pbucket) == SUCCESS && (*pbucket)->idle) {
+			php_ssh2_pool_bucket *bucket = *pbucket;
+
+			data = bucket->idle;
+			if (SSH2_G(pool_idle_ttl) > 0 && data->last_used + SSH2_G(pool_idle_ttl) <= now) {
+				/* MRU first, so everything in this bucket has expired */
+				expired = data;
+				data = NULL;
+				php_ssh2_pool_shared_idle -= bucket->num_idle;
+				bucket->idle = NULL;
+				bucket->num_idle = 0;
+			} else {
+				bucket->idle = data->pool_next;
+				bucket->num_idle--;
+				php_ssh2_pool_shared_idle--;
+				data->pool_next = NULL;
+			}
+		}
+		tsrm_mutex_unlock(php_ssh2_pool_shared_lock);
+
+		while (expired) {
+			php_ssh2_session_data *next = expired->pool_next;
+
+			SSH2_TSRMLS_SET(expired);
+			php_ssh2_session_destroy(expired->session TSRMLS_CC);
+			expired = next;
+		}
+
+		if (!data) {
+			return NULL;
+		}
+
+		/* This thread owns it now, allocator callbacks included */
+		SSH2_TSRMLS_SET(data);
+		if (!php_ssh2_pool_session_usable(data TSRMLS_CC)) {
+			php_ssh2_session_destroy(data->session TSRMLS_CC);
+			continue;
+		}
+		if (data->warmed) {
+			SSH2_G(pool_warm_hits)++;
+			data->warmed = 0;
+		}
+
+		return data->session;
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_shared_release
+ * File a usable session onto the shared list, FAILURE when the pool is full
+ */
+static int php_ssh2_pool_shared_release(php_ssh2_session_data *data, time_t now TSRMLS_DC)
+{
+	php_ssh2_pool_bucket **pbucket, *bucket;
+
+	tsrm_mutex_lock(php_ssh2_pool_shared_lock);
+
+	if (php_ssh2_pool_shared_idle >= SSH2_G(pool_max_idle) ||
+		(SSH2_G(pool_max_idle_per_host) > 0 &&
+		 php_ssh2_pool_shared_host_idle(data->host, data->port) >= SSH2_G(pool_max_idle_per_host))) {
+		tsrm_mutex_unlock(php_ssh2_pool_shared_lock);
+		return FAILURE;
+	}
+
+	if (zend_hash_find(&php_ssh2_pool_shared_buckets, data->pool_key, data->pool_key_len + 1, (void**)&pbucket) == SUCCESS) {
+		bucket = *pbucket;
+	} else {
+		bucket = pecalloc(1, sizeof(php_ssh2_pool_bucket), 1);
+		bucket->host = pestrdup(data->host, 1);
+		bucket->port = data->port;
+		zend_hash_add(&php_ssh2_pool_shared_buckets, data->pool_key, data->pool_key_len + 1, (void*)&bucket, sizeof(php_ssh2_pool_bucket*), NULL);
+	}
+
+	data->last_used = now;
+	data->pool_next = bucket->idle;
+	bucket->idle = data;
+	bucket->num_idle++;
+	php_ssh2_pool_shared_idle++;
+
+	tsrm_mutex_unlock(php_ssh2_pool_shared_lock);
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_shared_num_idle
+ */
+long php_ssh2_pool_shared_num_idle(void)
+{
+	long num_idle;
+
+	tsrm_mutex_lock(php_ssh2_pool_shared_lock);
+	num_idle = php_ssh2_pool_shared_idle;
+	tsrm_mutex_unlock(php_ssh2_pool_shared_lock);
+
+	return num_idle;
+}
+/* }}} */
+#endif
+
+/* **********************
+   * Checkout & Release *
+   ********************** */
+
+/* {{{ php_ssh2_pool_lock
+ * The key only says who a session was authenticated as, not that the new user can prove it,
+ * so an authenticated session stays locked until php_ssh2_session_auth_remember()
+ */
+static LIBSSH2_SESSION *php_ssh2_pool_lock(php_ssh2_session_data *data)
+{
+	data->auth_locked = libssh2_userauth_authenticated(data->session) ? 1 : 0;
+
+	return data->session;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_checkout
+ * Hand out the most recently used live session filed under key, NULL if there is none
+ */
+LIBSSH2_SESSION *php_ssh2_pool_checkout(char *key, int key_len TSRMLS_DC)
+{
+	zend_rsrc_list_entry *le;
+	php_ssh2_pool_bucket *bucket = NULL;
+
+	php_ssh2_pool_sweep(time(NULL) TSRMLS_CC);
+
+	if (zend_hash_find(&EG(persistent_list), key, key_len + 1, (void**)&le) == SUCCESS && le->type == le_ssh2_pool) {
+		bucket = (php_ssh2_pool_bucket*)le->ptr;
+	}
+
+	while (bucket && bucket->idle) {
+		php_ssh2_session_data *data = bucket->idle;
+
+		bucket->idle = data->pool_next;
+		bucket->num_idle--;
+		data->pool_next = NULL;
+
+		if (!php_ssh2_pool_session_usable(data TSRMLS_CC)) {
+			php_ssh2_pool_discard(data TSRMLS_CC);
+			continue;
+		}
+
+		SSH2_G(pool_num_idle)--;
+		SSH2_G(pool_hits)++;
+		if (data->warmed) {
+			SSH2_G(pool_warm_hits)++;
+			data->warmed = 0;
+		}
+		SSH2_TSRMLS_SET(data);
+
+		return php_ssh2_pool_lock(data);
+	}
+
+#ifdef ZTS
+	if (SSH2_G(pool_shared)) {
+		LIBSSH2_SESSION *session = php_ssh2_pool_shared_checkout(key, key_len TSRMLS_CC);
+
+		if (session) {
+			SSH2_G(pool_hits)++;
+			return php_ssh2_pool_lock(*(php_ssh2_session_data**)libssh2_session_abstract(session));
+		}
+	}
+#endif
+
+	SSH2_G(pool_misses)++;
+	return NULL;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_release
+ * Return a persistent session to its bucket
+ * FAILURE means the session is not poolable and should be destroyed by the caller
+ */
+int php_ssh2_pool_release(LIBSSH2_SESSION *session TSRMLS_DC)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	zend_rsrc_list_entry *le, new_le;
+	php_ssh2_pool_bucket *bucket;
+	time_t now = time(NULL);
+
+	if (!data || !data->persistent || !data->pool_key) {
+		return FAILURE;
+	}
+
+	/* Userspace callbacks die with the request */
+	php_ssh2_session_clear_callbacks(data TSRMLS_CC);
+
+	if (SSH2_G(pool_max_idle) <= 0 || !php_ssh2_pool_session_usable(data TSRMLS_CC)) {
+		return FAILURE;
+	}
+
+#ifdef ZTS
+	if (SSH2_G(pool_shared)) {
+		libssh2_session_set_blocking(session, 1);
+		return php_ssh2_pool_shared_release(data, now TSRMLS_CC);
+	}
+#endif
+
+	php_ssh2_pool_sweep(now TSRMLS_CC);
+
+	if (SSH2_G(pool_max_idle_per_host) > 0 &&
+		php_ssh2_pool_host_idle(data->host, data->port TSRMLS_CC) >= SSH2_G(pool_max_idle_per_host)) {
+		return FAILURE;
+	}
+
+	if (zend_hash_find(&EG(persistent_list), data->pool_key, data->pool_key_len + 1, (void**)&le) == SUCCESS && le->type == le_ssh2_pool) {
+		bucket = (php_ssh2_pool_bucket*)le->ptr;
+	} else {
+		bucket = pecalloc(1, sizeof(php_ssh2_pool_bucket), 1);
+		bucket->host = pestrdup(data->host, 1);
+		bucket->port = data->port;
+
+		new_le.type = le_ssh2_pool;
+		new_le.ptr = bucket;
+		if (zend_hash_update(&EG(persistent_list), data->pool_key, data->pool_key_len + 1, (void*)&new_le, sizeof(zend_rsrc_list_entry), NULL) == FAILURE) {
+			pefree(bucket->host, 1);
+			pefree(bucket, 1);
+			return FAILURE;
+		}
+	}
+
+	libssh2_session_set_blocking(session, 1);
+
+	data->last_used = now;
+	data->pool_next = bucket->idle;
+	bucket->idle = data;
+	bucket->num_idle++;
+
+	if (++SSH2_G(pool_num_idle) > SSH2_G(pool_max_idle)) {
+		php_ssh2_pool_evict_lru(TSRMLS_C);
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* **************
+   * Pre-warming *
+   ************** */
+
+/* {{{ php_ssh2_pool_warm_now
+ * Milliseconds on the wall clock, only used for the warming budget
+ */
+static long php_ssh2_pool_warm_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (long)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_warm_entry
+ * Connect and authenticate one "user@host[:port]|pubkeyfile|privkeyfile[|passphrase]" entry,
+ * then file it into the pool as if ssh2_pconnect() had released it
+ * budget is what is left of ssh2.pool_warm_budget in milliseconds and bounds
+ * the connect, handshake and auth of this entry, 0 for no limit
+ */
+static int php_ssh2_pool_warm_entry(char *entry, long budget TSRMLS_DC)
+{
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	zval *methods = NULL, *timeouts;
+	long started = php_ssh2_pool_warm_now();
+	char *username, *host, *port_str = NULL, *pubkey, *privkey, *passphrase = NULL, *p;
+	int port = PHP_SSH2_DEFAULT_PORT;
+	char ident[PHP_SSH2_AUTH_IDENT_LEN + 1];
+	smart_str key = {0};
+
+	if (!(pubkey = strchr(entry, '|')) || !(privkey = strchr(pubkey + 1, '|'))) {
+		return FAILURE;
+	}
+	*(pubkey++) = 0;
+	*(privkey++) = 0;
+	if ((passphrase = strchr(privkey, '|'))) {
+		*(passphrase++) = 0;
+	}
+
+	username = entry;
+	if (!(host = strrchr(entry, '@'))) {
+		return FAILURE;
+	}
+	*(host++) = 0;
+
+	if (*host == '[') {
+		/* IPv6 Encapsulated Format */
+		host++;
+		if ((p = strchr(host, ']'))) {
+			*(p++) = 0;
+			if (*p == ':') {
+				port_str = p + 1;
+			}
+		}
+	} else if ((p = strrchr(host, ':'))) {
+		*p = 0;
+		port_str = p + 1;
+	}
+	if (port_str) {
+		port = atoi(port_str);
+	}
+	if (!*username || !*host || port <= 0 || port > 65535) {
+		return FAILURE;
+	}
+
+	if (budget > 0) {
+		MAKE_STD_ZVAL(timeouts);
+		array_init(timeouts);
+		add_assoc_long(timeouts, "connect", budget);
+		add_assoc_long(timeouts, "handshake", budget);
+		add_assoc_long(timeouts, "auth", budget);
+		MAKE_STD_ZVAL(methods);
+		array_init(methods);
+		add_assoc_zval(methods, "timeouts", timeouts);
+	}
+
+	session = php_ssh2_session_connect_ex(host, port, methods, NULL, 1 TSRMLS_CC);
+	if (methods) {
+		zval_ptr_dtor(&methods);
+	}
+	if (!session) {
+		return FAILURE;
+	}
+
+	if (budget > 0) {
+		/* Whatever the connect and handshake left over */
+		budget -= php_ssh2_pool_warm_now() - started;
+		php_ssh2_session_timeout_ms(session, budget > 0 ? budget : 1);
+	}
+	if (libssh2_userauth_publickey_fromfile(session, username, pubkey, privkey, passphrase)) {
+		php_ssh2_session_destroy(session TSRMLS_CC);
+		return FAILURE;
+	}
+
+	/* Make it look like the result of ssh2_pconnect() + ssh2_auth_pubkey_file() */
+	php_ssh2_pool_key(&key, host, port, username, strlen(username), NULL TSRMLS_CC);
+	php_ssh2_auth_ident_keyfile(ident, username, strlen(username), "publickey", pubkey, privkey, passphrase TSRMLS_CC);
+	php_ssh2_session_auth_remember(session, ident);
+
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	/* The budget was only for warming, whoever checks it out gets the configured deadlines */
+	php_ssh2_timeouts_parse(NULL, data->timeouts TSRMLS_CC);
+	php_ssh2_session_timeout_ms(session, 0);
+	data->pool_key = pestrndup(key.c, key.len, 1);
+	data->pool_key_len = key.len;
+	data->warmed = 1;
+	smart_str_free(&key);
+
+	if (php_ssh2_pool_release(session TSRMLS_CC) == FAILURE) {
+		php_ssh2_session_destroy(session TSRMLS_CC);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_warm
+ * Pre-establish the sessions listed in ssh2.pool_warm (comma separated)
+ * Called from RINIT, each call spends at most ssh2.pool_warm_budget milliseconds
+ * and picks up where the previous one stopped, so a fresh worker only pays for
+ * the handshakes it has time for
+ */
+void php_ssh2_pool_warm(TSRMLS_D)
+{
+	char *list, *entry, *last = NULL;
+	long started, remaining = 0, entry_num = 0;
+	int error_reporting;
+
+	if (!SSH2_G(pool_warm) || !*SSH2_G(pool_warm)) {
+		SSH2_G(pool_warm_done) = 1;
+		return;
+	}
+
+	started = php_ssh2_pool_warm_now();
+	list = estrdup(SSH2_G(pool_warm));
+
+	/* Failures are counted, not reported into whatever request happens to run */
+	error_reporting = EG(error_reporting);
+	EG(error_reporting) = 0;
+
+	for(entry = php_strtok_r(list, ", \t", &last); entry; entry = php_strtok_r(NULL, ", \t", &last), entry_num++) {
+		if (entry_num < SSH2_G(pool_warm_next)) {
+			/* Already warmed by an earlier request */
+			continue;
+		}
+		if (SSH2_G(pool_warm_budget) > 0) {
+			remaining = SSH2_G(pool_warm_budget) - (php_ssh2_pool_warm_now() - started);
+			if (remaining <= 0) {
+				/* Out of time, continue with the next request */
+				break;
+			}
+		}
+
+		if (php_ssh2_pool_warm_entry(entry, remaining TSRMLS_CC) == SUCCESS) {
+			SSH2_G(pool_warmed)++;
+		} else {
+			SSH2_G(pool_warm_failures)++;
+		}
+		SSH2_G(pool_warm_next)++;
+	}
+
+	EG(error_reporting) = error_reporting;
+	if (!entry) {
+		SSH2_G(pool_warm_done) = 1;
+	}
+	efree(list);
+}
+/* }}} */
+
+/* {{{ php_ssh2_pool_bucket_dtor
+ * Persistent list destructor, disconnects whatever is still idle
+ */
+void php_ssh2_pool_bucket_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	php_ssh2_pool_bucket *bucket = (php_ssh2_pool_bucket*)rsrc->ptr;
+
+	while (bucket->idle) {
+		php_ssh2_session_data *data = bucket->idle;
+
+		bucket->idle = data->pool_next;
+		php_ssh2_pool_discard(data TSRMLS_CC);
+	}
+
+	pefree(bucket->host, 1);
+	pefree(bucket, 1);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -38,13 +38,48 @@ void php_ssh2_sftp_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
 		return;
 	}
 
-	libssh2_sftp_shutdown(data->sftp);
+	/* A shared subsystem belongs to the session and goes with it */
+	if (!data->shared) {
+		libssh2_sftp_shutdown(data->sftp);
+	}
 
 	zend_list_delete(data->session_rsrcid);
 
 	efree(data);
 }
 
+/* {{{ php_ssh2_session_sftp
+ * The session's own SFTP subsystem, started on first use and kept until the session is freed
+ */
+LIBSSH2_SFTP *php_ssh2_session_sftp(LIBSSH2_SESSION *session)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	if (!data->sftp) {
+		data->sftp = libssh2_sftp_init(session);
+	}
+
+	return data->sftp;
+}
+/* }}} */
+
+/* {{{ php_ssh2_sftp_register_shared
+ * Register an SFTP resource for the session's own subsystem, takes over a reference on session_rsrcid
+ */
+int php_ssh2_sftp_register_shared(LIBSSH2_SESSION *session, int session_rsrcid TSRMLS_DC)
+{
+	php_ssh2_sftp_data *data;
+
+	data = emalloc(sizeof(php_ssh2_sftp_data));
+	data->session = session;
+	data->sftp = php_ssh2_session_sftp(session);
+	data->session_rsrcid = session_rsrcid;
+	data->shared = 1;
+
+	return ZEND_REGISTER_RESOURCE(NULL, data, le_ssh2_sftp);
+}
+/* }}} */
+
 /* *****************
    * SFTP File Ops *
    ***************** */
@@ -101,17 +136,59 @@ typedef struct _php_ssh2_sftp_handle_data {
 	LIBSSH2_SFTP_HANDLE *handle;
 
 	long sftp_rsrcid;
+
+	/* Payload through this stream, for stream_get_meta_data() */
+	php_ssh2_uint64 bytes_read;
+	php_ssh2_uint64 bytes_written;
 } php_ssh2_sftp_handle_data;
 
+/* Run one SFTP request on session, counting it as op for ssh2_session_stats() */
+#define PHP_SSH2_SFTP_CALL(session, op, rc, call) \
+	do { \
+		double sftp_call_started = php_ssh2_comp_clock(); \
+		(rc) = (call); \
+		php_ssh2_stats_sftp((session), (op), (rc), sftp_call_started); \
+	} while (0)
+
+/* {{{ php_ssh2_sftp_handle_session
+ * Session behind a handle, NULL once its SFTP resource is gone
+ */
+static LIBSSH2_SESSION *php_ssh2_sftp_handle_session(php_ssh2_sftp_handle_data *data TSRMLS_DC)
+{
+	php_ssh2_sftp_data *sftp_data;
+	int type;
+
+	sftp_data = (php_ssh2_sftp_data*)zend_list_find(data->sftp_rsrcid, &type);
+	if (!sftp_data || type != le_ssh2_sftp) {
+		return NULL;
+	}
+
+	return sftp_data->session;
+}
+/* }}} */
+
 /* {{{ php_ssh2_sftp_stream_write
  */
 static size_t php_ssh2_sftp_stream_write(php_stream *stream, const char *buf, size_t count TSRMLS_DC)
 {
 	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
+	php_ssh2_sftp_data *sftp_data;
 	ssize_t bytes_written;
+	double started = php_ssh2_comp_clock();
+	int type;
 
 	bytes_written = libssh2_sftp_write(data->handle, buf, count);
 
+	sftp_data = (php_ssh2_sftp_data*)zend_list_find(data->sftp_rsrcid, &type);
+	if (sftp_data && type == le_ssh2_sftp) {
+		php_ssh2_comp_sample(sftp_data->session, PHP_SSH2_COMP_CS, buf, bytes_written, started);
+		php_ssh2_stats_sftp(sftp_data->session, PHP_SSH2_SFTP_OP_WRITE, bytes_written, started);
+	}
+
+	if (bytes_written > 0) {
+		data->bytes_written += bytes_written;
+	}
+
 	return (size_t)(bytes_written<0 ? 0 : bytes_written);
 }
 /* }}} */
@@ -121,11 +198,29 @@ static size_t php_ssh2_sftp_stream_write(php_stream *stream, const char *buf, si
 static size_t php_ssh2_sftp_stream_read(php_stream *stream, char *buf, size_t count TSRMLS_DC)
 {
 	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
+	php_ssh2_sftp_data *sftp_data;
 	ssize_t bytes_read;
+	double started;
+	int type;
+
+	sftp_data = (php_ssh2_sftp_data*)zend_list_find(data->sftp_rsrcid, &type);
+	if (sftp_data && type == le_ssh2_sftp) {
+		php_ssh2_keepalive(sftp_data->session);
+	} else {
+		sftp_data = NULL;
+	}
 
+	started = php_ssh2_comp_clock();
 	bytes_read = libssh2_sftp_read(data->handle, buf, count);
+	if (sftp_data) {
+		php_ssh2_comp_sample(sftp_data->session, PHP_SSH2_COMP_SC, buf, bytes_read, started);
+		php_ssh2_stats_sftp(sftp_data->session, PHP_SSH2_SFTP_OP_READ, bytes_read, started);
+	}
 
 	stream->eof = (bytes_read <= 0 && bytes_read != LIBSSH2_ERROR_EAGAIN);
+	if (bytes_read > 0) {
+		data->bytes_read += bytes_read;
+	}
 
 	return (size_t)(bytes_read<0 ? 0 : bytes_read);
 }
@@ -136,8 +231,9 @@ static size_t php_ssh2_sftp_stream_read(php_stream *stream, char *buf, size_t co
 static int php_ssh2_sftp_stream_close(php_stream *stream, int close_handle TSRMLS_DC)
 {
 	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
+	int rc;
 
-	libssh2_sftp_close(data->handle);
+	PHP_SSH2_SFTP_CALL(php_ssh2_sftp_handle_session(data TSRMLS_CC), PHP_SSH2_SFTP_OP_CLOSE, rc, libssh2_sftp_close(data->handle));
 	zend_list_delete(data->sftp_rsrcid);
 	efree(data);
 
@@ -155,8 +251,10 @@ static int php_ssh2_sftp_stream_seek(php_stream *stream, off_t offset, int whenc
 		case SEEK_END:
 		{
 			LIBSSH2_SFTP_ATTRIBUTES attrs;
+			int rc;
 
-			if (libssh2_sftp_fstat(data->handle, &attrs)) {
+			PHP_SSH2_SFTP_CALL(php_ssh2_sftp_handle_session(data TSRMLS_CC), PHP_SSH2_SFTP_OP_STAT, rc, libssh2_sftp_fstat(data->handle, &attrs));
+			if (rc) {
 				return -1;
 			}
 			if ((attrs.flags & LIBSSH2_SFTP_ATTR_SIZE) == 0) {
@@ -192,8 +290,10 @@ static int php_ssh2_sftp_stream_fstat(php_stream *stream, php_stream_statbuf *ss
 {
 	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
 	LIBSSH2_SFTP_ATTRIBUTES attrs;
+	int rc;
 
-	if (libssh2_sftp_fstat(data->handle, &attrs)) {
+	PHP_SSH2_SFTP_CALL(php_ssh2_sftp_handle_session(data TSRMLS_CC), PHP_SSH2_SFTP_OP_STAT, rc, libssh2_sftp_fstat(data->handle, &attrs));
+	if (rc) {
 		return -1;
 	}
 
@@ -201,6 +301,40 @@ static int php_ssh2_sftp_stream_fstat(php_stream *stream, php_stream_statbuf *ss
 }
 /* }}} */
 
+/* {{{ php_ssh2_sftp_stream_set_option
+ */
+static int php_ssh2_sftp_stream_set_option(php_stream *stream, int option, int value, void *ptrparam TSRMLS_DC)
+{
+	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
+	php_ssh2_sftp_data *sftp_data;
+	int type;
+
+	switch (option) {
+		case PHP_STREAM_OPTION_META_DATA_API:
+			php_ssh2_add_assoc_counter((zval*)ptrparam, "bytes_read", data->bytes_read);
+			php_ssh2_add_assoc_counter((zval*)ptrparam, "bytes_written", data->bytes_written);
+			php_ssh2_add_assoc_counter((zval*)ptrparam, "offset", libssh2_sftp_tell64(data->handle));
+			add_assoc_long((zval*)ptrparam, "stream_buffer", (long)(stream->writepos - stream->readpos));
+
+			sftp_data = (php_ssh2_sftp_data*)zend_list_find(data->sftp_rsrcid, &type);
+			if (sftp_data && type == le_ssh2_sftp) {
+#ifdef PHP_SSH2_SFTP_CHANNEL
+				LIBSSH2_CHANNEL *channel = libssh2_sftp_get_channel(sftp_data->sftp);
+
+				/* Every handle on this SFTP session shares the channel and its windows */
+				if (channel) {
+					php_ssh2_channel_meta((zval*)ptrparam, channel);
+				}
+#endif
+				php_ssh2_session_meta((zval*)ptrparam, sftp_data->session_rsrcid TSRMLS_CC);
+			}
+			return PHP_STREAM_OPTION_RETURN_OK;
+	}
+
+	return PHP_STREAM_OPTION_RETURN_NOTIMPL;
+}
+/* }}} */
+
 static php_stream_ops php_ssh2_sftp_stream_ops = {
     php_ssh2_sftp_stream_write,
     php_ssh2_sftp_stream_read,
@@ -210,7 +344,7 @@ static php_stream_ops php_ssh2_sftp_stream_ops = {
     php_ssh2_sftp_stream_seek,
     NULL, /* cast */
     php_ssh2_sftp_stream_fstat,
-	NULL, /* set_option */
+	php_ssh2_sftp_stream_set_option,
 };
 
 /* {{{ php_ssh2_sftp_stream_opener
@@ -227,6 +361,7 @@ static php_stream *php_ssh2_sftp_stream_opener(	php_stream_wrapper *wrapper, cha
 	php_url *resource;
 	unsigned long flags;
 	long perms = 0644;
+	double started;
 
 	resource = php_ssh2_fopen_wraper_parse_path(filename, "sftp", context, &session, &resource_id, &sftp, &sftp_rsrcid TSRMLS_CC);
 	if (!resource || !session || !sftp) {
@@ -235,7 +370,9 @@ static php_stream *php_ssh2_sftp_stream_opener(	php_stream_wrapper *wrapper, cha
 
 	flags = php_ssh2_parse_fopen_modes(mode);
 
+	started = php_ssh2_comp_clock();
 	handle = libssh2_sftp_open(sftp, resource->path, flags, perms);
+	php_ssh2_stats_sftp(session, PHP_SSH2_SFTP_OP_OPEN, handle ? 0 : libssh2_session_last_error(session, NULL, NULL, 0), started);
 	if (!handle) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to open %s on remote host", filename);
 		php_url_free(resource);
@@ -243,7 +380,7 @@ static php_stream *php_ssh2_sftp_stream_opener(	php_stream_wrapper *wrapper, cha
 		return NULL;
 	}
 
-	data = emalloc(sizeof(php_ssh2_sftp_handle_data));
+	data = ecalloc(1, sizeof(php_ssh2_sftp_handle_data));
 	data->handle = handle;
 	data->sftp_rsrcid = sftp_rsrcid;
 
@@ -269,10 +406,13 @@ static size_t php_ssh2_sftp_dirstream_read(php_stream *stream, char *buf, size_t
 {
 	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
 	php_stream_dirent *ent = (php_stream_dirent*)buf;
-	int bytesread = libssh2_sftp_readdir(data->handle, ent->d_name, sizeof(ent->d_name) - 1, NULL);
+	int bytesread;
 	char *basename = NULL;
 	size_t basename_len = 0;
 
+	PHP_SSH2_SFTP_CALL(php_ssh2_sftp_handle_session(data TSRMLS_CC), PHP_SSH2_SFTP_OP_READDIR, bytesread,
+		libssh2_sftp_readdir(data->handle, ent->d_name, sizeof(ent->d_name) - 1, NULL));
+
 	if (bytesread <= 0) {
 		return 0;
 	}
@@ -309,8 +449,9 @@ static size_t php_ssh2_sftp_dirstream_read(php_stream *stream, char *buf, size_t
 static int php_ssh2_sftp_dirstream_close(php_stream *stream, int close_handle TSRMLS_DC)
 {
 	php_ssh2_sftp_handle_data *data = (php_ssh2_sftp_handle_data*)stream->abstract;
+	int rc;
 
-	libssh2_sftp_close(data->handle);
+	PHP_SSH2_SFTP_CALL(php_ssh2_sftp_handle_session(data TSRMLS_CC), PHP_SSH2_SFTP_OP_CLOSE, rc, libssh2_sftp_close(data->handle));
 	zend_list_delete(data->sftp_rsrcid);
 	efree(data);
 
@@ -342,13 +483,16 @@ static php_stream *php_ssh2_sftp_dirstream_opener(	php_stream_wrapper *wrapper,
 	php_stream *stream;
 	int resource_id = 0, sftp_rsrcid = 0;
 	php_url *resource;
+	double started;
 
 	resource = php_ssh2_fopen_wraper_parse_path(filename, "sftp", context, &session, &resource_id, &sftp, &sftp_rsrcid TSRMLS_CC);
 	if (!resource || !session || !sftp) {
 		return NULL;
 	}
 
+	started = php_ssh2_comp_clock();
 	handle = libssh2_sftp_opendir(sftp, resource->path);
+	php_ssh2_stats_sftp(session, PHP_SSH2_SFTP_OP_OPENDIR, handle ? 0 : libssh2_session_last_error(session, NULL, NULL, 0), started);
 	if (!handle) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to open %s on remote host", filename);
 		php_url_free(resource);
@@ -356,7 +500,7 @@ static php_stream *php_ssh2_sftp_dirstream_opener(	php_stream_wrapper *wrapper,
 		return NULL;
 	}
 
-	data = emalloc(sizeof(php_ssh2_sftp_handle_data));
+	data = ecalloc(1, sizeof(php_ssh2_sftp_handle_data));
 	data->handle = handle;
 	data->sftp_rsrcid = sftp_rsrcid;
 
@@ -386,14 +530,16 @@ static int php_ssh2_sftp_urlstat(php_stream_wrapper *wrapper, char *url, int fla
 	LIBSSH2_SFTP *sftp = NULL;
 	int resource_id = 0, sftp_rsrcid = 0;
 	php_url *resource;
+	int rc;
 
 	resource = php_ssh2_fopen_wraper_parse_path(url, "sftp", context, &session, &resource_id, &sftp, &sftp_rsrcid TSRMLS_CC);
 	if (!resource || !session || !sftp || !resource->path) {
 		return -1;
 	}
 
-	if (libssh2_sftp_stat_ex(sftp, resource->path, strlen(resource->path),
-		(flags & PHP_STREAM_URL_STAT_LINK) ? LIBSSH2_SFTP_LSTAT : LIBSSH2_SFTP_STAT, &attrs)) {
+	PHP_SSH2_SFTP_CALL(session, PHP_SSH2_SFTP_OP_STAT, rc, libssh2_sftp_stat_ex(sftp, resource->path, strlen(resource->path),
+		(flags & PHP_STREAM_URL_STAT_LINK) ? LIBSSH2_SFTP_LSTAT : LIBSSH2_SFTP_STAT, &attrs));
+	if (rc) {
 		php_url_free(resource);
 		zend_list_delete(sftp_rsrcid);
 		return -1;
@@ -426,7 +572,7 @@ static int php_ssh2_sftp_unlink(php_stream_wrapper *wrapper, char *url, int opti
 		return 0;
 	}
 
-	result = libssh2_sftp_unlink(sftp, resource->path);
+	PHP_SSH2_SFTP_CALL(session, PHP_SSH2_SFTP_OP_UNLINK, result, libssh2_sftp_unlink(sftp, resource->path));
 	php_url_free(resource);
 
 	zend_list_delete(sftp_rsrcid);
@@ -468,7 +614,7 @@ static int php_ssh2_sftp_rename(php_stream_wrapper *wrapper, char *url_from, cha
 		return 0;
 	}
 
-	result = libssh2_sftp_rename(sftp, resource->path, resource_to->path);
+	PHP_SSH2_SFTP_CALL(session, PHP_SSH2_SFTP_OP_RENAME, result, libssh2_sftp_rename(sftp, resource->path, resource_to->path));
 	php_url_free(resource);
 	php_url_free(resource_to);
 
@@ -501,11 +647,11 @@ static int php_ssh2_sftp_mkdir(php_stream_wrapper *wrapper, char *url, int mode,
 		/* Just attempt to make every directory, some will fail, but we only care about the last success/failure */
 		char *p = resource->path;
 		while ((p = strchr(p + 1, '/'))) {
-			libssh2_sftp_mkdir_ex(sftp, resource->path, p - resource->path, mode);
+			PHP_SSH2_SFTP_CALL(session, PHP_SSH2_SFTP_OP_MKDIR, result, libssh2_sftp_mkdir_ex(sftp, resource->path, p - resource->path, mode));
 		}
 	}
 
-	result = libssh2_sftp_mkdir(sftp, resource->path, mode);
+	PHP_SSH2_SFTP_CALL(session, PHP_SSH2_SFTP_OP_MKDIR, result, libssh2_sftp_mkdir(sftp, resource->path, mode));
 	php_url_free(resource);
 
 	zend_list_delete(sftp_rsrcid);
@@ -533,7 +679,7 @@ static int php_ssh2_sftp_rmdir(php_stream_wrapper *wrapper, char *url, int optio
 		return 0;
 	}
 
-	result = libssh2_sftp_rmdir(sftp, resource->path);
+	PHP_SSH2_SFTP_CALL(session, PHP_SSH2_SFTP_OP_RMDIR, result, libssh2_sftp_rmdir(sftp, resource->path));
 	php_url_free(resource);
 
 	zend_list_delete(sftp_rsrcid);
@@ -592,7 +738,7 @@ PHP_FUNCTION(ssh2_sftp)
 		return;
 	}
 
-	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	SSH2_FETCH_AUTHENTICATED_SESSION(session, zsession);
 
 	sftp = libssh2_sftp_init(session);
 	if (!sftp) {
@@ -607,6 +753,7 @@ PHP_FUNCTION(ssh2_sftp)
 	data->session = session;
 	data->sftp = sftp;
 	data->session_rsrcid = Z_LVAL_P(zsession);
+	data->shared = 0;
 	zend_list_addref(Z_LVAL_P(zsession));
 
 	ZEND_REGISTER_RESOURCE(return_value, data, le_ssh2_sftp);
@@ -622,7 +769,7 @@ PHP_FUNCTION(ssh2_sftp_rename)
 	php_ssh2_sftp_data *data;
 	zval *zsftp;
 	char *src, *dst;
-	int src_len, dst_len;
+	int src_len, dst_len, rc;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rss", &zsftp, &src, &src_len, &dst, &dst_len) == FAILURE) {
 		return;
@@ -630,8 +777,9 @@ PHP_FUNCTION(ssh2_sftp_rename)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	RETURN_BOOL(!libssh2_sftp_rename_ex(data->sftp, src, src_len, dst, dst_len,
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_RENAME, rc, libssh2_sftp_rename_ex(data->sftp, src, src_len, dst, dst_len,
 				 LIBSSH2_SFTP_RENAME_OVERWRITE | LIBSSH2_SFTP_RENAME_ATOMIC | LIBSSH2_SFTP_RENAME_NATIVE));
+	RETURN_BOOL(!rc);
 }
 /* }}} */
 
@@ -642,7 +790,7 @@ PHP_FUNCTION(ssh2_sftp_unlink)
 	php_ssh2_sftp_data *data;
 	zval *zsftp;
 	char *filename;
-	int filename_len;
+	int filename_len, rc;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &zsftp, &filename, &filename_len) == FAILURE) {
 		return;
@@ -650,7 +798,8 @@ PHP_FUNCTION(ssh2_sftp_unlink)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	RETURN_BOOL(!libssh2_sftp_unlink_ex(data->sftp, filename, filename_len));
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_UNLINK, rc, libssh2_sftp_unlink_ex(data->sftp, filename, filename_len));
+	RETURN_BOOL(!rc);
 }
 /* }}} */
 
@@ -661,7 +810,7 @@ PHP_FUNCTION(ssh2_sftp_mkdir)
 	php_ssh2_sftp_data *data;
 	zval *zsftp;
 	char *filename;
-	int filename_len;
+	int filename_len, rc;
 	long mode = 0777;
 	zend_bool recursive = 0;
 	char *p;
@@ -683,12 +832,13 @@ PHP_FUNCTION(ssh2_sftp_mkdir)
 			if ((p - filename) + 1 == filename_len) {
 				break;
 			}
-			libssh2_sftp_mkdir_ex(data->sftp, filename, p - filename, mode);
+			PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_MKDIR, rc, libssh2_sftp_mkdir_ex(data->sftp, filename, p - filename, mode));
 		}
 	}
 
 
-	RETURN_BOOL(!libssh2_sftp_mkdir_ex(data->sftp, filename, filename_len, mode));
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_MKDIR, rc, libssh2_sftp_mkdir_ex(data->sftp, filename, filename_len, mode));
+	RETURN_BOOL(!rc);
 }
 /* }}} */
 
@@ -699,7 +849,7 @@ PHP_FUNCTION(ssh2_sftp_rmdir)
 	php_ssh2_sftp_data *data;
 	zval *zsftp;
 	char *filename;
-	int filename_len;
+	int filename_len, rc;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &zsftp, &filename, &filename_len) == FAILURE) {
 		return;
@@ -707,7 +857,8 @@ PHP_FUNCTION(ssh2_sftp_rmdir)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	RETURN_BOOL(!libssh2_sftp_rmdir_ex(data->sftp, filename, filename_len));
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_RMDIR, rc, libssh2_sftp_rmdir_ex(data->sftp, filename, filename_len));
+	RETURN_BOOL(!rc);
 }
 /* }}} */
 
@@ -718,7 +869,7 @@ PHP_FUNCTION(ssh2_sftp_chmod)
 	php_ssh2_sftp_data *data;
 	zval *zsftp;
 	char *filename;
-	int filename_len;
+	int filename_len, rc;
 	long mode;
 	LIBSSH2_SFTP_ATTRIBUTES attrs;
 
@@ -735,7 +886,8 @@ PHP_FUNCTION(ssh2_sftp_chmod)
 	attrs.permissions = mode;
 	attrs.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
 
-	RETURN_BOOL(!libssh2_sftp_stat_ex(data->sftp, filename, filename_len, LIBSSH2_SFTP_SETSTAT, &attrs));
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_SETSTAT, rc, libssh2_sftp_stat_ex(data->sftp, filename, filename_len, LIBSSH2_SFTP_SETSTAT, &attrs));
+	RETURN_BOOL(!rc);
 }
 /* }}} */
 
@@ -750,7 +902,7 @@ static void php_ssh2_sftp_stat_func(INTERNAL_FUNCTION_PARAMETERS, int stat_type)
 	LIBSSH2_SFTP_ATTRIBUTES attrs;
 	zval *zsftp;
 	char *path;
-	int path_len;
+	int path_len, rc;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rs", &zsftp, &path, &path_len) == FAILURE) {
 		return;
@@ -758,7 +910,8 @@ static void php_ssh2_sftp_stat_func(INTERNAL_FUNCTION_PARAMETERS, int stat_type)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	if (libssh2_sftp_stat_ex(data->sftp, path, path_len, stat_type, &attrs)) {
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_STAT, rc, libssh2_sftp_stat_ex(data->sftp, path, path_len, stat_type, &attrs));
+	if (rc) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Failed to stat remote file");
 		RETURN_FALSE;
 	}
@@ -813,7 +966,7 @@ PHP_FUNCTION(ssh2_sftp_symlink)
 	php_ssh2_sftp_data *data;
 	zval *zsftp;
 	char *targ, *link;
-	int targ_len, link_len;
+	int targ_len, link_len, rc;
 
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rss", &zsftp, &targ, &targ_len, &link, &link_len) == FAILURE) {
 		return;
@@ -821,7 +974,8 @@ PHP_FUNCTION(ssh2_sftp_symlink)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	RETURN_BOOL(!libssh2_sftp_symlink_ex(data->sftp, targ, targ_len, link, link_len, LIBSSH2_SFTP_SYMLINK));
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_SYMLINK, rc, libssh2_sftp_symlink_ex(data->sftp, targ, targ_len, link, link_len, LIBSSH2_SFTP_SYMLINK));
+	RETURN_BOOL(!rc);
 }
 /* }}} */
 
@@ -841,7 +995,8 @@ PHP_FUNCTION(ssh2_sftp_readlink)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	if ((targ_len = libssh2_sftp_symlink_ex(data->sftp, link, link_len, targ, 8192, LIBSSH2_SFTP_READLINK)) < 0) {
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_READLINK, targ_len, libssh2_sftp_symlink_ex(data->sftp, link, link_len, targ, 8192, LIBSSH2_SFTP_READLINK));
+	if (targ_len < 0) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to read link '%s'", link);
 		RETURN_FALSE;
 	}
@@ -866,7 +1021,8 @@ PHP_FUNCTION(ssh2_sftp_realpath)
 
 	ZEND_FETCH_RESOURCE(data, php_ssh2_sftp_data*, &zsftp, -1, PHP_SSH2_SFTP_RES_NAME, le_ssh2_sftp);
 
-	if ((targ_len = libssh2_sftp_symlink_ex(data->sftp, link, link_len, targ, 8192, LIBSSH2_SFTP_REALPATH)) < 0) {
+	PHP_SSH2_SFTP_CALL(data->session, PHP_SSH2_SFTP_OP_REALPATH, targ_len, libssh2_sftp_symlink_ex(data->sftp, link, link_len, targ, 8192, LIBSSH2_SFTP_REALPATH));
+	if (targ_len < 0) {
 		php_error_docref(NULL TSRMLS_CC, E_WARNING, "Unable to resolve realpath for '%s'", link);
 		RETURN_FALSE;
 	}
@@ -0,0 +1,282 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+
+/* Every libssh2 allocation of a session goes through here.  Blocks of up to
+ * PHP_SSH2_SLAB_MAX bytes are rounded up to a power of two size class and, once
+ * freed, parked on the session's free list for that class instead of going back
+ * to the engine, so the packet and channel buffers a bulk transfer allocates and
+ * frees for every packet are recycled.  Larger blocks bypass the slabs.
+ *
+ * All state lives in the session, nothing here touches the engine's globals:
+ * handshake threads allocate through these functions as well.
+ */
+
+typedef struct _php_ssh2_slab_header {
+	/* Usable bytes behind the header */
+	size_t size;
+	/* Size class, PHP_SSH2_SLAB_NONE for blocks which bypass the slabs */
+	size_t slab;
+} php_ssh2_slab_header;
+
+#define PHP_SSH2_SLAB_NONE				((size_t)-1)
+#define PHP_SSH2_SLAB_SIZE(slab)		(((size_t)1) << ((slab) + PHP_SSH2_SLAB_MIN_SHIFT))
+#define PHP_SSH2_SLAB_MAX				PHP_SSH2_SLAB_SIZE(PHP_SSH2_SLAB_CLASSES - 1)
+
+/* {{{ php_ssh2_slab_class
+ * Smallest size class count fits in, PHP_SSH2_SLAB_NONE if it is too large for any
+ */
+static inline size_t php_ssh2_slab_class(size_t count)
+{
+	size_t slab = 0;
+
+	if (count > PHP_SSH2_SLAB_MAX) {
+		return PHP_SSH2_SLAB_NONE;
+	}
+	while (PHP_SSH2_SLAB_SIZE(slab) < count) {
+		slab++;
+	}
+
+	return slab;
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_init
+ * Called before the session exists, cache_max bytes may sit on the free lists at a time
+ * and libssh2 may hold at most limit bytes (0 for no limit)
+ */
+void php_ssh2_slab_init(php_ssh2_slab *slab, long cache_max, long limit, int persistent)
+{
+	memset(slab, 0, sizeof(php_ssh2_slab));
+	slab->cache_max = cache_max > 0 ? (size_t)cache_max : 0;
+	slab->limit = limit > 0 ? (size_t)limit : 0;
+	slab->persistent = persistent;
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_take
+ * Account for size more bytes in libssh2's hands, FAILURE when that would break the limit
+ * libssh2 reports a failed allocation as LIBSSH2_ERROR_ALLOC and the operation fails cleanly,
+ * unlike running into memory_limit in the middle of a transfer
+ */
+static inline int php_ssh2_slab_take(php_ssh2_slab *slab, size_t size)
+{
+	if (slab->limit && slab->bytes + size > slab->limit) {
+		slab->limit_failures++;
+		return FAILURE;
+	}
+
+	slab->bytes += size;
+	if (slab->bytes > slab->peak) {
+		slab->peak = slab->bytes;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_alloc
+ */
+void *php_ssh2_slab_alloc(php_ssh2_slab *slab, size_t count)
+{
+	php_ssh2_slab_header *header;
+	size_t cls = php_ssh2_slab_class(count);
+	size_t size = cls == PHP_SSH2_SLAB_NONE ? count : PHP_SSH2_SLAB_SIZE(cls);
+
+	if (php_ssh2_slab_take(slab, size) == FAILURE) {
+		return NULL;
+	}
+	slab->allocations++;
+
+	if (cls != PHP_SSH2_SLAB_NONE) {
+		if (slab->free[cls]) {
+			header = (php_ssh2_slab_header*)slab->free[cls];
+			slab->free[cls] = *(void**)(header + 1);
+			slab->cached -= header->size;
+			slab->hits++;
+
+			return header + 1;
+		}
+		slab->misses++;
+	}
+
+	header = pemalloc(sizeof(php_ssh2_slab_header) + size, slab->persistent);
+	if (!header) {
+		slab->bytes -= size;
+		return NULL;
+	}
+	header->size = size;
+	header->slab = cls;
+
+	return header + 1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_free
+ */
+void php_ssh2_slab_free(php_ssh2_slab *slab, void *ptr)
+{
+	php_ssh2_slab_header *header;
+
+	if (!ptr) {
+		return;
+	}
+	header = (php_ssh2_slab_header*)ptr - 1;
+	slab->bytes -= header->size;
+
+	if (header->slab != PHP_SSH2_SLAB_NONE && slab->cached + header->size <= slab->cache_max) {
+		*(void**)ptr = slab->free[header->slab];
+		slab->free[header->slab] = header;
+		slab->cached += header->size;
+		return;
+	}
+
+	pefree(header, slab->persistent);
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_realloc
+ * Growing within the size class is free, anything else moves the block
+ */
+void *php_ssh2_slab_realloc(php_ssh2_slab *slab, void *ptr, size_t count)
+{
+	php_ssh2_slab_header *header;
+	void *moved;
+
+	if (!ptr) {
+		return php_ssh2_slab_alloc(slab, count);
+	}
+	header = (php_ssh2_slab_header*)ptr - 1;
+
+	if (header->slab == PHP_SSH2_SLAB_NONE) {
+		if (count > PHP_SSH2_SLAB_MAX) {
+			size_t size = header->size;
+			php_ssh2_slab_header *moved_header;
+
+			/* Stays large, let the backing allocator move it */
+			if (count > size && php_ssh2_slab_take(slab, count - size) == FAILURE) {
+				return NULL;
+			}
+			moved_header = perealloc(header, sizeof(php_ssh2_slab_header) + count, slab->persistent);
+			if (!moved_header) {
+				if (count > size) {
+					slab->bytes -= count - size;
+				}
+				return NULL;
+			}
+			if (count < size) {
+				slab->bytes -= size - count;
+			}
+			moved_header->size = count;
+
+			return moved_header + 1;
+		}
+	} else if (count <= header->size) {
+		return ptr;
+	}
+
+	moved = php_ssh2_slab_alloc(slab, count);
+	if (!moved) {
+		return NULL;
+	}
+	memcpy(moved, ptr, MIN(count, header->size));
+	php_ssh2_slab_free(slab, ptr);
+
+	return moved;
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_release
+ * Return everything on the free lists, called once libssh2 is done with the session
+ */
+void php_ssh2_slab_release(php_ssh2_slab *slab)
+{
+	int i;
+
+	for(i = 0; i < PHP_SSH2_SLAB_CLASSES; i++) {
+		while (slab->free[i]) {
+			php_ssh2_slab_header *header = (php_ssh2_slab_header*)slab->free[i];
+
+			slab->free[i] = *(void**)(header + 1);
+			pefree(header, slab->persistent);
+		}
+	}
+	slab->cached = 0;
+}
+/* }}} */
+
+/* {{{ php_ssh2_slab_meta
+ * Memory figures for stream_get_meta_data()
+ */
+void php_ssh2_slab_meta(zval *arr, LIBSSH2_SESSION *session)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	if (!data) {
+		return;
+	}
+	add_assoc_long(arr, "session_memory", (long)data->slab.bytes);
+	add_assoc_long(arr, "session_memory_peak", (long)data->slab.peak);
+}
+/* }}} */
+
+/* {{{ proto array ssh2_session_memory(resource session)
+ * Memory libssh2 holds for session, its high water mark, allocations made so far
+ * and how the slabs and the limit from methods['memory'] fared
+ */
+PHP_FUNCTION(ssh2_session_memory)
+{
+	zval *zsession;
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zsession) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	array_init(return_value);
+	add_assoc_long(return_value, "bytes", (long)data->slab.bytes);
+	add_assoc_long(return_value, "peak_bytes", (long)data->slab.peak);
+	add_assoc_long(return_value, "allocations", data->slab.allocations);
+	add_assoc_long(return_value, "limit", (long)data->slab.limit);
+	add_assoc_long(return_value, "limit_failures", data->slab.limit_failures);
+	add_assoc_long(return_value, "cached_bytes", (long)data->slab.cached);
+	add_assoc_long(return_value, "slab_hits", data->slab.hits);
+	add_assoc_long(return_value, "slab_misses", data->slab.misses);
+	add_assoc_bool(return_value, "persistent", data->slab.persistent);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,287 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+
+#ifdef __linux__
+# include <sys/ioctl.h>
+# include <linux/sockios.h>
+#endif
+
+/* Per-session counters behind ssh2_session_stats()
+ *
+ * Each hook takes the session an operation ran on (NULL is fine, nothing is counted) and
+ * the php_ssh2_comp_clock() reading from just before libssh2 was called, every millisecond
+ * between the two is time spent in libssh2, waiting on the network or on the crypto.
+ */
+
+static char *php_ssh2_stats_channel_names[PHP_SSH2_CHANNEL_KINDS] = {
+	"shell", "exec", "scp", "direct-tcpip", "forwarded-tcpip"
+};
+
+static char *php_ssh2_stats_sftp_names[PHP_SSH2_SFTP_OPS] = {
+	"open", "read", "write", "close", "stat", "setstat", "opendir", "readdir",
+	"mkdir", "rmdir", "rename", "unlink", "symlink", "readlink", "realpath"
+};
+
+/* {{{ php_ssh2_stats_get
+ */
+static inline php_ssh2_session_stats *php_ssh2_stats_get(LIBSSH2_SESSION *session)
+{
+	php_ssh2_session_data *data;
+
+	if (!session || !(data = *(php_ssh2_session_data**)libssh2_session_abstract(session))) {
+		return NULL;
+	}
+
+	return &data->stats;
+}
+/* }}} */
+
+/* {{{ php_ssh2_stats_call
+ * A libssh2 call returned rc after starting at started
+ */
+static inline void php_ssh2_stats_call(php_ssh2_session_stats *stats, ssize_t rc, double started)
+{
+	if (rc == LIBSSH2_ERROR_EAGAIN) {
+		stats->eagain++;
+	}
+	stats->blocked += php_ssh2_comp_clock() - started;
+}
+/* }}} */
+
+/* {{{ php_ssh2_stats_latency
+ * Record into the latency histograms of the thread the session currently belongs to
+ */
+static void php_ssh2_stats_latency(LIBSSH2_SESSION *session, int histogram, double started)
+{
+	php_ssh2_session_data *data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+	SSH2_TSRMLS_FETCH(data);
+
+	php_ssh2_latency_record(histogram, started TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ php_ssh2_stats_io
+ * Channel read or write in direction (PHP_SSH2_COMP_*), rc as libssh2_channel_(read|write)_ex() returned it
+ */
+void php_ssh2_stats_io(LIBSSH2_SESSION *session, int direction, ssize_t rc, double started)
+{
+	php_ssh2_session_stats *stats = php_ssh2_stats_get(session);
+
+	if (!stats) {
+		return;
+	}
+	php_ssh2_stats_call(stats, rc, started);
+	if (rc > 0) {
+		if (direction == PHP_SSH2_COMP_CS) {
+			stats->channel_bytes_written += rc;
+		} else {
+			stats->channel_bytes_read += rc;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_stats_sftp
+ * One SFTP request of type op (PHP_SSH2_SFTP_OP_*), rc is what libssh2 returned, or 0/-1 for calls returning a handle
+ */
+void php_ssh2_stats_sftp(LIBSSH2_SESSION *session, int op, ssize_t rc, double started)
+{
+	php_ssh2_session_stats *stats = php_ssh2_stats_get(session);
+
+	if (!stats) {
+		return;
+	}
+	php_ssh2_stats_call(stats, rc, started);
+	stats->sftp_requests[op]++;
+	if (rc != LIBSSH2_ERROR_EAGAIN) {
+		php_ssh2_stats_latency(session, PHP_SSH2_LATENCY_SFTP + op, started);
+	}
+	if (rc > 0) {
+		if (op == PHP_SSH2_SFTP_OP_WRITE) {
+			stats->sftp_bytes_written += rc;
+		} else if (op == PHP_SSH2_SFTP_OP_READ) {
+			stats->sftp_bytes_read += rc;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_stats_channel_open
+ * A channel of kind (PHP_SSH2_CHANNEL_*) was asked for at started, channel is NULL if that failed
+ */
+void php_ssh2_stats_channel_open(LIBSSH2_SESSION *session, int kind, LIBSSH2_CHANNEL *channel, double started)
+{
+	php_ssh2_session_stats *stats = php_ssh2_stats_get(session);
+
+	if (!stats) {
+		return;
+	}
+	php_ssh2_stats_call(stats, channel ? 0 : libssh2_session_last_error(session, NULL, NULL, 0), started);
+	if (channel) {
+		stats->channels_opened[kind]++;
+		php_ssh2_stats_latency(session, PHP_SSH2_LATENCY_CHANNEL + kind, started);
+	}
+}
+/* }}} */
+
+/* {{{ php_ssh2_channel_free
+ * libssh2_channel_free() counting the channel as closed
+ */
+void php_ssh2_channel_free(LIBSSH2_SESSION *session, LIBSSH2_CHANNEL *channel)
+{
+	php_ssh2_session_stats *stats = php_ssh2_stats_get(session);
+
+	libssh2_channel_free(channel);
+	if (stats) {
+		stats->channels_closed++;
+	}
+}
+/* }}} */
+
+/* ***************
+   * Stream Meta *
+   *************** */
+
+/* {{{ php_ssh2_channel_meta
+ * Flow control state of channel for stream_get_meta_data()
+ * window_local is what the server may still send us, read_ahead what it sent and nobody read yet,
+ * window_remote what we may still send before the server adjusts the window
+ */
+void php_ssh2_channel_meta(zval *arr, LIBSSH2_CHANNEL *channel)
+{
+	unsigned long read_avail = 0, window_size_initial = 0, window;
+
+	window = libssh2_channel_window_read_ex(channel, &read_avail, &window_size_initial);
+	add_assoc_long(arr, "window_local", (long)window);
+	add_assoc_long(arr, "window_local_initial", (long)window_size_initial);
+	add_assoc_long(arr, "read_ahead", (long)read_avail);
+
+	window = libssh2_channel_window_write_ex(channel, &window_size_initial);
+	add_assoc_long(arr, "window_remote", (long)window);
+	add_assoc_long(arr, "window_remote_initial", (long)window_size_initial);
+}
+/* }}} */
+
+/* {{{ php_ssh2_session_meta
+ * The session a stream belongs to, its memory and what the kernel still has to send on its socket
+ */
+void php_ssh2_session_meta(zval *arr, long session_rsrcid TSRMLS_DC)
+{
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	int type;
+
+	session = (LIBSSH2_SESSION*)zend_list_find(session_rsrcid, &type);
+	if (!session || type != le_ssh2_session) {
+		return;
+	}
+
+	/* The array holds a reference of its own */
+	zend_list_addref(session_rsrcid);
+	add_assoc_resource(arr, "session", session_rsrcid);
+	php_ssh2_slab_meta(arr, session);
+
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+#ifdef SIOCOUTQ
+	if (data) {
+		int unsent = 0;
+
+		if (ioctl(data->socket, SIOCOUTQ, &unsent) == 0) {
+			add_assoc_long(arr, "socket_unsent", unsent);
+		}
+	}
+#else
+	(void)data;
+#endif
+}
+/* }}} */
+
+/* {{{ proto array ssh2_session_stats(resource session)
+ * Traffic, channel and SFTP request counters of session, see php_ssh2_session_stats
+ */
+PHP_FUNCTION(ssh2_session_stats)
+{
+	zval *zsession, *channels, *sftp;
+	LIBSSH2_SESSION *session;
+	php_ssh2_session_data *data;
+	long opened = 0;
+	int i;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "r", &zsession) == FAILURE) {
+		return;
+	}
+
+	ZEND_FETCH_RESOURCE(session, LIBSSH2_SESSION*, &zsession, -1, PHP_SSH2_SESSION_RES_NAME, le_ssh2_session);
+	data = *(php_ssh2_session_data**)libssh2_session_abstract(session);
+
+	array_init(return_value);
+#ifdef PHP_SSH2_TRAFFIC_COUNTERS
+	php_ssh2_add_assoc_counter(return_value, "bytes_sent", data->bytes_sent);
+	php_ssh2_add_assoc_counter(return_value, "bytes_received", data->bytes_received);
+	add_assoc_long(return_value, "sends", data->stats.sends);
+	add_assoc_long(return_value, "recvs", data->stats.recvs);
+#else
+	add_assoc_null(return_value, "bytes_sent");
+	add_assoc_null(return_value, "bytes_received");
+	add_assoc_null(return_value, "sends");
+	add_assoc_null(return_value, "recvs");
+#endif
+	php_ssh2_add_assoc_counter(return_value, "channel_bytes_written", data->stats.channel_bytes_written);
+	php_ssh2_add_assoc_counter(return_value, "channel_bytes_read", data->stats.channel_bytes_read);
+	php_ssh2_add_assoc_counter(return_value, "sftp_bytes_written", data->stats.sftp_bytes_written);
+	php_ssh2_add_assoc_counter(return_value, "sftp_bytes_read", data->stats.sftp_bytes_read);
+
+	MAKE_STD_ZVAL(channels);
+	array_init(channels);
+	for(i = 0; i < PHP_SSH2_CHANNEL_KINDS; i++) {
+		add_assoc_long(channels, php_ssh2_stats_channel_names[i], data->stats.channels_opened[i]);
+		opened += data->stats.channels_opened[i];
+	}
+	add_assoc_long(return_value, "channels_opened", opened);
+	add_assoc_long(return_value, "channels_closed", data->stats.channels_closed);
+	add_assoc_long(return_value, "channels_open", opened - data->stats.channels_closed);
+	add_assoc_zval(return_value, "channels", channels);
+
+	MAKE_STD_ZVAL(sftp);
+	array_init(sftp);
+	for(i = 0; i < PHP_SSH2_SFTP_OPS; i++) {
+		add_assoc_long(sftp, php_ssh2_stats_sftp_names[i], data->stats.sftp_requests[i]);
+	}
+	add_assoc_zval(return_value, "sftp_requests", sftp);
+
+	add_assoc_long(return_value, "eagain", data->stats.eagain);
+	add_assoc_double(return_value, "blocked", data->stats.blocked / 1000.0);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,290 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 4                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2006 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 2.02 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available at through the world-wide-web at                           |
+  | http://www.php.net/license/2_02.txt.                                 |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Sara Golemon <pollita@php.net>                               |
+  +----------------------------------------------------------------------+
+
+  $Id$
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ssh2.h"
+
+#ifdef PHP_SSH2_THREADS
+
+#include <pthread.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+/* Key exchange and public key signing are CPU bound, ssh2_connect_multi(..., array('threads' => N))
+ * spreads them over N threads which each take the next job off a shared queue
+ *
+ * Nothing in here may touch the engine: no emalloc, no errors, no zvals
+ * The libssh2 sessions are created with the persistent allocators (plain malloc) and without
+ * userspace callbacks, the credentials in data->async are only read
+ * libssh2_init() is done in MINIT so the crypto backend is set up before any thread starts
+ */
+
+typedef struct _php_ssh2_thread_queue {
+	pthread_mutex_t lock;
+	php_ssh2_thread_job *jobs;
+	int num_jobs;
+	int next;
+} php_ssh2_thread_queue;
+
+/* {{{ php_ssh2_thread_fail
+ */
+static void php_ssh2_thread_fail(php_ssh2_thread_job *job, const char *what)
+{
+	char *error_msg = NULL;
+	int last_error;
+
+	last_error = libssh2_session_last_error(job->session, &error_msg, NULL, 0);
+	snprintf(job->error, sizeof(job->error), "%s(%d): %s", what, last_error, error_msg ? error_msg : "");
+	job->failed = 1;
+}
+/* }}} */
+
+/* {{{ php_ssh2_thread_timeout
+ * The session's own deadline for a phase, the job's timeout when it has none or the job's is shorter
+ * -1 when neither has one, which is what poll() takes for waiting indefinitely
+ */
+static int php_ssh2_thread_timeout(php_ssh2_thread_job *job, int phase)
+{
+	long timeout = job->data->timeouts[phase];
+
+	if (job->timeout > 0 && (timeout <= 0 || job->timeout < timeout)) {
+		timeout = job->timeout;
+	}
+	return timeout > 0 ? (int)timeout : -1;
+}
+/* }}} */
+
+#ifdef PHP_SSH2_SESSION_TIMEOUT
+/* {{{ php_ssh2_thread_session_timeout
+ * libssh2 spells "no timeout" as 0
+ */
+static void php_ssh2_thread_session_timeout(php_ssh2_thread_job *job, int phase)
+{
+	int timeout = php_ssh2_thread_timeout(job, phase);
+
+	libssh2_session_set_timeout(job->session, timeout > 0 ? timeout : 0);
+}
+/* }}} */
+#endif
+
+/* {{{ php_ssh2_thread_connect
+ * Resolve and connect, giving up after the connect timeout per address
+ */
+static int php_ssh2_thread_connect(php_ssh2_thread_job *job)
+{
+	struct addrinfo hints, *res, *ai;
+	char port[16];
+	int fd = -1, rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port, sizeof(port), "%d", job->port);
+
+	if ((rc = getaddrinfo(job->host, port, &hints, &res)) != 0) {
+		snprintf(job->error, sizeof(job->error), "Unable to resolve %s: %s", job->host, gai_strerror(rc));
+		job->failed = 1;
+		return -1;
+	}
+
+	for(ai = res; ai; ai = ai->ai_next) {
+		int flags, error = 0;
+		socklen_t error_len = sizeof(error);
+
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+
+		flags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+			struct pollfd pfd;
+
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+
+			if (errno != EINPROGRESS || poll(&pfd, 1, php_ssh2_thread_timeout(job, PHP_SSH2_TIMEOUT_CONNECT)) <= 0 ||
+				getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error) {
+				close(fd);
+				fd = -1;
+				continue;
+			}
+		}
+
+		fcntl(fd, F_SETFL, flags);
+		break;
+	}
+	freeaddrinfo(res);
+
+	if (fd < 0) {
+		snprintf(job->error, sizeof(job->error), "Unable to connect to %s on port %d", job->host, job->port);
+		job->failed = 1;
+	}
+
+	return fd;
+}
+/* }}} */
+
+/* {{{ php_ssh2_thread_handshake
+ * Connect, start up and authenticate one session, blocking this thread only
+ */
+static void php_ssh2_thread_handshake(php_ssh2_thread_job *job)
+{
+	php_ssh2_async_data *async = job->data->async;
+	int rc;
+
+	job->data->socket = php_ssh2_thread_connect(job);
+	if (job->data->socket < 0) {
+		return;
+	}
+	/* Tuning is best effort, there is nobody to warn from here */
+	php_ssh2_sockopts_apply(job->data->socket, &job->sockopts);
+
+	libssh2_session_set_blocking(job->session, 1);
+#ifdef PHP_SSH2_SESSION_TIMEOUT
+	php_ssh2_thread_session_timeout(job, PHP_SSH2_TIMEOUT_HANDSHAKE);
+#endif
+
+	if (libssh2_session_startup(job->session, job->data->socket)) {
+		php_ssh2_thread_fail(job, "Error starting up SSH connection");
+		return;
+	}
+	job->handshaken = 1;
+
+	if (job->known_hosts) {
+		const char *blob;
+		size_t blob_len;
+		int type, result = PHP_SSH2_KNOWNHOST_MISMATCH;
+
+		if ((blob = libssh2_session_hostkey(job->session, &blob_len, &type))) {
+			result = php_ssh2_known_hosts_lookup(job->known_hosts, job->host, job->port, blob, blob_len, type, 0);
+		}
+		if (result == PHP_SSH2_KNOWNHOST_REVOKED || result == PHP_SSH2_KNOWNHOST_MISMATCH ||
+			(result == PHP_SSH2_KNOWNHOST_NOTFOUND && job->known_hosts_strict)) {
+			snprintf(job->error, sizeof(job->error), "Host key for %s %s", job->host,
+				result == PHP_SSH2_KNOWNHOST_REVOKED ? "is revoked" : (result == PHP_SSH2_KNOWNHOST_NOTFOUND ? "is not known" : "does not match"));
+			job->failed = 1;
+			return;
+		}
+	}
+
+	if (async->username) {
+#ifdef PHP_SSH2_SESSION_TIMEOUT
+		php_ssh2_thread_session_timeout(job, PHP_SSH2_TIMEOUT_AUTH);
+#endif
+		if (async->password) {
+			rc = libssh2_userauth_password_ex(job->session, async->username, async->username_len, async->password, async->password_len, NULL);
+		} else {
+			rc = libssh2_userauth_publickey_fromfile_ex(job->session, async->username, async->username_len, async->pubkey_file, async->privkey_file, async->passphrase);
+		}
+		if (rc) {
+			php_ssh2_thread_fail(job, "Authentication failed");
+			return;
+		}
+	}
+	/* The PHP thread switches the session over to its operation timeout */
+}
+/* }}} */
+
+/* {{{ php_ssh2_thread_main
+ */
+static void *php_ssh2_thread_main(void *arg)
+{
+	php_ssh2_thread_queue *queue = (php_ssh2_thread_queue*)arg;
+
+	for(;;) {
+		int i;
+
+		pthread_mutex_lock(&queue->lock);
+		i = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+
+		if (i >= queue->num_jobs) {
+			break;
+		}
+		php_ssh2_thread_handshake(&queue->jobs[i]);
+	}
+
+	return NULL;
+}
+/* }}} */
+
+/* {{{ php_ssh2_threads_run
+ * Run all jobs on up to num_threads threads and wait for them to finish
+ * If no thread can be started the calling thread works through the queue itself
+ */
+void php_ssh2_threads_run(php_ssh2_thread_job *jobs, int num_jobs, int num_threads)
+{
+	php_ssh2_thread_queue queue;
+	pthread_t *threads;
+	int started = 0, i;
+
+	if (num_jobs <= 0) {
+		return;
+	}
+	if (num_threads > num_jobs) {
+		num_threads = num_jobs;
+	}
+
+	queue.jobs = jobs;
+	queue.num_jobs = num_jobs;
+	queue.next = 0;
+	pthread_mutex_init(&queue.lock, NULL);
+
+	threads = safe_emalloc(num_threads, sizeof(pthread_t), 0);
+	for(i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[started], NULL, php_ssh2_thread_main, &queue) == 0) {
+			started++;
+		}
+	}
+
+	if (!started) {
+		php_ssh2_thread_main(&queue);
+	}
+
+	for(i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	efree(threads);
+	pthread_mutex_destroy(&queue.lock);
+}
+/* }}} */
+
+#endif /* PHP_SSH2_THREADS */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * indent-tabs-mode: t
+ * End:
+ * vim600: fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
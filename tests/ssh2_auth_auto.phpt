@@ -0,0 +1,60 @@
+--TEST--
+ssh2_auth_auto() What worked last time is tried first, a failed hint is forgotten
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth();
+  if (TEST_SSH2_AUTH != 'password') print "skip needs TEST_SSH2_AUTH == 'password'";
+  if (!trim(shell_exec('command -v ssh-keygen'))) print "skip ssh-keygen not found";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+/* Authentication attempts per method since the last reset */
+function ssh2t_auth_attempts() {
+  $stats = ssh2_latency_stats();
+  $attempts = array();
+  foreach (array('publickey', 'password', 'keyboard-interactive') as $method) {
+    $attempts[$method] = isset($stats["auth.$method"]) ? $stats["auth.$method"]['count'] : 0;
+  }
+  return $attempts;
+}
+
+function ssh2t_auth_auto($credentials) {
+  ssh2_latency_reset();
+  $ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+  return @ssh2_auth_auto($ssh, TEST_SSH2_USER, $credentials);
+}
+
+/* A key the server has never heard of, it goes ahead of the password without a hint */
+$key = sys_get_temp_dir() . '/php-ssh2-key-' . uniqid();
+shell_exec('ssh-keygen -q -t rsa -b 2048 -N "" -f ' . escapeshellarg($key));
+$credentials = array('pubkey_file' => "$key.pub", 'privkey_file' => $key, 'password' => TEST_SSH2_PASS);
+
+$method = ssh2t_auth_auto($credentials);
+var_dump($method == 'password' || $method == 'keyboard-interactive');
+$attempts = ssh2t_auth_attempts();
+var_dump($attempts['publickey']);
+
+echo "**The hinted method goes first\n";
+var_dump(ssh2t_auth_auto($credentials) === $method);
+$attempts = ssh2t_auth_attempts();
+var_dump($attempts['publickey'], $attempts[$method]);
+
+echo "**A failing hint is dropped\n";
+var_dump(ssh2t_auth_auto(array('password' => 'not-' . uniqid())));
+var_dump(ssh2t_auth_auto($credentials) === $method);
+$attempts = ssh2t_auth_attempts();
+var_dump($attempts['publickey']);
+
+unlink($key);
+unlink("$key.pub");
+--EXPECT--
+bool(true)
+int(1)
+**The hinted method goes first
+bool(true)
+int(0)
+int(1)
+**A failing hint is dropped
+bool(false)
+bool(true)
+int(1)
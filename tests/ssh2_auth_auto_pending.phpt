@@ -0,0 +1,20 @@
+--TEST--
+ssh2_auth_auto() Refused before the handshake is done
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port);
+var_dump(ssh2_auth_auto($ssh, 'nobody', array('password' => 'secret', 'agent' => true)));
+
+echo "**Arguments\n";
+var_dump(@ssh2_auth_auto($ssh, 'nobody'));
+var_dump(@ssh2_auth_auto($ssh, 'nobody', 'secret'));
+--EXPECTF--
+Warning: ssh2_auth_auto(): Connection not established yet in %s on line %d
+bool(false)
+**Arguments
+NULL
+NULL
@@ -0,0 +1,35 @@
+--TEST--
+ssh2_auth_password() Sessions authenticating side by side answer with their own password
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth();
+  if (TEST_SSH2_AUTH != 'password') print "skip needs TEST_SSH2_AUTH == 'password'";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$a = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+$b = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+$methods = ssh2_auth_none($a, TEST_SSH2_USER);
+$kbdint = is_array($methods) && in_array('keyboard-interactive', $methods);
+
+ssh2_latency_reset();
+var_dump(@ssh2_auth_password($a, TEST_SSH2_USER, 'not-' . uniqid()));
+var_dump(ssh2_auth_password($b, TEST_SSH2_USER, TEST_SSH2_PASS));
+var_dump(ssh2_auth_password($a, TEST_SSH2_USER, TEST_SSH2_PASS));
+
+/* Whenever the server asks, keyboard-interactive is what answered */
+$stats = ssh2_latency_stats();
+var_dump(isset($stats['auth.keyboard-interactive']) == $kbdint);
+
+echo "**Still their own sessions\n";
+$stream = ssh2_exec($b, 'echo b');
+stream_set_blocking($stream, true);
+var_dump(stream_get_contents($stream));
+--EXPECT--
+bool(false)
+bool(true)
+bool(true)
+bool(true)
+**Still their own sessions
+string(2) "b
+"
@@ -0,0 +1,20 @@
+--TEST--
+ssh2_auth_pubkey_memory() Refused before the handshake is done
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port);
+var_dump(ssh2_auth_pubkey_memory($ssh, 'nobody', '', 'not a key'));
+
+echo "**Arguments\n";
+var_dump(@ssh2_auth_pubkey_memory($ssh, 'nobody'));
+var_dump(@ssh2_key_cache_clear(true, 1));
+--EXPECTF--
+Warning: ssh2_auth_pubkey_memory(): %s in %s on line %d
+bool(false)
+**Arguments
+%s
+NULL
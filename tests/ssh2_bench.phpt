@@ -0,0 +1,58 @@
+--TEST--
+ssh2.method_benchmark Only strong methods are measured, fastest first
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (strpos(ob_get_clean(), 'method benchmark => MB/s') === false) print "skip built without the method benchmark";
+?>
+--INI--
+ssh2.method_benchmark=5
+--FILE--
+<?php
+
+ob_start();
+phpinfo(INFO_MODULES);
+$info = ob_get_clean();
+$info = substr($info, strpos($info, 'method benchmark => MB/s') + strlen('method benchmark => MB/s'));
+
+$crypt = $mac = array();
+foreach (explode("\n", trim($info)) as $line) {
+  if (!preg_match('/^(\S+) => ([\d.]+)$/', $line, $m)) {
+    break;
+  }
+  if (strpos($m[1], 'hmac-') === 0) {
+    $mac[$m[1]] = (float)$m[2];
+  } else {
+    $crypt[$m[1]] = (float)$m[2];
+  }
+}
+
+$strong_crypt = array('chacha20-poly1305@openssh.com', 'aes128-gcm@openssh.com', 'aes256-gcm@openssh.com', 'aes128-ctr', 'aes192-ctr', 'aes256-ctr');
+$strong_mac = array('hmac-sha2-256-etm@openssh.com', 'hmac-sha2-256', 'hmac-sha2-512-etm@openssh.com', 'hmac-sha2-512');
+
+echo "**Rows\n";
+var_dump(count($mac));
+var_dump(array_diff(array_keys($crypt), $strong_crypt), array_diff(array_keys($mac), $strong_mac));
+var_dump(count($crypt) == 0 || isset($crypt['aes256-ctr']));
+
+echo "**Fastest first\n";
+$sorted = $crypt;
+arsort($sorted);
+var_dump(array_values($sorted) === array_values($crypt));
+$sorted = $mac;
+arsort($sorted);
+var_dump(array_values($sorted) === array_values($mac));
+var_dump(min($mac) > 0);
+--EXPECT--
+**Rows
+int(4)
+array(0) {
+}
+array(0) {
+}
+bool(true)
+**Fastest first
+bool(true)
+bool(true)
+bool(true)
@@ -0,0 +1,50 @@
+--TEST--
+ssh2.method_benchmark Sessions negotiate a measured method unless methods names one
+--SKIPIF--
+<?php require('ssh2_skip.inc');
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (strpos(ob_get_clean(), 'method benchmark => MB/s') === false) print "skip built without the method benchmark";
+?>
+--INI--
+ssh2.method_benchmark=5
+--FILE--
+<?php require('ssh2_test.inc');
+
+ob_start();
+phpinfo(INFO_MODULES);
+$info = ob_get_clean();
+$info = substr($info, strpos($info, 'method benchmark => MB/s') + strlen('method benchmark => MB/s'));
+
+$measured = array();
+foreach (explode("\n", trim($info)) as $line) {
+  if (!preg_match('/^(\S+) => [\d.]+$/', $line, $m)) {
+    break;
+  }
+  $measured[] = $m[1];
+}
+
+echo "**Benchmark order\n";
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+$mn = ssh2_methods_negotiated($ssh);
+var_dump(in_array($mn['client_to_server']['crypt'], $measured), in_array($mn['server_to_client']['crypt'], $measured));
+var_dump(in_array($mn['client_to_server']['mac'], $measured) || strpos($mn['client_to_server']['crypt'], '-gcm@') !== false || strpos($mn['client_to_server']['crypt'], 'poly1305') !== false);
+
+echo "**methods wins\n";
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, array(
+  'client_to_server' => array('crypt' => 'aes256-ctr', 'mac' => 'hmac-sha2-512'),
+  'server_to_client' => array('crypt' => 'aes256-ctr', 'mac' => 'hmac-sha2-512'),
+));
+$mn = ssh2_methods_negotiated($ssh);
+var_dump($mn['client_to_server']['crypt'], $mn['client_to_server']['mac']);
+var_dump($mn['server_to_client']['crypt'], $mn['server_to_client']['mac']);
+--EXPECT--
+**Benchmark order
+bool(true)
+bool(true)
+bool(true)
+**methods wins
+string(10) "aes256-ctr"
+string(13) "hmac-sha2-512"
+string(10) "aes256-ctr"
+string(13) "hmac-sha2-512"
@@ -0,0 +1,58 @@
+--TEST--
+ssh2.breaker_threshold Repeated failures open the circuit, connects then fail fast
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.breaker_threshold=2
+ssh2.breaker_backoff=60000
+ssh2.dns_cache_negative_ttl=60
+--FILE--
+<?php
+var_dump(ssh2_breaker_stats());
+
+for ($i = 0; $i < 2; $i++) {
+  var_dump(@ssh2_connect('127.0.0.1', 1));
+}
+$stats = ssh2_breaker_stats();
+$breaker = $stats['127.0.0.1:1'];
+var_dump($breaker['state'], $breaker['failures'], $breaker['opened'], $breaker['backoff']);
+var_dump($breaker['retry_in'] > 0 && $breaker['retry_in'] <= 60000);
+
+echo "**Open circuit\n";
+var_dump(ssh2_connect('127.0.0.1', 1));
+$stats = ssh2_breaker_stats();
+var_dump($stats['127.0.0.1:1']['failures']);
+
+echo "**Names too long for a breaker key are not tracked\n";
+$host = str_repeat('a', 60) . '.' . str_repeat('b', 1000) . '.invalid';
+for ($i = 0; $i < 3; $i++) {
+  @ssh2_connect($host, 22);
+}
+var_dump(array_keys(ssh2_breaker_stats()));
+
+echo "**Arguments\n";
+var_dump(@ssh2_breaker_stats(1));
+--EXPECTF--
+array(0) {
+}
+bool(false)
+bool(false)
+string(4) "open"
+int(2)
+int(1)
+int(60000)
+bool(true)
+**Open circuit
+
+Warning: ssh2_connect(): Unable to connect to 127.0.0.1 on port 1: Circuit open for 127.0.0.1:1 after 2 failures, retrying in %d ms in %s on line %d
+
+Warning: ssh2_connect(): Unable to connect to 127.0.0.1 in %s on line %d
+bool(false)
+int(2)
+**Names too long for a breaker key are not tracked
+array(1) {
+  [0]=>
+  string(11) "127.0.0.1:1"
+}
+**Arguments
+NULL
@@ -0,0 +1,36 @@
+--TEST--
+ssh2.breaker_threshold The breaker table is capped, open circuits outlive closed ones
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  if (PHP_OS != 'Linux') print "skip needs all of 127.0.0.0/8 on loopback";
+?>
+--INI--
+ssh2.breaker_threshold=2
+ssh2.breaker_backoff=60000
+--FILE--
+<?php
+function ssh2t_fail_hosts($first, $count) {
+  for ($i = $first; $i < $first + $count; $i++) {
+    @ssh2_connect('127.0.' . (int)($i / 250) . '.' . ($i % 250 + 1), 1);
+  }
+}
+
+/* One failure each, the table fills up with closed circuits and starts over */
+ssh2t_fail_hosts(0, 1100);
+var_dump(count(ssh2_breaker_stats()));
+
+echo "**Open circuits are kept, further hosts go untracked\n";
+ini_set('ssh2.breaker_threshold', 1);
+ssh2t_fail_hosts(2000, 1100);
+$states = array();
+foreach (ssh2_breaker_stats() as $breaker) {
+  $states[$breaker['state']] = isset($states[$breaker['state']]) ? $states[$breaker['state']] + 1 : 1;
+}
+var_dump($states);
+--EXPECT--
+int(76)
+**Open circuits are kept, further hosts go untracked
+array(1) {
+  ["open"]=>
+  int(1024)
+}
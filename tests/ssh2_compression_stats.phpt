@@ -0,0 +1,44 @@
+--TEST--
+ssh2_compression_stats() Nothing learned before any payload moved
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+var_dump(ssh2_compression_stats());
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port);
+$stats = ssh2_compression_stats($ssh);
+foreach (array('client_to_server', 'server_to_client') as $direction) {
+  echo "$direction\n";
+  var_dump($stats[$direction]);
+}
+
+echo "**Arguments\n";
+var_dump(@ssh2_compression_stats($srv));
+var_dump(@ssh2_compression_stats($ssh, 1));
+--EXPECT--
+array(0) {
+}
+client_to_server
+array(3) {
+  ["estimated_ratio"]=>
+  float(0)
+  ["rate"]=>
+  float(0)
+  ["recommended"]=>
+  string(4) "none"
+}
+server_to_client
+array(3) {
+  ["estimated_ratio"]=>
+  float(0)
+  ["rate"]=>
+  float(0)
+  ["recommended"]=>
+  string(4) "none"
+}
+**Arguments
+bool(false)
+NULL
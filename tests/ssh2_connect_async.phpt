@@ -0,0 +1,24 @@
+--TEST--
+ssh2_connect_async() Drive a non-blocking connect to completion
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth(); ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$ssh = ssh2_connect_async(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+var_dump(get_resource_type($ssh));
+
+while (($rc = ssh2_connect_step($ssh)) !== true) {
+  if ($rc === false) {
+    die("failed\n");
+  }
+  ssh2_connect_wait(array($ssh), 5000);
+}
+var_dump(ssh2_connect_step($ssh));
+var_dump(is_array(ssh2_methods_negotiated($ssh)));
+var_dump(ssh2t_auth($ssh));
+--EXPECT--
+string(12) "SSH2 Session"
+bool(true)
+bool(true)
+bool(true)
@@ -0,0 +1,23 @@
+--TEST--
+ssh2_connect_async() Credentials are read without touching the auth array, NULL counts as absent
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+
+$auth = array('username' => 'nobody', 'password' => null);
+var_dump(ssh2_connect_async('127.0.0.1', $port, null, null, $auth));
+
+echo "**Non-string credentials stay as they were\n";
+$auth = array('username' => 'nobody', 'password' => 'secret', 'passphrase' => 1234, 'pubkey_file' => false);
+var_dump(get_resource_type(ssh2_connect_async('127.0.0.1', $port, null, null, $auth)));
+var_dump($auth['passphrase'], $auth['pubkey_file']);
+--EXPECTF--
+Warning: ssh2_connect_async(): Authentication requires either a password or a pubkey_file and privkey_file in %s on line %d
+bool(false)
+**Non-string credentials stay as they were
+string(12) "SSH2 Session"
+int(1234)
+bool(false)
@@ -0,0 +1,42 @@
+--TEST--
+ssh2_connect_async() Sessions are refused until the handshake is done
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port);
+var_dump(get_resource_type($ssh));
+var_dump(ssh2_methods_negotiated($ssh));
+var_dump(ssh2_auth_none($ssh, 'nobody'));
+var_dump(ssh2_exec($ssh, 'true'));
+
+echo "**Peer hangs up\n";
+fclose(stream_socket_accept($srv, 5));
+do {
+  $rc = @ssh2_connect_step($ssh);
+  if (is_int($rc)) {
+    ssh2_connect_wait(array($ssh), 1000);
+  }
+} while (is_int($rc));
+var_dump($rc);
+var_dump(ssh2_methods_negotiated($ssh));
+--EXPECTF--
+string(12) "SSH2 Session"
+
+Warning: ssh2_methods_negotiated(): Connection not established yet in %s on line %d
+bool(false)
+
+Warning: ssh2_auth_none(): Connection not established yet in %s on line %d
+bool(false)
+
+Warning: ssh2_exec(): Connection not authenticated in %s on line %d
+bool(false)
+**Peer hangs up
+bool(false)
+
+Warning: ssh2_methods_negotiated(): Connection not established yet in %s on line %d
+bool(false)
@@ -0,0 +1,71 @@
+--TEST--
+ssh2_connect_multi() Invalid targets, refused and hanging hosts are reported per key
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  if (!getenv('TEST_PHP_EXECUTABLE') && !defined('PHP_BINARY')) print "skip no PHP binary to run a peer with";
+?>
+--INI--
+ssh2.breaker_threshold=5
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$result = ssh2_connect_multi(array(
+  'no-host' => array('port' => 22),
+  'number'  => 42,
+  'methods' => array('host' => '127.0.0.1', 'methods' => 'none'),
+  'refused' => array('host' => '127.0.0.1', 'port' => 1),
+  'hangs'   => array('host' => '127.0.0.1', 'port' => $port),
+), array('timeout' => 200));
+
+var_dump($result['sessions']);
+ksort($result['errors']);
+foreach ($result['errors'] as $key => $error) {
+  echo "$key: ", (strpos($error, 'Invalid target') === 0 ? 'invalid' : ($error == 'Timed out' ? 'timed out' : 'failed')), "\n";
+}
+
+echo "**A hanging host counts against its breaker\n";
+$breakers = ssh2_breaker_stats();
+var_dump($breakers["127.0.0.1:$port"]['failures']);
+
+echo "**A timeout of 0 waits for the peer\n";
+/* A peer in another process which hangs up after a while, only then may the target fail */
+$php = getenv('TEST_PHP_EXECUTABLE') ? getenv('TEST_PHP_EXECUTABLE') : PHP_BINARY;
+$peer = proc_open(escapeshellarg($php) . ' -n -r ' . escapeshellarg('
+  $srv = stream_socket_server("tcp://127.0.0.1:0");
+  $name = stream_socket_get_name($srv, false);
+  echo substr($name, strrpos($name, ":") + 1), "\n";
+  flush();
+  $conn = stream_socket_accept($srv, 5);
+  usleep(300000);
+  fclose($conn);
+'), array(1 => array('pipe', 'w')), $pipes);
+$peer_port = (int)fgets($pipes[1]);
+$result = ssh2_connect_multi(array('later' => array('host' => '127.0.0.1', 'port' => $peer_port)), array('timeout' => 0));
+var_dump($result['errors']['later'] != 'Timed out');
+fclose($pipes[1]);
+proc_close($peer);
+
+echo "**No targets\n";
+var_dump(ssh2_connect_multi(array()));
+--EXPECT--
+array(0) {
+}
+hangs: timed out
+methods: invalid
+no-host: invalid
+number: invalid
+refused: failed
+**A hanging host counts against its breaker
+int(1)
+**A timeout of 0 waits for the peer
+bool(true)
+**No targets
+array(2) {
+  ["sessions"]=>
+  array(0) {
+  }
+  ["errors"]=>
+  array(0) {
+  }
+}
@@ -0,0 +1,21 @@
+--TEST--
+ssh2_connect_multi() Builds without handshake threads connect from the calling thread
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (strpos(ob_get_clean(), 'handshake threads => disabled') === false) print "skip built with handshake threads";
+?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php
+$result = ssh2_connect_multi(array('refused' => array('host' => '127.0.0.1', 'port' => 1)), array('threads' => 4));
+var_dump(count($result['sessions']), array_keys($result['errors']));
+--EXPECTF--
+Notice: ssh2_connect_multi(): Handshake threads are not available in this build, connecting from this thread in %s on line %d
+int(0)
+array(1) {
+  [0]=>
+  string(7) "refused"
+}
@@ -0,0 +1,54 @@
+--TEST--
+ssh2_connect_multi() Handshake threads work through hanging and refused hosts side by side
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  ob_start();
+  phpinfo(INFO_MODULES);
+  $info = ob_get_clean();
+  if (strpos($info, 'handshake threads => enabled') === false) print "skip built without handshake threads";
+  preg_match('/^libssh2 version => ([\d.]+)/m', $info, $m);
+  if (version_compare($m[1], '1.2.9', '<')) print "skip libssh2 too old to time out a handshake";
+?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+$targets = array('refused' => array('host' => '127.0.0.1', 'port' => 1), 'invalid' => 42);
+$srvs = array();
+for ($i = 0; $i < 4; $i++) {
+  $srvs[] = ssh2t_listen($port);
+  $targets["hangs$i"] = array('host' => '127.0.0.1', 'port' => $port);
+}
+
+/* One after the other these would take four timeouts */
+$started = microtime(true);
+$result = ssh2_connect_multi($targets, array('timeout' => 500, 'threads' => 4));
+$elapsed = microtime(true) - $started;
+
+var_dump($result['sessions']);
+ksort($result['errors']);
+foreach ($result['errors'] as $key => $error) {
+  echo "$key: ", (strpos($error, 'Invalid target') === 0 ? 'invalid' : 'failed'), "\n";
+}
+var_dump($elapsed < 1.5);
+
+echo "**More threads than targets\n";
+$result = ssh2_connect_multi(array('refused' => array('host' => '127.0.0.1', 'port' => 1)), array('threads' => 16));
+var_dump(count($result['sessions']), array_keys($result['errors']));
+--EXPECT--
+array(0) {
+}
+hangs0: failed
+hangs1: failed
+hangs2: failed
+hangs3: failed
+invalid: invalid
+refused: failed
+bool(true)
+**More threads than targets
+int(0)
+array(1) {
+  [0]=>
+  string(7) "refused"
+}
@@ -0,0 +1,44 @@
+--TEST--
+ssh2.dns_cache_size Lookups are answered from the resolver cache, failed ones too
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  if (version_compare(PHP_VERSION, '5.1', '<')) print "skip resolver cache needs PHP 5.1 or later";
+  if (gethostbyname('localhost') == 'localhost') print "skip localhost does not resolve";
+?>
+--INI--
+ssh2.dns_cache_size=16
+ssh2.dns_cache_ttl=60
+ssh2.dns_cache_negative_ttl=60
+ssh2.breaker_threshold=0
+--FILE--
+<?php
+function ssh2t_dns_stats() {
+  ob_start();
+  phpinfo(INFO_MODULES);
+  $info = ob_get_clean();
+  $stats = array();
+  foreach (array('entries', 'hits', 'misses') as $name) {
+    preg_match("/^resolver cache $name => (\\d+)$/m", $info, $m);
+    $stats[] = "$name={$m[1]}";
+  }
+  echo implode(' ', $stats), "\n";
+}
+
+ssh2t_dns_stats();
+for ($i = 0; $i < 3; $i++) {
+  @ssh2_connect('localhost', 1);
+}
+ssh2t_dns_stats();
+
+echo "**Negative entries\n";
+for ($i = 0; $i < 2; $i++) {
+  var_dump(@ssh2_connect('no-such-host.invalid', 22));
+}
+ssh2t_dns_stats();
+--EXPECT--
+entries=0 hits=0 misses=0
+entries=1 hits=2 misses=1
+**Negative entries
+bool(false)
+bool(false)
+entries=2 hits=3 misses=2
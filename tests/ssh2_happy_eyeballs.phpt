@@ -0,0 +1,72 @@
+--TEST--
+ssh2_connect() Dual-stack address order and the remembered family
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  if (version_compare(PHP_VERSION, '5.1', '<')) print "skip address ordering needs PHP 5.1 or later";
+  $v6 = @stream_socket_server('tcp://[::1]:0');
+  if (!$v6) die("skip no IPv6 loopback");
+  $v4 = stream_socket_server('tcp://127.0.0.1:0');
+  $name = stream_socket_get_name($v6, false);
+  $port6 = substr($name, strrpos($name, ':') + 1);
+  $name = stream_socket_get_name($v4, false);
+  $port4 = substr($name, strrpos($name, ':') + 1);
+  if (!@stream_socket_client("tcp://localhost:$port6", $errno, $errstr, 1) ||
+      !@stream_socket_client("tcp://localhost:$port4", $errno, $errstr, 1)) {
+    print "skip localhost does not resolve to both 127.0.0.1 and ::1";
+  }
+?>
+--INI--
+ssh2.breaker_threshold=0
+ssh2.connect_attempt_delay=250
+--FILE--
+<?php
+
+/* One port, listening on both loopback addresses, nobody ever speaks SSH */
+for ($i = 0; $i < 20; $i++) {
+  $v4 = stream_socket_server('tcp://127.0.0.1:0');
+  $name = stream_socket_get_name($v4, false);
+  $port = (int)substr($name, strrpos($name, ':') + 1);
+  if ($v6 = @stream_socket_server("tcp://[::1]:$port")) {
+    break;
+  }
+  fclose($v4);
+}
+
+function ssh2t_accepted($srv) {
+  $r = array($srv);
+  $w = $e = null;
+  if (!stream_select($r, $w, $e, 0, 500000)) {
+    return false;
+  }
+  fclose(stream_socket_accept($srv, 0));
+  return true;
+}
+
+echo "**IPv6 first for a host never connected to\n";
+$ssh = ssh2_connect_async('localhost', $port);
+var_dump(is_resource($ssh), ssh2t_accepted($v6), ssh2t_accepted($v4));
+unset($ssh);
+
+echo "**Refused IPv6 falls through to IPv4 at once\n";
+fclose($v6);
+$started = microtime(true);
+var_dump(@ssh2_connect('localhost', $port, array('timeouts' => array('handshake' => 200))));
+var_dump(ssh2t_accepted($v4), microtime(true) - $started < 5);
+
+echo "**IPv4 won, it goes first now\n";
+$v6 = stream_socket_server("tcp://[::1]:$port");
+$ssh = ssh2_connect_async('localhost', $port);
+var_dump(is_resource($ssh), ssh2t_accepted($v4), ssh2t_accepted($v6));
+--EXPECT--
+**IPv6 first for a host never connected to
+bool(true)
+bool(true)
+bool(false)
+**Refused IPv6 falls through to IPv4 at once
+bool(false)
+bool(true)
+bool(true)
+**IPv4 won, it goes first now
+bool(true)
+bool(true)
+bool(false)
@@ -0,0 +1,50 @@
+--TEST--
+ssh2_keepalive_tick() Interval from methods['keepalive'] or ssh2.keepalive_interval
+--SKIPIF--
+<?php require('ssh2_skip.inc');
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (!preg_match('/^libssh2 version => ([\d.]+)/m', ob_get_clean(), $m) || version_compare($m[1], '1.2.5', '<')) {
+    print "skip libssh2 < 1.2.5 has no keepalives";
+  }
+?>
+--INI--
+ssh2.keepalive_interval=3
+--FILE--
+<?php require('ssh2_test.inc');
+
+function ssh2t_tick($methods) {
+  $ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, $methods);
+  return ssh2_keepalive_tick($ssh);
+}
+
+/* The first tick sends right away, the next one is then a full interval out */
+$next = ssh2t_tick(array('keepalive' => array('interval' => 5, 'want_reply' => false)));
+var_dump($next > 0 && $next <= 5);
+$next = ssh2t_tick(array('keepalive' => '7'));
+var_dump($next > 0 && $next <= 7);
+
+echo "**ssh2.keepalive_interval\n";
+$next = ssh2t_tick(null);
+var_dump($next > 0 && $next <= 3);
+
+echo "**Off\n";
+var_dump(ssh2t_tick(array('keepalive' => 0)));
+var_dump(ssh2t_tick(array('keepalive' => array('interval' => -10))));
+
+echo "**Ticks in between don't move the next one out\n";
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, array('keepalive' => 60));
+$first = ssh2_keepalive_tick($ssh);
+sleep(2);
+$second = ssh2_keepalive_tick($ssh);
+var_dump($second < $first);
+--EXPECT--
+bool(true)
+bool(true)
+**ssh2.keepalive_interval
+bool(true)
+**Off
+int(0)
+int(0)
+**Ticks in between don't move the next one out
+bool(true)
@@ -0,0 +1,51 @@
+--TEST--
+ssh2_key_cache_clear() Key files are read once and dropped on request
+--SKIPIF--
+<?php require('ssh2_skip.inc');
+  if (!trim(shell_exec('command -v ssh-keygen'))) print "skip ssh-keygen not found";
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (!preg_match('/^libssh2 version => ([\d.]+)/m', ob_get_clean(), $m) || version_compare($m[1], '1.6.0', '<')) {
+    print "skip libssh2 < 1.6.0 has no key cache";
+  }
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+function ssh2t_cached_key_files() {
+  ob_start();
+  phpinfo(INFO_MODULES);
+  preg_match('/^cached key files => (\d+)$/m', ob_get_clean(), $m);
+  return (int)$m[1];
+}
+
+var_dump(ssh2_key_cache_clear());
+
+/* A key the server has never heard of, authentication fails but the files are read */
+$key = sys_get_temp_dir() . '/php-ssh2-key-' . uniqid();
+shell_exec('ssh-keygen -q -t rsa -b 2048 -N "" -f ' . escapeshellarg($key));
+
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+var_dump(@ssh2_auth_pubkey_file($ssh, TEST_SSH2_USER, "$key.pub", $key));
+var_dump(ssh2t_cached_key_files());
+
+echo "**Decrypted keys only\n";
+var_dump(ssh2_key_cache_clear(true));
+var_dump(ssh2t_cached_key_files());
+
+echo "**Everything\n";
+var_dump(ssh2_key_cache_clear());
+var_dump(ssh2t_cached_key_files());
+
+unlink($key);
+unlink("$key.pub");
+--EXPECT--
+int(0)
+bool(false)
+int(2)
+**Decrypted keys only
+int(0)
+int(2)
+**Everything
+int(2)
+int(0)
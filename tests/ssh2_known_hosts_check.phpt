@@ -0,0 +1,81 @@
+--TEST--
+ssh2_known_hosts_check() Plain, listed, wildcard, other key type and revoked entries
+--SKIPIF--
+<?php require('ssh2_skip.inc');
+  if (!trim(shell_exec('command -v ssh-keyscan'))) print "skip ssh-keyscan not found";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$name = (TEST_SSH2_PORT == 22) ? TEST_SSH2_HOSTNAME : '[' . TEST_SSH2_HOSTNAME . ']:' . TEST_SSH2_PORT;
+$keys = array();
+foreach (explode("\n", shell_exec('ssh-keyscan -p ' . (int)TEST_SSH2_PORT . ' ' . escapeshellarg(TEST_SSH2_HOSTNAME) . ' 2>/dev/null')) as $line) {
+  $fields = preg_split('/\s+/', trim($line));
+  if (count($fields) >= 3 && $fields[0][0] != '#') {
+    $keys[] = "$fields[1] $fields[2]";
+  }
+}
+
+/* Same key type, last byte of the key flipped */
+function ssh2t_known_hosts_wrong($key) {
+  list($type, $blob) = explode(' ', $key);
+  $blob = base64_decode($blob);
+  $blob[strlen($blob) - 1] = chr(ord($blob[strlen($blob) - 1]) ^ 1);
+  return "$type " . base64_encode($blob);
+}
+
+/* Some key type the server never offers */
+function ssh2t_known_hosts_other($key) {
+  list($type, $blob) = explode(' ', ssh2t_known_hosts_wrong($key));
+  return "x-other-$type@example.com $blob";
+}
+
+$wrong = array_map('ssh2t_known_hosts_wrong', $keys);
+$other = array_map('ssh2t_known_hosts_other', $keys);
+$cases = array(
+  'empty'    => '',
+  'plain'    => "# comment\n$name " . implode("\n$name ", $keys) . "\n",
+  'crlf'     => "# comment\r\n$name " . implode("\r\n$name ", $keys) . "\r\n",
+  'listed'   => "other.invalid,$name " . implode("\nother.invalid,$name ", $keys) . "\n",
+  'wildcard' => "* " . implode("\n* ", $keys) . "\n",
+  'mismatch' => "$name " . implode("\n$name ", $wrong) . "\n",
+  'other'    => "$name " . implode("\n$name ", $other) . "\n",
+  'two types' => "$name " . implode("\n$name ", $other) . "\n$name " . implode("\n$name ", $keys) . "\n",
+  'revoked'  => "$name " . implode("\n$name ", $keys) . "\n@revoked $name " . implode("\n@revoked $name ", $keys) . "\n",
+);
+$results = array(
+  SSH2_KNOWNHOST_MATCH => 'match', SSH2_KNOWNHOST_MISMATCH => 'mismatch',
+  SSH2_KNOWNHOST_NOTFOUND => 'notfound', SSH2_KNOWNHOST_REVOKED => 'revoked',
+);
+
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+$files = array();
+foreach ($cases as $case => $contents) {
+  $files[$case] = tempnam(sys_get_temp_dir(), 'php-ssh2-kh-');
+  file_put_contents($files[$case], $contents);
+  echo "$case: ", $results[ssh2_known_hosts_check($ssh, $files[$case])], "\n";
+}
+
+echo "**Strict checking refuses a mismatch\n";
+var_dump(@ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, array('known_hosts' => array('file' => $files['mismatch'], 'strict' => true))));
+
+echo "**Keys of other types only are not a mismatch\n";
+var_dump(is_resource(ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, array('known_hosts' => array('file' => $files['other'], 'strict' => false)))));
+
+foreach ($files as $file) {
+  unlink($file);
+}
+--EXPECT--
+empty: notfound
+plain: match
+crlf: match
+listed: match
+wildcard: match
+mismatch: mismatch
+other: notfound
+two types: match
+revoked: revoked
+**Strict checking refuses a mismatch
+bool(false)
+**Keys of other types only are not a mismatch
+bool(true)
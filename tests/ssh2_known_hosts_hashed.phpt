@@ -0,0 +1,40 @@
+--TEST--
+ssh2_known_hosts_check() Hashed entries with one line per key type
+--SKIPIF--
+<?php require('ssh2_skip.inc');
+  if (!function_exists('hash_hmac')) print "skip hash extension not loaded";
+  if (!trim(shell_exec('command -v ssh-keyscan'))) print "skip ssh-keyscan not found";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+function ssh2t_known_hosts_hashed($name, $type, $key) {
+  $salt = '';
+  for ($i = 0; $i < 20; $i++) {
+    $salt .= chr(mt_rand(0, 255));
+  }
+  return '|1|' . base64_encode($salt) . '|' . base64_encode(hash_hmac('sha1', $name, $salt, true)) . " $type $key\n";
+}
+
+$name = (TEST_SSH2_PORT == 22) ? TEST_SSH2_HOSTNAME : '[' . TEST_SSH2_HOSTNAME . ']:' . TEST_SSH2_PORT;
+$file = tempnam(sys_get_temp_dir(), 'php-ssh2-kh-');
+$lines = '';
+foreach (explode("\n", shell_exec('ssh-keyscan -p ' . (int)TEST_SSH2_PORT . ' ' . escapeshellarg(TEST_SSH2_HOSTNAME) . ' 2>/dev/null')) as $line) {
+  $fields = preg_split('/\s+/', trim($line));
+  if (count($fields) >= 3 && $fields[0][0] != '#') {
+    $lines .= ssh2t_known_hosts_hashed($name, $fields[1], $fields[2]);
+  }
+}
+/* A key type the server doesn't use, last so it is the last salt seen */
+$lines .= ssh2t_known_hosts_hashed($name, 'ssh-dss', base64_encode("\0\0\0\7ssh-dss" . str_repeat("\1", 64)));
+file_put_contents($file, $lines);
+
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, array('known_hosts' => array('file' => $file, 'strict' => true)));
+var_dump(get_resource_type($ssh));
+var_dump(ssh2_known_hosts_check($ssh, $file) === SSH2_KNOWNHOST_MATCH);
+var_dump(ssh2_known_hosts_check($ssh, $file) === SSH2_KNOWNHOST_MATCH);
+unlink($file);
+--EXPECT--
+string(12) "SSH2 Session"
+bool(true)
+bool(true)
@@ -0,0 +1,22 @@
+--TEST--
+ssh2_known_hosts_check() Refused before the handshake is done
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.known_hosts=
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port);
+var_dump(ssh2_known_hosts_check($ssh, __FILE__));
+
+echo "**Arguments\n";
+var_dump(@ssh2_known_hosts_check());
+var_dump(@ssh2_known_hosts_check($srv));
+--EXPECTF--
+Warning: ssh2_known_hosts_check(): Connection not established yet in %s on line %d
+bool(false)
+**Arguments
+NULL
+bool(false)
@@ -0,0 +1,80 @@
+--TEST--
+ssh2_latency_stats() Connect latencies, percentiles and reset
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+var_dump(ssh2_latency_stats());
+
+$srv = ssh2t_listen($port);
+for ($i = 0; $i < 5; $i++) {
+  $ssh = ssh2_connect_async('127.0.0.1', $port);
+  fclose(stream_socket_accept($srv, 5));
+  do {
+    $rc = @ssh2_connect_step($ssh);
+    if (is_int($rc)) {
+      ssh2_connect_wait(array($ssh), 1000);
+    }
+  } while (is_int($rc));
+}
+
+$stats = ssh2_latency_stats();
+var_dump(array_keys($stats));
+$connect = $stats['connect'];
+var_dump($connect['count']);
+echo implode(',', array_keys($connect['percentiles'])), "\n";
+var_dump($connect['min'] <= $connect['mean'] + 1e-9 && $connect['mean'] <= $connect['max'] + 1e-9);
+$last = $connect['min'];
+foreach ($connect['percentiles'] as $value) {
+  var_dump($value >= $last && $value <= $connect['max']);
+  $last = $value;
+}
+
+echo "**Requested percentiles\n";
+$stats = ssh2_latency_stats(array(0, 100, 75), 'connect');
+echo implode(',', array_keys($stats['connect']['percentiles'])), "\n";
+var_dump($stats['connect']['percentiles']['0'] == $connect['min'], $stats['connect']['percentiles']['100'] == $connect['max']);
+
+echo "**Reset\n";
+var_dump(ssh2_latency_reset('kex'));
+var_dump(ssh2_latency_reset('connect'));
+var_dump(ssh2_latency_stats());
+var_dump(ssh2_latency_reset());
+
+echo "**Unknown operations\n";
+var_dump(ssh2_latency_stats(null, 'nope'));
+var_dump(ssh2_latency_reset('nope'));
+--EXPECTF--
+array(0) {
+}
+array(1) {
+  [0]=>
+  string(7) "connect"
+}
+int(5)
+50,90,99,99.9
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+**Requested percentiles
+0,100,75
+bool(true)
+bool(true)
+**Reset
+bool(true)
+bool(true)
+array(0) {
+}
+bool(true)
+**Unknown operations
+
+Warning: ssh2_latency_stats(): Unknown operation 'nope' in %s on line %d
+bool(false)
+
+Warning: ssh2_latency_reset(): Unknown operation 'nope' in %s on line %d
+bool(false)
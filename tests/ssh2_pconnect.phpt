@@ -0,0 +1,23 @@
+--TEST--
+ssh2_pconnect() Persistent sessions are handed out again after release
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth(); ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(get_resource_type($ssh));
+var_dump(ssh2t_auth($ssh));
+$fingerprint = ssh2_fingerprint($ssh);
+unset($ssh);
+
+echo "**Reuse\n";
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(ssh2_fingerprint($ssh) === $fingerprint);
+var_dump(ssh2t_auth($ssh));
+--EXPECT--
+string(12) "SSH2 Session"
+bool(true)
+**Reuse
+bool(true)
+bool(true)
@@ -0,0 +1,29 @@
+--TEST--
+ssh2_pconnect() A pooled session stays locked until its own credentials are given
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth(); ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(ssh2t_auth($ssh));
+unset($ssh);
+
+echo "**Wrong credential\n";
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(@ssh2_auth_password($ssh, TEST_SSH2_USER, 'not-' . uniqid()));
+var_dump(@ssh2_exec($ssh, 'echo hello'));
+var_dump(@ssh2_sftp($ssh));
+
+echo "**Right credential\n";
+var_dump(ssh2t_auth($ssh));
+var_dump(is_resource(ssh2_exec($ssh, 'echo hello')));
+--EXPECT--
+bool(true)
+**Wrong credential
+bool(false)
+bool(false)
+bool(false)
+**Right credential
+bool(true)
+bool(true)
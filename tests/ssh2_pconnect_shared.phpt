@@ -0,0 +1,40 @@
+--TEST--
+ssh2.pool_shared Released persistent sessions go to the shared pool
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth();
+  if (!ZEND_THREAD_SAFE) print "skip needs a thread safe build";
+?>
+--INI--
+ssh2.pool_shared=1
+--FILE--
+<?php require('ssh2_test.inc');
+
+function ssh2t_pool_idle() {
+  ob_start();
+  phpinfo(INFO_MODULES);
+  $info = ob_get_clean();
+  preg_match('/^idle persistent sessions => (\d+)$/m', $info, $own);
+  preg_match('/^idle persistent sessions \(shared\) => (\d+)$/m', $info, $shared);
+  return "own=$own[1] shared=$shared[1]\n";
+}
+
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(ssh2t_auth($ssh));
+$fingerprint = ssh2_fingerprint($ssh);
+echo ssh2t_pool_idle();
+unset($ssh);
+echo ssh2t_pool_idle();
+
+echo "**Checked out again\n";
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(ssh2_fingerprint($ssh) === $fingerprint);
+echo ssh2t_pool_idle();
+var_dump(ssh2t_auth($ssh));
+--EXPECT--
+bool(true)
+own=0 shared=0
+own=0 shared=1
+**Checked out again
+bool(true)
+own=0 shared=0
+bool(true)
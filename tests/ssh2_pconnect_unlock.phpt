@@ -0,0 +1,44 @@
+--TEST--
+ssh2_pconnect() Naming an agent or a key path does not unlock a pooled session
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth();
+  if (TEST_SSH2_AUTH != 'password') print "skip needs TEST_SSH2_AUTH == 'password'";
+  if (!trim(shell_exec('command -v ssh-keygen'))) print "skip ssh-keygen not found";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+var_dump(ssh2t_auth($ssh));
+unset($ssh);
+
+$key = sys_get_temp_dir() . '/php-ssh2-key-' . uniqid();
+shell_exec('ssh-keygen -q -t rsa -b 2048 -N "" -f ' . escapeshellarg($key));
+
+$ssh = ssh2_pconnect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT, null, null, TEST_SSH2_USER);
+echo "**Agent\n";
+var_dump(@ssh2_auth_agent($ssh, TEST_SSH2_USER));
+echo "**Key files\n";
+var_dump(@ssh2_auth_pubkey_file($ssh, TEST_SSH2_USER, "$key.pub", $key));
+var_dump(@ssh2_auth_pubkey_file($ssh, TEST_SSH2_USER, "$key.pub", "$key.missing"));
+echo "**Auto\n";
+var_dump(@ssh2_auth_auto($ssh, TEST_SSH2_USER, array('agent' => true, 'pubkey_file' => "$key.pub", 'privkey_file' => $key)));
+var_dump(@ssh2_exec($ssh, 'echo hello'));
+
+echo "**Right credential\n";
+var_dump(ssh2t_auth($ssh));
+
+unlink($key);
+unlink("$key.pub");
+--EXPECT--
+bool(true)
+**Agent
+bool(false)
+**Key files
+bool(false)
+bool(false)
+**Auto
+bool(false)
+bool(false)
+**Right credential
+bool(true)
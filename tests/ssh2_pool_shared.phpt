@@ -0,0 +1,33 @@
+--TEST--
+ssh2.pool_shared The shared idle pool of a threaded build
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  if (!ZEND_THREAD_SAFE) print "skip needs a thread safe build";
+?>
+--INI--
+ssh2.pool_shared=1
+--FILE--
+<?php
+function ssh2t_pool_rows() {
+  ob_start();
+  phpinfo(INFO_MODULES);
+  preg_match_all('/^(idle persistent sessions(?: \(shared\))?) => (\d+)$/m', ob_get_clean(), $m, PREG_SET_ORDER);
+  foreach ($m as $row) {
+    echo "$row[1]: $row[2]\n";
+  }
+}
+
+ssh2t_pool_rows();
+var_dump(ini_get('ssh2.pool_shared'));
+
+echo "**Only at startup\n";
+var_dump(ini_set('ssh2.pool_shared', '0'));
+ssh2t_pool_rows();
+--EXPECT--
+idle persistent sessions: 0
+idle persistent sessions (shared): 0
+string(1) "1"
+**Only at startup
+bool(false)
+idle persistent sessions: 0
+idle persistent sessions (shared): 0
@@ -0,0 +1,22 @@
+--TEST--
+ssh2.pool_warm Failed entries are counted without reporting into the request
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.pool_warm=nobody@127.0.0.1:1|/nonexistent/id_rsa.pub|/nonexistent/id_rsa, not-an-entry
+ssh2.pool_warm_budget=2000
+ssh2.breaker_threshold=0
+--FILE--
+<?php
+ob_start();
+phpinfo(INFO_MODULES);
+$info = ob_get_clean();
+
+preg_match('/^pre-warmed sessions => (\d+)$/m', $info, $warmed);
+preg_match('/^pre-warm failures => (\d+)$/m', $info, $failures);
+var_dump($warmed[1], $failures[1]);
+var_dump(error_reporting() == ini_get('error_reporting'));
+--EXPECT--
+string(1) "0"
+string(1) "2"
+bool(true)
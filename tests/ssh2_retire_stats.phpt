@@ -0,0 +1,25 @@
+--TEST--
+ssh2_retire_stats() Retirement limits only apply to pooled sessions
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port, array('retire' => array('bytes' => 1024, 'time' => 60)));
+$stats = ssh2_retire_stats($ssh);
+var_dump($stats['retire_bytes'], $stats['retire_time'], $stats['due']);
+var_dump($stats['age'] >= 0);
+
+echo "**Arguments\n";
+var_dump(@ssh2_retire_stats());
+var_dump(@ssh2_retire_stats($srv));
+--EXPECTF--
+Warning: ssh2_connect_async(): methods['retire'] only applies to pooled sessions, ignoring it in %s on line %d
+int(0)
+int(0)
+bool(false)
+bool(true)
+**Arguments
+NULL
+bool(false)
@@ -0,0 +1,42 @@
+--TEST--
+ssh2_session_memory() A session is held to its memory limit
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+
+$ssh = ssh2_connect_async('127.0.0.1', $port, array('memory' => array('limit' => 1048576)));
+$memory = ssh2_session_memory($ssh);
+var_dump($memory['limit'], $memory['limit_failures']);
+var_dump($memory['bytes'] > 0 && $memory['bytes'] <= $memory['limit']);
+
+echo "**From ssh2.session_memory_limit\n";
+ini_set('ssh2.session_memory_limit', 2097152);
+$memory = ssh2_session_memory(ssh2_connect_async('127.0.0.1', $port));
+var_dump($memory['limit']);
+
+echo "**Too small for libssh2 to start\n";
+var_dump(ssh2_connect_async('127.0.0.1', $port, array('memory' => array('limit' => 1))));
+
+echo "**Arguments\n";
+var_dump(@ssh2_session_memory());
+var_dump(@ssh2_session_memory($srv));
+--EXPECTF--
+int(1048576)
+int(0)
+bool(true)
+**From ssh2.session_memory_limit
+int(2097152)
+**Too small for libssh2 to start
+
+Warning: ssh2_connect_async(): Unable to initialize SSH2 session in %s on line %d
+
+Warning: ssh2_connect_async(): Unable to initialize SSH2 session in %s on line %d
+bool(false)
+**Arguments
+NULL
+bool(false)
@@ -0,0 +1,87 @@
+--TEST--
+ssh2_session_stats() Counters of a session which never got past the handshake
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+$ssh = ssh2_connect_async('127.0.0.1', $port);
+fclose(stream_socket_accept($srv, 5));
+do {
+  $rc = @ssh2_connect_step($ssh);
+  if (is_int($rc)) {
+    ssh2_connect_wait(array($ssh), 1000);
+  }
+} while (is_int($rc));
+
+$stats = ssh2_session_stats($ssh);
+var_dump(array_keys($stats));
+var_dump($stats['channels_opened'], $stats['channels_open'], array_sum($stats['channels']), array_sum($stats['sftp_requests']));
+var_dump($stats['channel_bytes_written'], $stats['sftp_bytes_read']);
+var_dump(array_keys($stats['channels']));
+var_dump(count($stats['sftp_requests']));
+var_dump($stats['eagain'] >= 0, $stats['blocked'] >= 0);
+
+echo "**Arguments\n";
+var_dump(@ssh2_session_stats());
+var_dump(@ssh2_session_stats($srv));
+--EXPECT--
+array(15) {
+  [0]=>
+  string(10) "bytes_sent"
+  [1]=>
+  string(14) "bytes_received"
+  [2]=>
+  string(5) "sends"
+  [3]=>
+  string(5) "recvs"
+  [4]=>
+  string(21) "channel_bytes_written"
+  [5]=>
+  string(18) "channel_bytes_read"
+  [6]=>
+  string(18) "sftp_bytes_written"
+  [7]=>
+  string(15) "sftp_bytes_read"
+  [8]=>
+  string(15) "channels_opened"
+  [9]=>
+  string(15) "channels_closed"
+  [10]=>
+  string(13) "channels_open"
+  [11]=>
+  string(8) "channels"
+  [12]=>
+  string(13) "sftp_requests"
+  [13]=>
+  string(6) "eagain"
+  [14]=>
+  string(7) "blocked"
+}
+int(0)
+int(0)
+int(0)
+int(0)
+int(0)
+int(0)
+array(5) {
+  [0]=>
+  string(5) "shell"
+  [1]=>
+  string(4) "exec"
+  [2]=>
+  string(3) "scp"
+  [3]=>
+  string(12) "direct-tcpip"
+  [4]=>
+  string(15) "forwarded-tcpip"
+}
+int(15)
+bool(true)
+bool(true)
+**Arguments
+NULL
+bool(false)
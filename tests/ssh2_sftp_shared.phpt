@@ -0,0 +1,54 @@
+--TEST--
+ssh2.sftp://Resource id #N URLs share the session's SFTP subsystem
+--SKIPIF--
+<?php
+  require('ssh2_skip.inc');
+  ssh2t_needs_auth();
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (strpos(ob_get_clean(), 'traffic counters => disabled') !== false) print "skip traffic counters disabled";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+var_dump(ssh2t_auth($ssh));
+
+/* Bytes one url_stat() puts on the wire, starting the subsystem costs more than a request */
+function ssh2t_stat_sent($ssh) {
+  clearstatcache();
+  $stats = ssh2_session_stats($ssh);
+  $exists = file_exists("ssh2.sftp://$ssh/");
+  $after = ssh2_session_stats($ssh);
+  return array($exists, $after['bytes_sent'] - $stats['bytes_sent'], $after['sftp_requests']['stat'] - $stats['sftp_requests']['stat']);
+}
+
+list($exists, $first, $stat) = ssh2t_stat_sent($ssh);
+var_dump($exists, $stat);
+list($exists, $second, $stat) = ssh2t_stat_sent($ssh);
+var_dump($exists, $stat);
+list($exists, $third, $stat) = ssh2t_stat_sent($ssh);
+var_dump($exists, $stat);
+var_dump($first > $second, $first > $third);
+
+echo "**Freeing an ssh2_sftp() subsystem leaves the shared one alone\n";
+$sftp = ssh2_sftp($ssh);
+clearstatcache();
+var_dump(file_exists("ssh2.sftp://$sftp/"));
+unset($sftp);
+list($exists, $fourth) = ssh2t_stat_sent($ssh);
+var_dump($exists, $fourth < $first);
+--EXPECT--
+bool(true)
+bool(true)
+int(1)
+bool(true)
+int(1)
+bool(true)
+int(1)
+bool(true)
+bool(true)
+**Freeing an ssh2_sftp() subsystem leaves the shared one alone
+bool(true)
+bool(true)
+bool(true)
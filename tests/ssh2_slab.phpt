@@ -0,0 +1,59 @@
+--TEST--
+ssh2.slab_cache Size class recycling stays within its budget
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded"; ?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+function ssh2t_slab_run($port, $srv) {
+  $ssh = ssh2_connect_async('127.0.0.1', $port);
+  fclose(stream_socket_accept($srv, 5));
+  do {
+    $rc = @ssh2_connect_step($ssh);
+    if (is_int($rc)) {
+      ssh2_connect_wait(array($ssh), 1000);
+    }
+  } while (is_int($rc));
+
+  $memory = ssh2_session_memory($ssh);
+  var_dump($memory['allocations'] > 0);
+  var_dump($memory['bytes'] <= $memory['peak_bytes']);
+  var_dump($memory['slab_hits'] + $memory['slab_misses'] <= $memory['allocations']);
+  var_dump($memory['cached_bytes'] <= ini_get('ssh2.slab_cache'));
+  var_dump($memory['persistent']);
+  return $memory;
+}
+
+$srv = ssh2t_listen($port);
+ssh2t_slab_run($port, $srv);
+
+echo "**Without a cache\n";
+ini_set('ssh2.slab_cache', 0);
+$memory = ssh2t_slab_run($port, $srv);
+var_dump($memory['slab_hits'], $memory['cached_bytes']);
+
+echo "**Persistent\n";
+ini_set('ssh2.slab_persistent', 1);
+ssh2t_slab_run($port, $srv);
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
+**Without a cache
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
+int(0)
+int(0)
+**Persistent
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
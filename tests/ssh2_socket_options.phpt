@@ -0,0 +1,50 @@
+--TEST--
+ssh2_connect_async() methods['socket'] parsing and refused values
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  if (PHP_OS != 'Linux') print "skip Linux only, the refused option is Linux specific";
+?>
+--INI--
+ssh2.breaker_threshold=0
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+
+echo "**Valid\n";
+$ssh = ssh2_connect_async('127.0.0.1', $port, array('socket' => array(
+  'tcp_nodelay' => true, 'sndbuf' => 65536, 'rcvbuf' => '131072', 'keepalive' => 1,
+  'keepidle' => 30, 'keepintvl' => 10.0, 'keepcnt' => 3, 'user_timeout' => 5000, 'tos' => 0x10, 'unknown' => 'ignored',
+)));
+var_dump(is_resource($ssh));
+
+echo "**Not an array\n";
+var_dump(is_resource(ssh2_connect_async('127.0.0.1', $port, array('socket' => 'nodelay'))));
+
+echo "**Bad values\n";
+$ssh = ssh2_connect_async('127.0.0.1', $port, array('socket' => array(
+  'tcp_nodelay' => null, 'sndbuf' => -1, 'rcvbuf' => 'lots', 'keepalive' => array(1), 'keepcnt' => '5', 'tos' => -16,
+)));
+var_dump(is_resource($ssh));
+
+echo "**Refused by the kernel\n";
+var_dump(is_resource(ssh2_connect_async('127.0.0.1', $port, array('socket' => array('keepcnt' => 1000)))));
+--EXPECTF--
+**Valid
+bool(true)
+**Not an array
+bool(true)
+**Bad values
+
+Warning: ssh2_connect_async(): Invalid value for socket option sndbuf, expecting a non-negative integer in %s on line %d
+
+Warning: ssh2_connect_async(): Invalid value for socket option rcvbuf, expecting a non-negative integer in %s on line %d
+
+Warning: ssh2_connect_async(): Invalid value for socket option keepalive, expecting a non-negative integer in %s on line %d
+
+Warning: ssh2_connect_async(): Invalid value for socket option tos, expecting a non-negative integer in %s on line %d
+bool(true)
+**Refused by the kernel
+
+Warning: ssh2_connect_async(): Failed setting socket option TCP_KEEPCNT in %s on line %d
+bool(true)
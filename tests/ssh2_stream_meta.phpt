@@ -0,0 +1,71 @@
+--TEST--
+stream_get_meta_data() Flow control, offset and session of channel and SFTP streams
+--SKIPIF--
+<?php
+  require('ssh2_skip.inc');
+  ssh2t_needs_auth();
+  ssh2t_writes_remote();
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+ob_start();
+phpinfo(INFO_MODULES);
+preg_match('/^libssh2 version => ([\d.]+)/m', ob_get_clean(), $m);
+/* SFTP streams only see their channel with libssh2_sftp_get_channel() */
+$sftp_channel = version_compare($m[1], '1.4.0', '>=');
+
+$ssh = ssh2_connect(TEST_SSH2_HOSTNAME, TEST_SSH2_PORT);
+var_dump(ssh2t_auth($ssh));
+
+echo "**Channel\n";
+$stream = ssh2_exec($ssh, 'echo hello');
+stream_set_blocking($stream, true);
+var_dump(stream_get_contents($stream));
+$meta = stream_get_meta_data($stream);
+var_dump($meta['bytes_read']);
+var_dump(is_int($meta['window_local']), $meta['window_local'] <= $meta['window_local_initial']);
+var_dump(is_int($meta['window_remote']), $meta['window_remote'] <= $meta['window_remote_initial']);
+var_dump($meta['session'] === $ssh);
+fclose($stream);
+
+echo "**SFTP\n";
+$sftp = ssh2_sftp($ssh);
+$filename = ssh2t_tempnam();
+$stream = fopen("ssh2.sftp://$sftp$filename", 'w');
+fwrite($stream, '0123456789');
+fflush($stream);
+$meta = stream_get_meta_data($stream);
+var_dump($meta['offset'], $meta['bytes_written']);
+var_dump(isset($meta['window_local']) == $sftp_channel);
+var_dump($meta['session'] === $ssh);
+fclose($stream);
+
+$stream = fopen("ssh2.sftp://$sftp$filename", 'r');
+fread($stream, 4);
+$meta = stream_get_meta_data($stream);
+var_dump($meta['offset'] >= 4);
+fseek($stream, 2);
+$meta = stream_get_meta_data($stream);
+var_dump($meta['offset']);
+fclose($stream);
+var_dump(ssh2_sftp_unlink($sftp, $filename));
+--EXPECT--
+bool(true)
+**Channel
+string(6) "hello
+"
+int(6)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+**SFTP
+int(10)
+int(10)
+bool(true)
+bool(true)
+bool(true)
+int(2)
+bool(true)
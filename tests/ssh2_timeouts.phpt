@@ -0,0 +1,35 @@
+--TEST--
+ssh2_connect() A handshake with a host that never answers gives up at the handshake timeout
+--SKIPIF--
+<?php if (!extension_loaded("ssh2")) print "skip extension not loaded";
+  ob_start();
+  phpinfo(INFO_MODULES);
+  if (!preg_match('/^libssh2 version => ([\d.]+)/m', ob_get_clean(), $m) || version_compare($m[1], '1.2.9', '<')) {
+    print "skip libssh2 < 1.2.9 has no session timeouts";
+  }
+?>
+--INI--
+ssh2.breaker_threshold=0
+default_socket_timeout=30
+--FILE--
+<?php require('ssh2_test.inc');
+
+$srv = ssh2t_listen($port);
+
+$start = microtime(true);
+var_dump(@ssh2_connect('127.0.0.1', $port, array('timeouts' => array('handshake' => 300))));
+$elapsed = microtime(true) - $start;
+var_dump($elapsed >= 0.2 && $elapsed < 10);
+
+echo "**From ssh2.handshake_timeout\n";
+ini_set('ssh2.handshake_timeout', 300);
+$start = microtime(true);
+var_dump(@ssh2_connect('127.0.0.1', $port));
+$elapsed = microtime(true) - $start;
+var_dump($elapsed >= 0.2 && $elapsed < 10);
+--EXPECT--
+bool(false)
+bool(true)
+**From ssh2.handshake_timeout
+bool(false)
+bool(true)
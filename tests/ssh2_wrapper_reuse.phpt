@@ -0,0 +1,54 @@
+--TEST--
+ssh2.sftp:// URLs with the same credentials share one connection per request
+--SKIPIF--
+<?php require('ssh2_skip.inc'); ssh2t_needs_auth();
+  if (TEST_SSH2_AUTH != 'password') print "skip needs TEST_SSH2_AUTH == 'password'";
+  if (rawurlencode(TEST_SSH2_USER . TEST_SSH2_PASS) != TEST_SSH2_USER . TEST_SSH2_PASS) print "skip credentials don't fit in a URL as they are";
+?>
+--FILE--
+<?php require('ssh2_test.inc');
+
+function ssh2t_wrapper_hits() {
+  ob_start();
+  phpinfo(INFO_MODULES);
+  preg_match('/^wrapper connections reused => (\d+)$/m', ob_get_clean(), $m);
+  return (int)$m[1];
+}
+
+/* opendir() rather than is_dir(), the stat cache would answer repeated calls */
+function ssh2t_opendir($url, $context = null) {
+  $dir = $context ? @opendir($url, $context) : @opendir($url);
+  if (!$dir) {
+    return false;
+  }
+  closedir($dir);
+  return true;
+}
+
+$url = 'ssh2.sftp://' . TEST_SSH2_USER . ':' . TEST_SSH2_PASS . '@' . TEST_SSH2_HOSTNAME . ':' . TEST_SSH2_PORT . '/';
+$hits = ssh2t_wrapper_hits();
+var_dump(ssh2t_opendir($url), ssh2t_opendir($url), ssh2t_opendir($url));
+var_dump(ssh2t_wrapper_hits() - $hits);
+
+echo "**Other credentials get their own connection\n";
+$hits = ssh2t_wrapper_hits();
+var_dump(ssh2t_opendir('ssh2.sftp://' . TEST_SSH2_USER . ':not-' . uniqid() . '@' . TEST_SSH2_HOSTNAME . ':' . TEST_SSH2_PORT . '/'));
+var_dump(ssh2t_wrapper_hits() - $hits);
+
+echo "**Not with reuse off\n";
+$hits = ssh2t_wrapper_hits();
+$context = stream_context_create(array('ssh2' => array('reuse' => false)));
+var_dump(ssh2t_opendir($url, $context), ssh2t_opendir($url, $context));
+var_dump(ssh2t_wrapper_hits() - $hits);
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+int(2)
+**Other credentials get their own connection
+bool(false)
+int(0)
+**Not with reuse off
+bool(true)
+bool(true)
+int(0)